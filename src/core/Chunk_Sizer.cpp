@@ -0,0 +1,92 @@
+#include "core/Chunk_Sizer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include "sample/Placement.hpp"
+
+// doubling the chunk size has to improve the throughput by at least this much
+constexpr double MIN_GAIN = 0.05;
+
+Chunk_Sizer::Chunk_Sizer( const size_t num_branches,
+                          const size_t num_sites,
+                          const size_t memory_budget,
+                          const size_t min_size,
+                          const size_t max_size,
+                          const size_t initial_size,
+                          const bool prescoring)
+  : num_branches_(num_branches)
+  , num_sites_(num_sites)
+  , memory_budget_(memory_budget)
+  , min_size_(min_size)
+  , max_size_(max_size)
+  , prescoring_(prescoring)
+{
+  if (min_size_ == 0 or min_size_ > max_size_) {
+    throw std::runtime_error{std::string("Invalid chunk size bounds: ")
+      + std::to_string(min_size_) + " to " + std::to_string(max_size_)};
+  }
+  size_ = fit_(initial_size);
+}
+
+size_t Chunk_Sizer::chunk_bytes(const size_t num_sequences) const
+{
+  // the worst case, until the heuristic was seen at work
+  const double candidates = sequences_seen_
+                          ? static_cast<double>(candidates_seen_) / sequences_seen_
+                          : static_cast<double>(num_branches_);
+
+  // the sequence itself, its candidate placements, and their entries in the Work
+  double per_sequence = num_sites_ + candidates * (sizeof(Placement) + sizeof(size_t));
+  if (prescoring_) {
+    per_sequence += num_branches_ * sizeof(Placement);
+  }
+  return static_cast<size_t>(num_sequences * per_sequence);
+}
+
+size_t Chunk_Sizer::fit_(const size_t size) const
+{
+  const auto per_sequence = std::max<size_t>(1u, chunk_bytes(1));
+  const auto memory_limit = memory_budget_ / per_sequence;
+  // the lower bound wins over the budget
+  return std::max(min_size_, std::min({size, memory_limit, max_size_}));
+}
+
+void Chunk_Sizer::report(const size_t num_sequences,
+                         const double seconds,
+                         const size_t num_candidates)
+{
+  sequences_seen_ += num_sequences;
+  candidates_seen_ += num_candidates;
+
+  // the last chunk of the input is usually short, and says little about throughput
+  if (growing_ and num_sequences == size_ and seconds > 0.0) {
+    const double rate = num_sequences / seconds;
+    if (rate > best_rate_ * (1.0 + MIN_GAIN)) {
+      best_rate_ = rate;
+      best_size_ = size_;
+      const auto proposed = fit_(size_ * 2);
+      growing_ = (proposed > size_);
+      size_ = proposed;
+    } else {
+      growing_ = false;
+      size_ = best_size_;
+    }
+  }
+
+  // the estimate of the candidates per sequence may have changed
+  size_ = fit_(size_);
+}
+
+size_t default_chunk_memory()
+{
+  const auto pages = sysconf(_SC_PHYS_PAGES);
+  const auto page_size = sysconf(_SC_PAGESIZE);
+  if (pages <= 0 or page_size <= 0) {
+    // 1 GiB
+    return size_t(1) << 30;
+  }
+  return static_cast<size_t>(pages) * static_cast<size_t>(page_size) / 4u;
+}
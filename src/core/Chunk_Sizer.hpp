@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Picks the number of query sequences to read per chunk, and adjusts it from
+ * chunk to chunk (--adaptive-chunk-size):
+ *
+ *  - a chunk has to fit into the memory budget. Per sequence, the dense
+ *    prescoring Sample takes one Placement per branch, and the thorough stage
+ *    one per candidate branch. The latter is learned from the chunks so far,
+ *    starting out with the worst case of all branches.
+ *  - within that, the size is doubled for as long as doing so noticeably
+ *    improves the measured throughput (sequences per second), as larger chunks
+ *    spread the per-chunk setup of the branches over more sequences. Once it
+ *    stops improving, the sizer settles on the best size seen.
+ *  - the result is always within the given bounds.
+ */
+class Chunk_Sizer
+{
+public:
+  Chunk_Sizer(const size_t num_branches,
+              const size_t num_sites,
+              const size_t memory_budget,
+              const size_t min_size,
+              const size_t max_size,
+              const size_t initial_size,
+              const bool prescoring = true);
+  Chunk_Sizer() = delete;
+  ~Chunk_Sizer() = default;
+
+  /**
+   * Number of sequences to read for the next chunk.
+   */
+  size_t next() const { return size_; }
+
+  /**
+   * Feedback after a chunk was placed: its number of sequences, how long that
+   * took, and how many candidate placements the heuristic chose for it.
+   */
+  void report(const size_t num_sequences,
+              const double seconds,
+              const size_t num_candidates);
+
+  /**
+   * Estimated peak memory of a chunk of the given size, in bytes.
+   */
+  size_t chunk_bytes(const size_t num_sequences) const;
+
+  bool settled() const { return not growing_; }
+
+private:
+  size_t fit_(const size_t size) const;
+
+  size_t num_branches_;
+  size_t num_sites_;
+  size_t memory_budget_;
+  size_t min_size_;
+  size_t max_size_;
+  bool prescoring_;
+
+  size_t size_;
+  bool growing_ = true;
+  // best measurement so far, while growing
+  size_t best_size_ = 0;
+  double best_rate_ = 0.0;
+
+  size_t sequences_seen_ = 0;
+  size_t candidates_seen_ = 0;
+};
+
+/**
+ * Default memory budget for the chunks when none is given: a quarter of the
+ * physical memory of the machine.
+ */
+size_t default_chunk_memory();
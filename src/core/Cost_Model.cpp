@@ -0,0 +1,111 @@
+#include "core/Cost_Model.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <utility>
+#include <cmath>
+
+// weight of a new measurement, as one chunk may well be unlike the previous ones
+constexpr double CALIBRATION_ALPHA = 0.5;
+
+Cost_Sample& Cost_Sample::operator+=(const Cost_Sample& other)
+{
+  for (size_t tip = 0; tip < 2; ++tip) {
+    builds_[tip] += other.builds_[tip];
+    build_seconds_[tip] += other.build_seconds_[tip];
+    sites_[tip] += other.sites_[tip];
+    place_seconds_[tip] += other.place_seconds_[tip];
+  }
+  return *this;
+}
+
+static void move_towards(double& estimate, const double measured)
+{
+  estimate = (1.0 - CALIBRATION_ALPHA) * estimate + CALIBRATION_ALPHA * measured;
+}
+
+void Cost_Model::calibrate(const Cost_Sample& sample)
+{
+  for (size_t tip = 0; tip < 2; ++tip) {
+    if (sample.builds_[tip]) {
+      move_towards(build_[tip], sample.build_seconds_[tip] / sample.builds_[tip]);
+    }
+    if (sample.sites_[tip]) {
+      move_towards(per_site_[tip], sample.place_seconds_[tip] / sample.sites_[tip]);
+    }
+  }
+}
+
+/**
+ * Splits a bundle into the given number of parts of about equal cost.
+ */
+static std::vector<Bundle> split(const Bundle& bundle, const size_t parts)
+{
+  std::vector<Bundle> result;
+  const double share = (bundle.cost - bundle.setup) / parts;
+
+  result.emplace_back(bundle.branch_id, bundle.setup);
+  double current = 0.0;
+  for (size_t i = 0; i < bundle.sequences.size(); ++i) {
+    const bool full = current > 0.0 and current + bundle.costs[i] / 2.0 > share;
+    if (full and result.size() < parts) {
+      result.emplace_back(bundle.branch_id, bundle.setup);
+      current = 0.0;
+    }
+    result.back().add(bundle.sequences[i], bundle.costs[i]);
+    current += bundle.costs[i];
+  }
+  return result;
+}
+
+std::vector<std::vector<Bundle>> balance_bundles( std::vector<Bundle> bundles,
+                                                  const size_t num_threads)
+{
+  std::vector<std::vector<Bundle>> result(std::max<size_t>(1u, num_threads));
+
+  double total = 0.0;
+  for (const auto& bundle : bundles) {
+    total += bundle.cost;
+  }
+  const double share = total / result.size();
+
+  // split up the ones that would keep a thread busy beyond its share
+  if (result.size() > 1 and share > 0.0) {
+    std::vector<Bundle> pieces;
+    for (auto& bundle : bundles) {
+      const auto parts = std::min(static_cast<size_t>(std::ceil(bundle.cost / share)),
+                                  bundle.sequences.size());
+      if (parts > 1) {
+        for (auto& piece : split(bundle, parts)) {
+          pieces.push_back(std::move(piece));
+        }
+      } else {
+        pieces.push_back(std::move(bundle));
+      }
+    }
+    bundles = std::move(pieces);
+  }
+
+  std::sort(std::begin(bundles), std::end(bundles),
+    [](const Bundle& lhs, const Bundle& rhs) {
+      return lhs.cost > rhs.cost;
+    });
+
+  // (load, thread), least loaded on top
+  using load_type = std::pair<double, size_t>;
+  std::priority_queue<load_type, std::vector<load_type>, std::greater<load_type>> loads;
+  for (size_t i = 0; i < result.size(); ++i) {
+    loads.emplace(0.0, i);
+  }
+
+  for (auto& bundle : bundles) {
+    auto least = loads.top();
+    loads.pop();
+    least.first += bundle.cost;
+    result[least.second].push_back(std::move(bundle));
+    loads.push(least);
+  }
+
+  return result;
+}
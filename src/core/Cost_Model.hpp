@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Measured times of the thorough placement, per kind of branch (leading to a
+ * tip or not): how long the Tiny_Trees took to build, and how long the queries
+ * took to place, along with the number of sites that were placed.
+ *
+ * Meant to be collected thread-locally, and then merged.
+ */
+class Cost_Sample
+{
+public:
+  void build(const bool tip, const double seconds)
+  {
+    ++builds_[tip];
+    build_seconds_[tip] += seconds;
+  }
+
+  void place(const bool tip, const size_t sites, const double seconds)
+  {
+    sites_[tip] += sites;
+    place_seconds_[tip] += seconds;
+  }
+
+  Cost_Sample& operator+=(const Cost_Sample& other);
+
+private:
+  friend class Cost_Model;
+
+  std::array<size_t, 2> builds_ = {{0, 0}};
+  std::array<double, 2> build_seconds_ = {{0.0, 0.0}};
+  std::array<size_t, 2> sites_ = {{0, 0}};
+  std::array<double, 2> place_seconds_ = {{0.0, 0.0}};
+};
+
+/**
+ * Estimated cost (in seconds) of the thorough placement. Building the Tiny_Tree
+ * of a branch is paid once per branch and thread, placing a query costs time
+ * proportional to the number of sites in its premasked range. Both differ
+ * between branches leading to a tip and inner ones.
+ *
+ * Starts out with rough guesses, and is calibrated from measured times as the
+ * run goes on.
+ */
+class Cost_Model
+{
+public:
+  Cost_Model() = default;
+  ~Cost_Model() = default;
+
+  double build_cost(const bool tip) const { return build_[tip]; }
+  double place_cost(const bool tip, const size_t sites) const
+  {
+    return per_site_[tip] * sites;
+  }
+
+  /**
+   * Moves the estimates towards the measured ones. Kinds of branches that were
+   * not measured keep their estimates.
+   */
+  void calibrate(const Cost_Sample& sample);
+
+private:
+  std::array<double, 2> build_ = {{1.0e-3, 1.0e-3}};
+  std::array<double, 2> per_site_ = {{1.0e-6, 1.0e-6}};
+};
+
+/**
+ * Queries to place on the same branch, by one thread.
+ */
+struct Bundle
+{
+  Bundle() = default;
+  Bundle(const size_t branch_id, const double setup)
+    : branch_id(branch_id)
+    , setup(setup)
+    , cost(setup)
+  { }
+
+  void add(const size_t sequence_id, const double sequence_cost)
+  {
+    sequences.push_back(sequence_id);
+    costs.push_back(sequence_cost);
+    cost += sequence_cost;
+  }
+
+  size_t branch_id = 0;
+  // of building the Tiny_Tree for the branch
+  double setup = 0.0;
+  std::vector<size_t> sequences;
+  std::vector<double> costs;
+  // total, including the setup
+  double cost = 0.0;
+};
+
+/**
+ * Distributes bundles over the given number of threads, such that their total
+ * costs are as even as possible: longest processing time first, each bundle
+ * goes to the thread with the least work so far.
+ *
+ * Each bundle stays in one piece, so that its branch is built only once.
+ * Bundles that cost more than the even share of a thread are split into as
+ * many as it takes to fit, each of which pays for building the branch again.
+ */
+std::vector<std::vector<Bundle>> balance_bundles( std::vector<Bundle> bundles,
+                                                  const size_t num_threads);
@@ -7,13 +7,22 @@
 #include <limits>
 #include <cassert>
 #include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
 
+#include "net/Shared_Segment.hpp"
 #include "util/Matrix.hpp"
 #include "util/maps.hpp"
 #include "util/Range.hpp"
 
 constexpr size_t INVALID = std::numeric_limits<size_t>::max();
 
+// the per branch state of shared lookup matrices is an atomic in memory mapped
+// by several processes, which only works if it is lock-free (and thereby
+// address-free)
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "std::atomic<int> has to be lock-free");
+
 class Lookup_Store
 {
 /**
@@ -26,6 +35,10 @@ class Lookup_Store
  * char_to_posish: maps ascii char to a column in a lookup_matrix. This also normalizes the input!
  *                 meaning: map upper and lowercase to the same CLV site, different variants of
  *                 GAP (-?Xx etc.) and ANY (N), U into T (RNA support) and defines invalid chars
+ * shared_: if set (see share_across_node), the lookup matrices live in memory shared by all
+ *          ranks on the machine instead of in store_, together with a state per branch
+ * gap_sums_: per branch, the prefix sums over the sites of the gap column of its lookup_matrix,
+ *            such that the gap sites of a query don't need to be looked up one by one
  */
 public:
   using lookup_type = Matrix<double>;
@@ -33,6 +46,7 @@ public:
   Lookup_Store(const size_t num_branches, const size_t num_states) 
     : branch_(num_branches)
     , store_(num_branches)
+    , gap_sums_(num_branches)
     , char_map_size_((num_states == 4) ? NT_MAP_SIZE : AA_MAP_SIZE)
     , char_map_((num_states == 4) ? NT_MAP : AA_MAP)
   {
@@ -66,13 +80,81 @@ public:
       char_to_posish_['x'] = char_to_posish_['N'];
     }
     char_to_posish_['?'] = char_to_posish_['-'];
+
+    gap_posish_ = char_to_posish_['-'];
   }
 
   Lookup_Store()  = delete;
   ~Lookup_Store() = default;
 
+  /**
+   * Moves the lookup matrices into memory shared with the other ranks on this
+   * machine, such that each one is computed and stored only once per machine.
+   * Has to be called before any branch is initialized. Collective under MPI.
+   */
+  void share_across_node(const size_t num_sites)
+  {
+    num_sites_ = num_sites;
+    const size_t num_branches = store_.size();
+    const size_t state_bytes = ((num_branches * sizeof(std::atomic<int>) + 63) / 64) * 64;
+    const size_t table_size = num_sites * char_map_size_ + num_sites + 1;
+
+    shared_ = std::make_unique<Shared_Segment>(state_bytes + num_branches * table_size * sizeof(double));
+    claimed_.assign(num_branches, false);
+    auto base = static_cast<char*>(shared_->data());
+    state_ = reinterpret_cast<std::atomic<int>*>(base);
+    tables_ = reinterpret_cast<double*>(base + state_bytes);
+    shared_gap_sums_ = tables_ + num_branches * num_sites * char_map_size_;
+
+    if (shared_->owner()) {
+      for (size_t i = 0; i < num_branches; ++i) {
+        new (&state_[i]) std::atomic<int>(EMPTY);
+      }
+    }
+    shared_->barrier();
+  }
+
+  /**
+   * Has the lookup matrices hold one row per site pattern of the reference
+   * instead of one per site, given the pattern of each site.
+   */
+  void use_site_patterns(const std::vector<unsigned int>& site_to_pattern)
+  {
+    site_to_pattern_ = site_to_pattern;
+  }
+
+  /**
+   * Whether the caller is to compute the lookup matrix of the branch and pass
+   * it to init_branch. With shared matrices, only one rank per machine is, the
+   * others wait for that rank to finish. Call under the lock of get_mutex.
+   */
+  bool claim_branch(const size_t branch_id)
+  {
+    if (not shared_) {
+      return not has_branch(branch_id);
+    }
+    if (claimed_[branch_id]) {
+      return true;
+    }
+
+    int expected = EMPTY;
+    if (state_[branch_id].compare_exchange_strong(expected, BUSY)) {
+      claimed_[branch_id] = true;
+      return true;
+    }
+    while (state_[branch_id].load(std::memory_order_acquire) != READY) {
+      std::this_thread::yield();
+    }
+    return false;
+  }
+
   void init_branch(const size_t branch_id, std::vector<std::vector<double>> precomps)
   {
+    if (shared_) {
+      init_shared_branch_(branch_id, precomps);
+      return;
+    }
+
     store_[branch_id] = Matrix<double>(precomps[0].size(), char_map_size_);
 
     for(size_t ch = 0; ch < precomps.size(); ++ch) {
@@ -80,6 +162,9 @@ public:
         store_[branch_id](site, ch) = precomps[ch][site];
       }
     }
+
+    gap_sums_[branch_id].resize(precomps[0].size() + 1);
+    fill_gap_sums_(precomps, gap_sums_[branch_id].data());
   }
 
   std::mutex& get_mutex(const size_t branch_id)
@@ -89,6 +174,9 @@ public:
 
   bool has_branch(const size_t branch_id) 
   {
+    if (shared_) {
+      return state_[branch_id].load(std::memory_order_acquire) == READY;
+    }
     return store_[branch_id].size() != 0; 
   }
 
@@ -126,43 +214,97 @@ public:
 
   double sum_precomputed_sitelk(const size_t branch_id, const std::string& seq, const Range& range) const
   {
-    assert(seq.length() == store_[branch_id].rows());
+    assert(not site_to_pattern_.empty() or
+           seq.length() == (shared_ ? num_sites_ : store_[branch_id].rows()));
     
     double sum = 0;
-    const auto& lookup_matrix = store_[branch_id];
-    const auto& lookup = lookup_matrix.get_array();
+    const auto lookup = shared_
+                      ? tables_ + branch_id * num_sites_ * char_map_size_
+                      : store_[branch_id].get_array().data();
+    const auto cols = char_map_size_;
+
+    if (not site_to_pattern_.empty()) {
+      return sum_patterns_(lookup, seq, range);
+    }
 
-    // unrolled loop
-    size_t site = range.begin;
+    const auto gap_sums = shared_
+                        ? shared_gap_sums_ + branch_id * (num_sites_ + 1)
+                        : gap_sums_[branch_id].data();
     const size_t end = range.begin + range.span;
 
-    const size_t stride = 4;
-    for (; site + stride-1u < end; site+=stride) {
-      double sum_one =
-      lookup[lookup_matrix.coord(site, char_to_posish_[seq[site]])]
-      + lookup[lookup_matrix.coord(site+1u, char_to_posish_[seq[site+1u]])];
-      
-      double sum_two =
-      lookup[lookup_matrix.coord(site+2u, char_to_posish_[seq[site+2u]])]
-      + lookup[lookup_matrix.coord(site+3u, char_to_posish_[seq[site+3u]])];
+    // score the range as if it were all gaps, then correct for the sites that are not
+    sum = gap_sums[end] - gap_sums[range.begin];
 
-      sum_one += sum_two;
+    for (size_t site = range.begin; site < end; ++site) {
+      const auto pos = char_to_posish_[seq[site]];
+      if (pos != gap_posish_) {
+        sum += lookup[site * cols + pos] - lookup[site * cols + gap_posish_];
+      }
+    }
+    return sum;
+  }
+
+private:
+  enum { EMPTY = 0, BUSY, READY };
 
-      sum += sum_one;
+  void fill_gap_sums_(const std::vector<std::vector<double>>& precomps, double * gap_sums) const
+  {
+    const auto& gaps = precomps[gap_posish_];
+    gap_sums[0] = 0.0;
+    for (size_t site = 0; site < gaps.size(); ++site) {
+      gap_sums[site + 1] = gap_sums[site] + gaps[site];
     }
+  }
+
+  double sum_patterns_(double const * const lookup, const std::string& seq, const Range& range) const
+  {
+    assert(seq.length() == site_to_pattern_.size());
 
-    // rest of the horizontal add
-    while (site < end) {
-      sum += lookup[lookup_matrix.coord(site, char_to_posish_[seq[site]])];
-      ++site;
+    double sum = 0;
+    const auto cols = char_map_size_;
+    const size_t end = range.begin + range.span;
+    for (size_t site = range.begin; site < end; ++site) {
+      sum += lookup[site_to_pattern_[site] * cols + char_to_posish_[seq[site]]];
     }
     return sum;
   }
 
-private:
+  void init_shared_branch_(const size_t branch_id, const std::vector<std::vector<double>>& precomps)
+  {
+    // if another rank got to it first, its table is used instead
+    if (not claim_branch(branch_id)) {
+      return;
+    }
+
+    assert(precomps[0].size() == num_sites_);
+    auto table = tables_ + branch_id * num_sites_ * char_map_size_;
+    for(size_t ch = 0; ch < precomps.size(); ++ch) {
+      for(size_t site = 0; site < precomps[ch].size(); ++site) {
+        table[site * char_map_size_ + ch] = precomps[ch][site];
+      }
+    }
+    fill_gap_sums_(precomps, shared_gap_sums_ + branch_id * (num_sites_ + 1));
+    state_[branch_id].store(READY, std::memory_order_release);
+    claimed_[branch_id] = false;
+  }
+
   std::vector<std::mutex> branch_;
   std::vector<lookup_type> store_;
+  std::vector<std::vector<double>> gap_sums_;
   const size_t char_map_size_;
   const unsigned char * char_map_;
   std::array<size_t, 128> char_to_posish_;
+  size_t gap_posish_;
+
+  std::unique_ptr<Shared_Segment> shared_;
+  std::atomic<int>* state_ = nullptr;
+  // per branch, whether this rank won the right to fill its shared table.
+  // Not a vector<bool>, as different branches are claimed concurrently
+  std::vector<char> claimed_;
+  double* tables_ = nullptr;
+  double* shared_gap_sums_ = nullptr;
+  size_t num_sites_ = 0;
+
+  // empty, unless the rows of the lookup matrices are site patterns
+  std::vector<unsigned int> site_to_pattern_;
 };
@@ -5,6 +5,13 @@
 #include <memory>
 #include <functional>
 #include <limits>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <stdexcept>
 
 #ifdef __OMP
 #include <omp.h>
@@ -15,9 +22,12 @@
 #include "io/msa_reader.hpp"
 #include "io/Binary_Fasta.hpp"
 #include "io/jplace_writer.hpp"
+#include "io/Checkpoint.hpp"
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
 #include "util/Timer.hpp"
+#include "util/hash.hpp"
+#include "util/Range.hpp"
 #include "tree/Tiny_Tree.hpp"
 #include "net/mpihead.hpp"
 #include "pipeline/schedule.hpp"
@@ -29,11 +39,14 @@
 #include "core/Lookup_Store.hpp"
 #include "core/Work.hpp"
 #include "core/heuristics.hpp"
+#include "core/Chunk_Sizer.hpp"
+#include "core/Cost_Model.hpp"
 #include "sample/Sample.hpp"
 #include "set_manipulators.hpp"
 
 #ifdef __MPI
 #include "net/epa_mpi_util.hpp"
+#include "net/Work_Distributor.hpp"
 #endif
 
 using mytimer = Timer<std::chrono::milliseconds>;
@@ -106,6 +119,12 @@ static void place(MSA& msa,
   }
 }
 
+// either end of the branch is a tip
+static bool is_tip_branch(pll_unode_t const * const node)
+{
+  return not node->next or not node->back->next;
+}
+
 template <class T>
 static void place_thorough(const Work& to_place,
                   MSA& msa,
@@ -114,6 +133,7 @@ static void place_thorough(const Work& to_place,
                   Sample<T>& sample,
                   const Options& options,
                   std::shared_ptr<Lookup_Store>& lookup_store,
+                  Cost_Model& costs,
                   const size_t seq_id_offset=0,
                   mytimer* time=nullptr)
 {
@@ -132,133 +152,461 @@ static void place_thorough(const Work& to_place,
   // split the sample structure such that the parts are thread-local
   std::vector<Sample<T>> sample_parts(num_threads);
 
-  // build vector of elements
-  std::vector<Work::Work_Pair> id;
-  for(auto it = to_place.begin(); it != to_place.end(); ++it) {
-    id.push_back(*it);
+  // one bundle per branch, with the estimated cost of each of its queries
+  std::vector<Bundle> bundles;
+  for (auto it = to_place.bin_cbegin(); it != to_place.bin_cend(); ++it) {
+    const auto branch_id = it->first;
+    const bool tip = is_tip_branch(branches[branch_id]);
+    bundles.emplace_back(branch_id, costs.build_cost(tip));
+    for (const auto seq_id : it->second) {
+      const auto& sequence = msa[seq_id].sequence();
+      const size_t sites = options.premasking
+                         ? get_valid_range(sequence).span
+                         : sequence.size();
+      bundles.back().add(seq_id, costs.place_cost(tip, sites));
+    }
   }
+  const auto per_thread = balance_bundles(std::move(bundles), num_threads);
 
   // Map from sequence indices to indices in the pquery vector.
   auto seq_lookup_vec = std::vector<std::unordered_map<size_t, size_t>>(num_threads);
+  std::vector<Cost_Sample> measured(num_threads);
 
-  std::vector<std::unique_ptr<Tiny_Tree>> branch_ptrs(num_threads);
-  auto prev_branch_id = std::numeric_limits<size_t>::max();
+  using clock = std::chrono::steady_clock;
+  auto seconds_since = [](const clock::time_point& start) {
+    return std::chrono::duration<double>(clock::now() - start).count();
+  };
 
   // work seperately
   if (time){
     time->start();
   }
 #ifdef __OMP
-  #pragma omp parallel for schedule(dynamic), firstprivate(prev_branch_id)
-#endif
-  for (size_t i = 0; i < id.size(); ++i) {
-
-#ifdef __OMP
-    const auto tid = omp_get_thread_num();
-#else
-    const auto tid = 0;
+  #pragma omp parallel for schedule(static, 1)
 #endif
-    auto& local_sample = sample_parts[tid];
-    auto& seq_lookup = seq_lookup_vec[tid];
-
-    const auto branch_id = id[i].branch_id;
-    const auto seq_id = id[i].sequence_id;
-    const auto& seq = msa[seq_id];
-
-    // get a tiny tree representing the current branch,
-    // IF the branch has changed. Overwriting the old variable ensures
-    // the now unused previous tiny tree is deallocated
-    if ((branch_id != prev_branch_id) or not branch_ptrs[tid]) {
-      // as make_unique produces an rvalue, this is a move assignment and thus legal
-      branch_ptrs[tid] = std::make_unique<Tiny_Tree>(branches[branch_id],
-                                           branch_id,
-                                           reference_tree,
-                                           true,
-                                           options,
-                                           lookup_store);
-    }
-
-    if (seq_lookup.count( seq_id ) == 0) {
-      auto const new_idx = local_sample.add_pquery( seq_id_offset + seq_id, seq.header() );
-      seq_lookup[ seq_id ] = new_idx;
+  for (size_t part = 0; part < per_thread.size(); ++part) {
+
+    auto& local_sample = sample_parts[part];
+    auto& seq_lookup = seq_lookup_vec[part];
+    auto& local_costs = measured[part];
+
+    for (const auto& bundle : per_thread[part]) {
+      const auto branch_id = bundle.branch_id;
+      const bool tip = is_tip_branch(branches[branch_id]);
+
+      auto start = clock::now();
+      Tiny_Tree branch(branches[branch_id],
+                       branch_id,
+                       reference_tree,
+                       true,
+                       options,
+                       lookup_store);
+      local_costs.build(tip, seconds_since(start));
+
+      for (const auto seq_id : bundle.sequences) {
+        const auto& seq = msa[seq_id];
+
+        if (seq_lookup.count( seq_id ) == 0) {
+          auto const new_idx = local_sample.add_pquery( seq_id_offset + seq_id, seq.header() );
+          seq_lookup[ seq_id ] = new_idx;
+        }
+        assert( seq_lookup.count( seq_id ) > 0 );
+
+        const size_t sites = options.premasking
+                           ? get_valid_range(seq.sequence()).span
+                           : seq.sequence().size();
+        start = clock::now();
+        local_sample[ seq_lookup[ seq_id ] ].emplace_back( branch.place(seq) );
+        local_costs.place(tip, sites, seconds_since(start));
+      }
     }
-    assert( seq_lookup.count( seq_id ) > 0 );
-    local_sample[ seq_lookup[ seq_id ] ].emplace_back( branch_ptrs[tid]->place(seq) );
-
-    prev_branch_id = branch_id;
   }
   if (time){
     time->stop();
   }
+
+  Cost_Sample total;
+  for (const auto& part : measured) {
+    total += part;
+  }
+  costs.calibrate(total);
+
   // merge samples back
   merge(sample, std::move(sample_parts));
   collapse(sample);
 }
 
-void simple_mpi(Tree& reference_tree,
+/**
+ * Periodic checkpoints of the main placement loop, and resuming from them (see
+ * Checkpoint). Counts the chunks placed by this rank.
+ *
+ * Under MPI, ranks write their blocks to the jplace file in rounds, so a
+ * checkpoint needs all of them to take part. Checkpoints are therefore only
+ * taken for as long as every rank still has chunks left.
+ */
+class Checkpointer
+{
+public:
+  Checkpointer( const std::string& newick,
+                raxml::Model& model,
                 const std::string& query_file,
                 const MSA_Info& msa_info,
                 const std::string& outdir,
-                const Options& options,
-                const std::string& invocation)
-{
-  const auto num_branches = reference_tree.nums().branches;
+                const Options& options)
+    : file_name_(Checkpoint::file_name(outdir))
+    , interval_(options.checkpoint_interval)
+    , enabled_(options.checkpoint_interval or options.resume)
+    , chunk_size_(options.chunk_size)
+  {
+    if (not enabled_) {
+      return;
+    }
 
-  // get all edges
-  std::vector<pll_unode_t *> branches(num_branches);
-  auto num_traversed_branches = utree_query_branches(reference_tree.tree(), &branches[0]);
-  if (num_traversed_branches != num_branches) {
-    throw std::runtime_error{"Traversing the utree went wrong during pipeline startup!"};
+    int num_ranks = 1;
+    MPI_COMM_SIZE(MPI_COMM_WORLD, &num_ranks);
+
+    // the fewest number of chunks any rank gets, see local_seq_package
+    const size_t num_sequences = msa_info.sequences();
+    const size_t part_size = (num_sequences + num_ranks - 1) / num_ranks;
+    const size_t last_part = num_sequences - std::min(num_sequences, part_size * (num_ranks - 1));
+    common_chunks_ = (std::min(part_size, last_part) + chunk_size_ - 1) / chunk_size_;
+
+    std::ostringstream model_string;
+    model_string << model;
+    checkpoint_ = Checkpoint( fnv1a(model_string.str(), fnv1a(newick)),
+                              settings_hash_(options),
+                              query_file,
+                              chunk_size_,
+                              num_ranks);
+
+    if (options.resume) {
+      if (not std::ifstream(file_name_)) {
+        LOG_WARN << "No checkpoint found at " << file_name_ << ", starting from the beginning.";
+        return;
+      }
+      const auto previous = Checkpoint::load(file_name_);
+      checkpoint_.check_resumable(previous);
+
+      chunks_done_ = previous.chunks_done();
+      start_.bytes = previous.bytes_written();
+      start_.blocks = previous.blocks_written();
+      checkpoint_.progress(chunks_done_, start_.bytes, start_.blocks);
+      LOG_INFO << "Resuming after chunk " << chunks_done_ << " of every rank";
+    }
   }
 
-  auto lookups =
-    std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states);
+  /**
+   * Once the run is complete, the checkpoint is of no further use. Meant to be
+   * declared before the jplace_writer, such that this happens after the output
+   * was finalized.
+   */
+  ~Checkpointer()
+  {
+    int local_rank = 0;
+    MPI_COMM_RANK(MPI_COMM_WORLD, &local_rank);
+    if (enabled_ and complete_ and local_rank == 0) {
+      std::remove(file_name_.c_str());
+    }
+  }
 
-  auto reader = make_msa_reader(query_file,
-                                msa_info,
-                                options.premasking,
-                                true);
+  void complete() { complete_ = true; }
+
+  // where the output of the previous run ends
+  jplace_writer::Position start() const { return start_; }
+
+  /**
+   * Reads past the chunks that were placed before the checkpoint. Returns the
+   * number of sequences skipped.
+   */
+  size_t skip(msa_reader& reader) const
+  {
+    MSA chunk;
+    size_t skipped = 0;
+    for (size_t i = 0; i < chunks_done_; ++i) {
+      const auto num_sequences = reader.read_next(chunk, chunk_size_);
+      if (num_sequences == 0) {
+        break;
+      }
+      skipped += num_sequences;
+    }
+    return skipped;
+  }
 
-  size_t num_sequences = 0;
-  Work all_work(std::make_pair(0, num_branches), std::make_pair(0, options.chunk_size));
+  /**
+   * To be called after the results of a chunk were passed to the writer. A
+   * checkpoint syncs the output with the other ranks, so every rank has to
+   * call this from its main thread, after each of its chunks.
+   */
+  void chunk_done(jplace_writer& jplace)
+  {
+    ++chunks_done_;
+    if (not interval_ or chunks_done_ % interval_ or chunks_done_ > common_chunks_) {
+      return;
+    }
 
-  Work blo_work;
+    #ifdef __MPI
+    int is_main = 0;
+    MPI_Is_thread_main(&is_main);
+    if (not is_main) {
+      throw std::runtime_error{"Checkpoints have to be taken on the main thread"};
+    }
+    #endif
 
-  size_t chunk_num = 1;
+    const auto position = jplace.sync();
+    checkpoint_.progress(chunks_done_, position.bytes, position.blocks);
 
-  using Sample = Sample<Placement>;
-  std::future<void> prev_gather;
-  MSA chunk;
-  size_t sequences_done = 0; // not just for info output!
+    int local_rank = 0;
+    MPI_COMM_RANK(MPI_COMM_WORLD, &local_rank);
+    if (local_rank == 0) {
+      checkpoint_.save(file_name_);
+    }
+    LOG_DBG << "Checkpoint after chunk " << chunks_done_;
+  }
 
-  // prepare output file
-  LOG_INFO << "Output file: " << outdir + "epa_result.jplace";
-  jplace_writer jplace( outdir, "epa_result.jplace",
-                        get_numbered_newick_string( reference_tree.tree(),
-                                                    reference_tree.mapper(),
-                                                    options.precision ),
-                        invocation,
-                        reference_tree.mapper());
-  jplace.set_precision( options.precision );
+private:
+  // the settings that change what ends up in the output
+  static uint64_t settings_hash_(const Options& options)
+  {
+    auto hash = fnv1a_value(options.prescoring);
+    hash = fnv1a_value(options.prescoring_by_percentage, hash);
+    hash = fnv1a_value(options.prescoring_threshold, hash);
+    hash = fnv1a_value(options.baseball, hash);
+    hash = fnv1a_value(options.sliding_blo, hash);
+    hash = fnv1a_value(options.premasking, hash);
+    hash = fnv1a_value(options.repeats, hash);
+    hash = fnv1a_value(options.scaling, hash);
+    hash = fnv1a_value(options.support_threshold, hash);
+    hash = fnv1a_value(options.acc_threshold, hash);
+    hash = fnv1a_value(options.filter_min, hash);
+    hash = fnv1a_value(options.filter_max, hash);
+    hash = fnv1a_value(options.precision, hash);
+    return hash;
+  }
 
-  Sample preplace(options.chunk_size, num_branches);
+  std::string file_name_;
+  size_t interval_;
+  bool enabled_;
+  bool complete_ = false;
+  size_t chunk_size_;
+  size_t common_chunks_ = 0;
+  size_t chunks_done_ = 0;
+  Checkpoint checkpoint_;
+  jplace_writer::Position start_;
+};
+
+/**
+ * A chunk of query sequences, passed through the stages of the placement
+ * pipeline along with everything computed for it so far.
+ */
+class Chunk_Token : public Token
+{
+public:
+  Chunk_Token()   = default;
+  ~Chunk_Token()  = default;
 
-  while ( (num_sequences = reader->read_next(chunk, options.chunk_size)) ) {
+  Chunk_Token(Chunk_Token const& other) = default;
+  Chunk_Token(Chunk_Token && other) = default;
 
-    assert(chunk.size() == num_sequences);
+  Chunk_Token& operator=(Chunk_Token const&) = default;
+  Chunk_Token& operator=(Chunk_Token &&) = default;
 
-    LOG_DBG << "num_sequences: " << num_sequences << std::endl;
+  size_t size() { return msa.size(); }
 
-    const size_t seq_id_offset = sequences_done + reader->local_seq_offset();;
+  void clear()
+  {
+    msa.clear();
+    preplace.clear();
+    work.clear();
+    result.clear();
+  }
+
+  MSA msa;
+  size_t seq_id_offset = 0;
+  Sample<Placement> preplace;
+  Work work;
+  Sample<Placement> result;
+};
+
+/**
+ * Overlapped variant of the main placement loop: reading, prescoring, thorough
+ * placement and output each run on their own thread, such that reading of chunk
+ * N+2, prescoring of N+1 and thorough placement of N happen at the same time.
+ * The available threads are split between the two compute stages. The output
+ * stage keeps the calling thread, as it is the one to make the MPI calls.
+ */
+static void place_pipelined(Tree& reference_tree,
+                            const std::vector<pll_unode_t *>& branches,
+                            std::shared_ptr<Lookup_Store>& lookups,
+                            msa_reader& reader,
+                            jplace_writer& jplace,
+                            Checkpointer& checkpointer,
+                            const Options& options)
+{
+  const auto num_branches = branches.size();
+  const size_t num_threads = get_num_threads(options);
+
+  // the OpenMP teams of each stage are independent of each other
+  Options prescoring_options(options);
+  Options thorough_options(options);
+  if (options.prescoring) {
+    prescoring_options.num_threads = std::max<size_t>(1u, num_threads / 2u);
+    thorough_options.num_threads = std::max<size_t>(1u, num_threads - prescoring_options.num_threads);
+  } else {
+    prescoring_options.num_threads = 1u;
+    thorough_options.num_threads = num_threads;
+  }
+  LOG_DBG << "Pipeline threads: prescoring " << prescoring_options.num_threads
+          << ", thorough " << thorough_options.num_threads;
+
+  // calibrated across chunks
+  Cost_Model costs;
+
+  size_t sequences_read = checkpointer.skip(reader);
+  size_t sequences_done = sequences_read;
 
-    if (num_sequences < options.chunk_size) {
-      all_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
-      preplace = Sample(num_sequences, num_branches);
+  auto read_stage = [&](VoidToken&) {
+    Chunk_Token chunk;
+    const auto num_sequences = reader.read_next(chunk.msa, options.chunk_size);
+    if (num_sequences == 0) {
+      chunk.is_last(true);
+      return chunk;
     }
+    chunk.seq_id_offset = sequences_read + reader.local_seq_offset();
+    sequences_read += num_sequences;
+    return chunk;
+  };
 
+  auto prescoring_stage = [&](Chunk_Token& chunk) {
+    const auto num_sequences = chunk.msa.size();
     if (options.prescoring) {
+      chunk.preplace = Sample<Placement>(num_sequences, num_branches);
+      place(chunk.msa,
+            reference_tree,
+            branches,
+            chunk.preplace,
+            prescoring_options,
+            lookups);
+      chunk.work = apply_heuristic(chunk.preplace, prescoring_options);
+      chunk.preplace.clear();
+    } else {
+      chunk.work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
+    }
+    return std::move(chunk);
+  };
 
-      LOG_DBG << "Preplacement." << std::endl;
+  auto thorough_stage = [&](Chunk_Token& chunk) {
+    place_thorough( chunk.work,
+                    chunk.msa,
+                    reference_tree,
+                    branches,
+                    chunk.result,
+                    thorough_options,
+                    lookups,
+                    costs,
+                    chunk.seq_id_offset);
+    return std::move(chunk);
+  };
+
+  auto write_stage = [&](Chunk_Token& chunk) {
+    compute_and_set_lwr(chunk.result);
+    filter(chunk.result, options);
+    jplace.write(chunk.result);
+    checkpointer.chunk_done(jplace);
+
+    sequences_done += chunk.msa.size();
+    LOG_INFO << sequences_done  << " Sequences done!";
+    return VoidToken();
+  };
+
+  auto pipe = make_pipeline(read_stage, []{}, []{}, [&jplace]{ jplace.wait(); })
+    .push(prescoring_stage)
+    .push(thorough_stage)
+    .push(write_stage);
+
+  pipe.process_concurrent();
+}
+
+#ifdef __MPI
+/**
+ * Variant of the main placement loop where chunks are handed out on demand by
+ * a Work_Distributor, so that ranks that happen to get cheap queries take on
+ * more of them. Each rank writes its results to the shared jplace file at the
+ * offsets it is given, which keep the blocks in the order of the chunks. Until
+ * the chunks before it are finished, a block is held back. A rank holding back
+ * max_held_blocks blocks stops taking on chunks until some of them are written.
+ */
+static void place_distributed(Tree& reference_tree,
+                              const std::vector<pll_unode_t *>& branches,
+                              std::shared_ptr<Lookup_Store>& lookups,
+                              msa_reader& reader,
+                              jplace_writer& jplace,
+                              const Options& options)
+{
+  const auto num_branches = branches.size();
+  const size_t max_held_blocks = 8;
+
+  const auto header_bytes = jplace.begin_unordered();
+  Work_Distributor distributor(reader.num_sequences(), options.chunk_size, header_bytes);
+
+  MSA chunk;
+  Work blo_work;
+  Sample<Placement> preplace;
+  Cost_Model costs;
+  std::string block;
+  size_t chunk_id = 0;
+  size_t sequences_done = 0;
+
+  // finished blocks, by chunk, that wait for their slot in the file
+  std::unordered_map<size_t, std::string> held;
+  auto write_slots = [&](const std::vector<Work_Distributor::Slot>& slots) {
+    for (auto const& slot : slots) {
+      auto it = held.find(slot.chunk_id);
+      if (it == held.end()) {
+        throw std::runtime_error{"No output held for chunk " + std::to_string(slot.chunk_id)};
+      }
+      jplace.write_at(std::move(it->second), slot.offset, slot.first_block);
+      held.erase(it);
+    }
+  };
+
+  while (true) {
+    const auto bytes = block.size();
+    if (bytes) {
+      held.emplace(chunk_id, std::move(block));
+    }
+    block = std::string();
+
+    // report the output of the previous chunk, and get the next one
+    auto wants_chunk = held.size() < max_held_blocks;
+    auto ticket = distributor.next(bytes, wants_chunk);
+    write_slots(ticket.slots);
+
+    // holding back too much: wait for the chunks before ours to finish
+    while (not wants_chunk) {
+      wants_chunk = held.size() < max_held_blocks;
+      if (not wants_chunk) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      ticket = distributor.next(0, wants_chunk);
+      write_slots(ticket.slots);
+    }
+
+    if (not ticket.has_chunk) {
+      break;
+    }
+    chunk_id = ticket.chunk_id;
+
+    const auto seq_id_offset = distributor.chunk_begin(ticket.chunk_id);
+    const auto num_sequences = reader.read_range(chunk,
+                                                 seq_id_offset,
+                                                 distributor.chunk_length(ticket.chunk_id));
+
+    LOG_DBG << "Chunk " << ticket.chunk_id << ", num_sequences: " << num_sequences;
+
+    if (options.prescoring) {
+      if (preplace.size() != num_sequences) {
+        preplace = Sample<Placement>(num_sequences, num_branches);
+      }
       place(chunk,
             reference_tree,
             branches,
@@ -266,17 +614,12 @@ void simple_mpi(Tree& reference_tree,
             options,
             lookups);
 
-      LOG_DBG << "Selecting candidates." << std::endl;
-
       blo_work = apply_heuristic(preplace, options);
-
     } else {
-      blo_work = all_work;
+      blo_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
     }
 
-    Sample blo_sample;
-
-    LOG_DBG << "BLO Placement." << std::endl;
+    Sample<Placement> blo_sample;
     place_thorough( blo_work,
                     chunk,
                     reference_tree,
@@ -284,21 +627,218 @@ void simple_mpi(Tree& reference_tree,
                     blo_sample,
                     options,
                     lookups,
+                    costs,
                     seq_id_offset);
 
-    // Output
     compute_and_set_lwr(blo_sample);
     filter(blo_sample, options);
 
+    block = jplace.serialize(blo_sample);
+
+    sequences_done += num_sequences;
+    LOG_INFO << sequences_done  << " Sequences done!";
+  }
+
+  std::vector<Work_Distributor::Slot> slots;
+  const auto total_bytes = distributor.finish(slots);
+  write_slots(slots);
+
+  jplace.wait();
+  jplace.end_unordered( total_bytes );
+}
+#endif //__MPI
+
+Placer::Placer(Tree& reference_tree, const Options& options)
+  : reference_tree_(reference_tree)
+  , options_(options)
+  , branches_(reference_tree.nums().branches)
+{
+  const auto num_branches = reference_tree.nums().branches;
+
+  // get all edges
+  auto num_traversed_branches = utree_query_branches(reference_tree.tree(), &branches_[0]);
+  if (num_traversed_branches != num_branches) {
+    throw std::runtime_error{"Traversing the utree went wrong during pipeline startup!"};
+  }
+
+  lookups_ = std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states);
+  if (reference_tree.patterns()) {
+    lookups_->use_site_patterns(reference_tree.patterns().map());
+  }
+  if (options.shared_memory) {
+    lookups_->share_across_node(reference_tree.partition()->sites);
+  }
+}
+
+Sample<Placement> Placer::place(MSA& queries, const size_t seq_id_offset)
+{
+  const auto num_sequences = queries.size();
+  const auto num_branches = branches_.size();
+
+  if (num_sequences == 0) {
+    last_work_size_ = 0;
+    return Sample<Placement>();
+  }
+
+  Work blo_work;
+  if (options_.prescoring) {
+    if (num_sequences != preplace_.size()) {
+      preplace_ = Sample<Placement>(num_sequences, num_branches);
+    }
+
+    LOG_DBG << "Preplacement." << std::endl;
+    ::place(queries,
+            reference_tree_,
+            branches_,
+            preplace_,
+            options_,
+            lookups_);
+
+    LOG_DBG << "Selecting candidates." << std::endl;
+    blo_work = apply_heuristic(preplace_, options_);
+  } else {
+    blo_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
+  }
+  last_work_size_ = blo_work.size();
+
+  Sample<Placement> blo_sample;
+
+  LOG_DBG << "BLO Placement." << std::endl;
+  place_thorough( blo_work,
+                  queries,
+                  reference_tree_,
+                  branches_,
+                  blo_sample,
+                  options_,
+                  lookups_,
+                  costs_,
+                  seq_id_offset);
+
+  compute_and_set_lwr(blo_sample);
+  filter(blo_sample, options_);
+
+  return blo_sample;
+}
+
+void simple_mpi(Tree& reference_tree,
+                const std::string& query_file,
+                const MSA_Info& msa_info,
+                const std::string& outdir,
+                const Options& options,
+                const std::string& invocation)
+{
+  Placer placer(reference_tree, options);
+  auto& branches = placer.branches();
+  auto& lookups = placer.lookups();
+  const auto num_branches = branches.size();
+
+  int num_ranks = 1;
+  MPI_COMM_SIZE(MPI_COMM_WORLD, &num_ranks);
+  // the pipeline reads its input strictly in order, so it gets a fixed share.
+  // Same for checkpoints, which record how far into its share each rank is
+  const bool checkpoints = options.checkpoint_interval or options.resume;
+  const bool distribute = (num_ranks > 1) and options.dynamic_distribution
+                          and not options.pipeline and not checkpoints;
+
+  if (distribute) {
+    prepare_random_access(query_file);
+  }
+
+  auto reader = make_msa_reader(query_file,
+                                msa_info,
+                                options.premasking,
+                                not distribute);
+
+  size_t num_sequences = 0;
+
+  size_t chunk_num = 1;
+
+  std::future<void> prev_gather;
+  MSA chunk;
+  size_t sequences_done = 0; // not just for info output!
+
+  const auto newick = get_numbered_newick_string( reference_tree.tree(),
+                                                  reference_tree.mapper(),
+                                                  options.precision );
+  Checkpointer checkpointer(newick, reference_tree.model(), query_file, msa_info, outdir, options);
+
+  // prepare output file
+  LOG_INFO << "Output file: " << outdir + "epa_result.jplace";
+  jplace_writer jplace( outdir, "epa_result.jplace",
+                        newick,
+                        invocation,
+                        reference_tree.mapper(),
+                        checkpointer.start());
+  jplace.set_precision( options.precision );
+
+  if (options.pipeline) {
+    place_pipelined(reference_tree, branches, lookups, *reader, jplace, checkpointer, options);
+    jplace.finish();
+    checkpointer.complete();
+    MPI_BARRIER(MPI_COMM_WORLD);
+    return;
+  }
+
+  #ifdef __MPI
+  if (distribute) {
+    place_distributed(reference_tree, branches, lookups, *reader, jplace, options);
+    MPI_BARRIER(MPI_COMM_WORLD);
+    return;
+  }
+  #endif
+
+  // fixed, unless adapted to the memory budget and the measured throughput
+  std::unique_ptr<Chunk_Sizer> sizer;
+  if (options.adaptive_chunk_size) {
+    const size_t memory = options.chunk_memory
+                        ? size_t(options.chunk_memory) << 20
+                        : default_chunk_memory();
+    sizer = std::make_unique<Chunk_Sizer>(num_branches,
+                                          reference_tree.num_sites(),
+                                          memory,
+                                          options.min_chunk_size,
+                                          options.max_chunk_size,
+                                          options.chunk_size,
+                                          options.prescoring);
+    LOG_DBG << "Initial chunk size: " << sizer->next();
+  }
+  auto chunk_size = sizer ? sizer->next() : options.chunk_size;
+
+  sequences_done = checkpointer.skip(*reader);
+
+  while ( (num_sequences = reader->read_next(chunk, chunk_size)) ) {
+
+    assert(chunk.size() == num_sequences);
+
+    LOG_DBG << "num_sequences: " << num_sequences << std::endl;
+
+    mytimer chunk_time;
+    chunk_time.start();
+
+    const size_t seq_id_offset = sequences_done + reader->local_seq_offset();;
+
+    auto blo_sample = placer.place(chunk, seq_id_offset);
+
     // pass the result chunk to the writer
     jplace.write( blo_sample );
+    checkpointer.chunk_done(jplace);
+
+    if (sizer) {
+      chunk_time.stop();
+      sizer->report(num_sequences, chunk_time.seconds(), placer.last_work_size());
+      if (sizer->next() != chunk_size) {
+        LOG_DBG << "Chunk size: " << chunk_size << " -> " << sizer->next();
+      }
+      chunk_size = sizer->next();
+    }
 
     sequences_done += num_sequences;
     LOG_INFO << sequences_done  << " Sequences done!";
     ++chunk_num;
   }
 
-  jplace.wait();
+  jplace.finish();
+  checkpointer.complete();
 
   MPI_BARRIER(MPI_COMM_WORLD);
 }
@@ -1,12 +1,60 @@
 #pragma once
 
+#include "seq/MSA.hpp"
 #include "seq/MSA_Stream.hpp"
 #include "seq/MSA_Info.hpp"
 #include "util/Options.hpp"
 #include "tree/Tree.hpp"
 #include "core/raxml/Model.hpp"
+#include "core/Lookup_Store.hpp"
+#include "core/Cost_Model.hpp"
+#include "sample/Sample.hpp"
+#include "sample/Placement.hpp"
 
 #include <string>
+#include <vector>
+#include <memory>
+
+/**
+ * In-process placement against a reference tree that is built once: holds the
+ * branches, the prescoring lookup tables and the calibrated cost model, all of
+ * which carry over from one batch of queries to the next.
+ *
+ * Not thread safe itself, as every batch is placed on all configured threads.
+ */
+class Placer
+{
+public:
+  Placer(Tree& reference_tree, const Options& options);
+  Placer() = delete;
+  ~Placer() = default;
+
+  Placer(Placer const& other) = delete;
+  Placer& operator= (Placer const& other) = delete;
+
+  /**
+   * Places a batch of queries, as a chunk of the query file would be: prescoring
+   * and heuristic (if enabled), thorough placement, then LWRs and filtering.
+   * Query ids in the result start at seq_id_offset.
+   */
+  Sample<Placement> place(MSA& queries, const size_t seq_id_offset = 0);
+
+  // number of thorough placements in the last batch
+  size_t last_work_size() const { return last_work_size_; }
+
+  Tree& reference_tree() { return reference_tree_; }
+  const std::vector<pll_unode_t*>& branches() const { return branches_; }
+  std::shared_ptr<Lookup_Store>& lookups() { return lookups_; }
+
+private:
+  Tree& reference_tree_;
+  Options options_;
+  std::vector<pll_unode_t*> branches_;
+  std::shared_ptr<Lookup_Store> lookups_;
+  Cost_Model costs_;
+  Sample<Placement> preplace_;
+  size_t last_work_size_ = 0;
+};
 
 void simple_mpi(Tree& tree,
                 const std::string& query_file,
@@ -0,0 +1,152 @@
+#include "core/pll/Partition_Slices.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+Partition_Slices::Partition_Slices( pll_partition_t * partition,
+                                    const unsigned int num_slices)
+  : param_indices_(partition->rate_cats, 0)
+{
+  // site repeats and ascertainment bias correction need all sites at once
+  const bool whole = (partition->attributes & PLL_ATTRIB_SITE_REPEATS)
+                  or (partition->attributes & PLL_ATTRIB_AB_FLAG);
+  const size_t sites = partition->sites;
+  const size_t count = whole ? 1 : std::max<size_t>(1, std::min<size_t>(num_slices, sites));
+
+  const size_t clv_size = partition->rate_cats * partition->states_padded;
+  const size_t scaler_size = (partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+                           ? partition->rate_cats : 1;
+  const size_t num_clvs = partition->tips + partition->clv_buffers;
+  const bool pattern_tip = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+
+  slices_.resize(count);
+  results_.resize(2 * count);
+
+  for (size_t i = 0; i < count; ++i) {
+    const size_t begin = sites * i / count;
+    const size_t span  = sites * (i + 1) / count - begin;
+
+    auto& slice = slices_[i];
+    slice.partition = *partition;
+    slice.partition.sites = span;
+
+    slice.clv.resize(num_clvs, nullptr);
+    for (size_t c = 0; c < num_clvs; ++c) {
+      if (partition->clv[c]) {
+        slice.clv[c] = partition->clv[c] + begin * clv_size;
+      }
+    }
+    slice.partition.clv = slice.clv.data();
+
+    slice.scale_buffer.resize(partition->scale_buffers, nullptr);
+    for (size_t s = 0; s < partition->scale_buffers; ++s) {
+      if (partition->scale_buffer[s]) {
+        slice.scale_buffer[s] = partition->scale_buffer[s] + begin * scaler_size;
+      }
+    }
+    slice.partition.scale_buffer = slice.scale_buffer.data();
+
+    if (pattern_tip) {
+      slice.tipchars.resize(partition->tips, nullptr);
+      for (size_t t = 0; t < partition->tips; ++t) {
+        if (partition->tipchars[t]) {
+          slice.tipchars[t] = partition->tipchars[t] + begin;
+        }
+      }
+      slice.partition.tipchars = slice.tipchars.data();
+
+      // same size as allocated by libpll
+      const size_t lookup_size = (size_t(1) << (2 * partition->log2_maxstates)) * clv_size;
+      slice.ttlookup.reset(static_cast<double*>(
+        pll_aligned_alloc(lookup_size * sizeof(double), partition->alignment)));
+      if (not slice.ttlookup) {
+        throw std::runtime_error{"Cannot allocate the tip-tip lookup of a partition slice"};
+      }
+      slice.partition.ttlookup = slice.ttlookup.get();
+    }
+
+    slice.partition.pattern_weights = partition->pattern_weights + begin;
+    if (partition->invariant) {
+      slice.partition.invariant = partition->invariant + begin;
+    }
+
+    const size_t sites_alloc = span + ((partition->attributes & PLL_ATTRIB_AB_FLAG)
+                                        ? partition->states : 0);
+    slice.sumtable.reset(static_cast<double*>(
+      pll_aligned_alloc(sites_alloc * clv_size * sizeof(double), partition->alignment)));
+    if (not slice.sumtable) {
+      throw std::runtime_error{"Cannot allocate the sumtable of a partition slice"};
+    }
+  }
+}
+
+void Partition_Slices::update_partials( const pll_operation_t * operations,
+                                        const unsigned int count)
+{
+  #ifdef __OMP
+  #pragma omp parallel for schedule(static) num_threads(slices_.size()) if(slices_.size() > 1)
+  #endif
+  for (size_t i = 0; i < slices_.size(); ++i) {
+    pll_update_partials(&slices_[i].partition, operations, count);
+  }
+}
+
+double Partition_Slices::edge_loglikelihood(pll_unode_t const * const node)
+{
+  #ifdef __OMP
+  #pragma omp parallel for schedule(static) num_threads(slices_.size()) if(slices_.size() > 1)
+  #endif
+  for (size_t i = 0; i < slices_.size(); ++i) {
+    results_[i] = pll_compute_edge_loglikelihood( &slices_[i].partition,
+                                                  node->clv_index,
+                                                  node->scaler_index,
+                                                  node->back->clv_index,
+                                                  node->back->scaler_index,
+                                                  node->pmatrix_index,
+                                                  param_indices_.data(),
+                                                  nullptr);
+  }
+  return std::accumulate(results_.begin(), results_.begin() + slices_.size(), 0.0);
+}
+
+void Partition_Slices::update_sumtable(pll_unode_t const * const node)
+{
+  #ifdef __OMP
+  #pragma omp parallel for schedule(static) num_threads(slices_.size()) if(slices_.size() > 1)
+  #endif
+  for (size_t i = 0; i < slices_.size(); ++i) {
+    pll_update_sumtable(&slices_[i].partition,
+                        node->clv_index,
+                        node->back->clv_index,
+                        node->scaler_index,
+                        node->back->scaler_index,
+                        param_indices_.data(),
+                        slices_[i].sumtable.get());
+  }
+}
+
+void Partition_Slices::derivatives( pll_unode_t const * const node,
+                                    const double length,
+                                    double * df,
+                                    double * ddf)
+{
+  const size_t count = slices_.size();
+
+  #ifdef __OMP
+  #pragma omp parallel for schedule(static) num_threads(count) if(count > 1)
+  #endif
+  for (size_t i = 0; i < count; ++i) {
+    pll_compute_likelihood_derivatives( &slices_[i].partition,
+                                        node->scaler_index,
+                                        node->back->scaler_index,
+                                        length,
+                                        param_indices_.data(),
+                                        slices_[i].sumtable.get(),
+                                        &results_[i],
+                                        &results_[count + i]);
+  }
+  *df  = std::accumulate(results_.begin(), results_.begin() + count, 0.0);
+  *ddf = std::accumulate(results_.begin() + count, results_.end(), 0.0);
+}
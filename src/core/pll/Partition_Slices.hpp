@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "core/pll/pllhead.hpp"
+
+/**
+ * Views of a partition that each span a contiguous range of its sites, such that
+ * likelihoods and branch length derivatives over all sites can be computed on
+ * several threads at once.
+ *
+ * The views share everything with the partition (CLV and scaler memory, model,
+ * pmatrices), except for the shifted CLV, scaler and tipchar pointers, and a
+ * sumtable and tip-tip lookup table of their own. Hence pmatrices and model
+ * parameters are to be set on the partition itself, before evaluating the
+ * slices.
+ *
+ * Partials are summed per slice in a fixed order, making the results
+ * reproducible for a given number of slices.
+ */
+class Partition_Slices
+{
+public:
+  Partition_Slices(pll_partition_t * partition, const unsigned int num_slices);
+  Partition_Slices() = delete;
+  ~Partition_Slices() = default;
+
+  Partition_Slices(Partition_Slices const& other) = delete;
+  Partition_Slices& operator= (Partition_Slices const& other) = delete;
+
+  size_t size() const { return slices_.size(); }
+
+  void update_partials(const pll_operation_t * operations, const unsigned int count);
+
+  // log-likelihood over the branch between node and node->back
+  double edge_loglikelihood(pll_unode_t const * const node);
+
+  // sumtable for the branch between node and node->back, prerequisite for derivatives
+  void update_sumtable(pll_unode_t const * const node);
+  void derivatives( pll_unode_t const * const node,
+                    const double length,
+                    double * df,
+                    double * ddf);
+
+private:
+  struct Slice
+  {
+    pll_partition_t partition;
+    std::vector<double*> clv;
+    std::vector<unsigned int*> scale_buffer;
+    std::vector<unsigned char*> tipchars;
+    std::unique_ptr<double, void(*)(void*)> sumtable{nullptr, pll_aligned_free};
+    // rebuilt by every tip-tip update of a pattern tip partition
+    std::unique_ptr<double, void(*)(void*)> ttlookup{nullptr, pll_aligned_free};
+  };
+
+  std::vector<Slice> slices_;
+  std::vector<unsigned int> param_indices_;
+  std::vector<double> results_;
+};
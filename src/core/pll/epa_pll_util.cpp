@@ -2,6 +2,12 @@
 
 #include <unordered_map>
 #include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
 
 #include "core/pll/pll_util.hpp"
 #include "core/pll/optimize.hpp"
@@ -11,32 +17,36 @@ void link_tree_msa( pll_utree_t * tree,
                     pll_partition_t * partition,
                     raxml::Model& model,
                     const MSA& msa,
-                    const unsigned int num_tip_nodes)
+                    const unsigned int num_tip_nodes,
+                    const bool set_tip_states)
 {
   assert( num_tip_nodes == msa.size() );
 
-  // associate the sequences from the MSA file with the correct tips
-  /* create a hash table of size num_tip_nodes */
-  std::unordered_map<std::string, unsigned int> map; // mapping labels to tip clv indices
+  // the tips may already be set by another rank sharing them (see Tree)
+  if (set_tip_states) {
+    // associate the sequences from the MSA file with the correct tips
+    /* create a hash table of size num_tip_nodes */
+    std::unordered_map<std::string, unsigned int> map; // mapping labels to tip clv indices
 
-  /* populate the hash table with tree tip labels */
-  for (size_t i = 0; i < num_tip_nodes; ++i) {
-    map[tree->nodes[i]->label] = i;
-  }
+    /* populate the hash table with tree tip labels */
+    for (size_t i = 0; i < num_tip_nodes; ++i) {
+      map[tree->nodes[i]->label] = i;
+    }
 
-  /* find sequences in hash table and link them with the corresponding taxa */
-  for (auto const &s : msa) {
-    auto map_value = map.find(s.header());
+    /* find sequences in hash table and link them with the corresponding taxa */
+    for (auto const &s : msa) {
+      auto map_value = map.find(s.header());
 
-    // failure tolerance: the MSA may also contain query sequences
-    if (map_value == map.end()) {
-      continue;
-      // throw runtime_error{std::string("Sequence with header does not appear in the tree: ") + s.header()};
-    }
+      // failure tolerance: the MSA may also contain query sequences
+      if (map_value == map.end()) {
+        continue;
+        // throw runtime_error{std::string("Sequence with header does not appear in the tree: ") + s.header()};
+      }
 
-    auto clv_index = map_value->second;
-    // associates the sequence with the tip by calculating the tips clv buffers
-    pll_set_tip_states(partition, clv_index, model.charmap(), s.sequence().c_str());
+      auto clv_index = map_value->second;
+      // associates the sequence with the tip by calculating the tips clv buffers
+      pll_set_tip_states(partition, clv_index, model.charmap(), s.sequence().c_str());
+    }
   }
 
   if ( model.empirical_base_freqs() ) {
@@ -46,59 +56,142 @@ void link_tree_msa( pll_utree_t * tree,
   raxml::assign(partition, model);
 }
 
+/**
+ * Computes the pmatrices of all branches and the CLVs of all three directions of
+ * every inner node.
+ *
+ * Each directional CLV depends on the two it points towards. They are computed
+ * in levels: first the ones whose children are both tips, then the ones that
+ * only depend on those, and so on. The operations within a level are
+ * independent of each other, and are carried out in parallel.
+ */
 void precompute_clvs( pll_utree_t const * const tree,
                       pll_partition_t * partition,
-                      const Tree_Numbers& nums)
+                      const Tree_Numbers& nums,
+                      const bool update_partials,
+                      const unsigned int num_threads)
 {
-  /* various buffers for creating a postorder traversal and operations structures */
   std::vector<unsigned int> param_indices(partition->rate_cats, 0);
-  std::vector<pll_unode_t*> travbuffer(nums.nodes);
-  std::vector<double> branch_lengths(nums.branches);
-  std::vector<unsigned int> matrix_indices(nums.branches);
-  std::vector<pll_operation_t> operations(nums.nodes);
 
-  const auto root = get_root(tree);
+  std::vector<pll_unode_t*> branches(nums.branches);
+  const auto num_branches = utree_query_branches(tree, &branches[0]);
+
+  std::vector<double> branch_lengths(num_branches);
+  std::vector<unsigned int> matrix_indices(num_branches);
+  for (size_t i = 0; i < num_branches; ++i) {
+    branch_lengths[i] = branches[i]->length;
+    matrix_indices[i] = branches[i]->pmatrix_index;
+  }
+
+  pll_update_prob_matrices(partition,
+                           &param_indices[0],             // use model 0
+                           &matrix_indices[0],
+                           &branch_lengths[0],
+                           num_branches);
+
+  if (not update_partials) {
+    return;
+  }
 
-  utree_free_node_data(root);
+  // every inner direction, indexed by its (unique) CLV index
+  const size_t num_tips = tree->tip_count;
+  const size_t num_directions = 3 * tree->inner_count;
+  auto index = [num_tips, num_directions](pll_unode_t const * const node) {
+    if (node->clv_index < num_tips or node->clv_index - num_tips >= num_directions) {
+      throw std::runtime_error{"CLV indices are not unique per direction (precompute_clvs)"};
+    }
+    return node->clv_index - num_tips;
+  };
 
-  for (size_t i = 0; i < tree->tip_count; ++i) {
+  std::vector<pll_unode_t*> directions(num_directions, nullptr);
+  for (size_t i = num_tips; i < num_tips + tree->inner_count; ++i) {
     const auto node = tree->nodes[i];
-    /* perform a partial postorder traversal of the unrooted tree  starting at the current tip
-      and returning every node whose clv in the direction of the tip hasn't been calculated yet*/
-    unsigned int traversal_size = 0;
-    unsigned int num_matrices = 0;
-    unsigned int num_ops = 0;
-    if (pll_utree_traverse( node->back,
-                            PLL_TREE_TRAVERSE_POSTORDER,
-                            cb_partial_traversal,
-                            &travbuffer[0],
-                            &traversal_size)
-                != PLL_SUCCESS) {
-      throw std::runtime_error{"Function pll_unode_traverse() requires inner nodes as parameters"};
+    for (auto direction : {node, node->next, node->next->next}) {
+      directions[ index(direction) ] = direction;
     }
+  }
+
+  // number of children of each direction whose CLV is still missing
+  std::vector<unsigned int> missing(num_directions, 0);
+  std::vector<pll_unode_t*> level;
+  for (size_t i = 0; i < num_directions; ++i) {
+    const auto node = directions[i];
+    missing[i] = (node->next->back->next ? 1 : 0) + (node->next->next->back->next ? 1 : 0);
+    if (missing[i] == 0) {
+      level.push_back(node);
+    }
+  }
+
+#ifdef __OMP
+  // site repeats share scratch buffers within the partition
+  const int threads = (partition->attributes & PLL_ATTRIB_SITE_REPEATS)
+                    ? 1
+                    : (num_threads ? num_threads : omp_get_max_threads());
+#else
+  (void) num_threads;
+#endif
+
+  size_t num_done = 0;
+  std::vector<pll_operation_t> operations;
+  while (not level.empty()) {
+    operations.resize(level.size());
+    for (size_t i = 0; i < level.size(); ++i) {
+      const auto node = level[i];
+      const auto child1 = node->next->back;
+      const auto child2 = node->next->next->back;
+      auto& op = operations[i];
+      op.parent_clv_index     = node->clv_index;
+      op.parent_scaler_index  = node->scaler_index;
+      op.child1_clv_index     = child1->clv_index;
+      op.child1_scaler_index  = child1->scaler_index;
+      op.child1_matrix_index  = child1->pmatrix_index;
+      op.child2_clv_index     = child2->clv_index;
+      op.child2_scaler_index  = child2->scaler_index;
+      op.child2_matrix_index  = child2->pmatrix_index;
+    }
+
+    // with pattern tips, a tip-tip update first rebuilds the lookup table of the
+    // partition from its own matrices, so those run one after the other
+    size_t first = 0;
+    if (partition->attributes & PLL_ATTRIB_PATTERN_TIP) {
+      auto tip_tip = [num_tips](const pll_operation_t& op) {
+        return op.child1_clv_index < num_tips and op.child2_clv_index < num_tips;
+      };
+      first = std::stable_partition(operations.begin(), operations.end(), tip_tip)
+            - operations.begin();
+      for (size_t i = 0; i < first; ++i) {
+        pll_update_partials(partition, &operations[i], 1);
+      }
+    }
+
+#ifdef __OMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threads) if(operations.size() - first > 1)
+#endif
+    for (size_t i = first; i < operations.size(); ++i) {
+      pll_update_partials(partition, &operations[i], 1);
+    }
+    num_done += level.size();
+
+    // the directions pointing towards the ones just computed may now be ready
+    std::vector<pll_unode_t*> next_level;
+    for (const auto node : level) {
+      const auto parent = node->back;
+      if (not parent->next) {
+        continue;
+      }
+      for (auto dependent : {parent->next, parent->next->next}) {
+        if (--missing[ index(dependent) ] == 0) {
+          next_level.push_back(dependent);
+        }
+      }
+    }
+    level = std::move(next_level);
+  }
 
-    /* given the computed traversal descriptor, generate the operations
-       structure, and the corresponding probability matrix indices that
-       may need recomputing */
-    pll_utree_create_operations(&travbuffer[0],
-                                traversal_size,
-                                &branch_lengths[0],
-                                &matrix_indices[0],
-                                &operations[0],
-                                &num_matrices,
-                                &num_ops);
-
-    pll_update_prob_matrices(partition,
-                             &param_indices[0],             // use model 0
-                             &matrix_indices[0],// matrices to update
-                             &branch_lengths[0],
-                             num_matrices); // how many should be updated
-
-    /* use the operations array to compute all num_ops inner CLVs. Operations
-       will be carried out sequentially starting from operation 0 towrds num_ops-1 */
-    pll_update_partials(partition, &operations[0], num_ops);
+  if (num_done != num_directions) {
+    throw std::runtime_error{std::string("Could only compute ") + std::to_string(num_done)
+      + " of " + std::to_string(num_directions) + " reference CLVs (precompute_clvs)"};
   }
-  utree_free_node_data(root);
 }
 
 void split_combined_msa(MSA& source,
@@ -15,10 +15,13 @@ void link_tree_msa( pll_utree_t * tree,
                     pll_partition_t * partition, 
                     raxml::Model& model, 
                     const MSA& msa, 
-                    const unsigned int num_tip_nodes);
+                    const unsigned int num_tip_nodes,
+                    const bool set_tip_states = true);
 void precompute_clvs( pll_utree_t const * const tree, 
                       pll_partition_t * partition, 
-                      const Tree_Numbers& nums);
+                      const Tree_Numbers& nums,
+                      const bool update_partials = true,
+                      const unsigned int num_threads = 0);
 void split_combined_msa(MSA& source, 
                         MSA& target, 
                         Tree& tree);
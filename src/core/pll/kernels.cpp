@@ -0,0 +1,360 @@
+#include "core/pll/kernels.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+/**
+ * Likelihood kernels for a fixed number of states and rate categories, on
+ * partitions whose states are not padded.
+ */
+template <size_t STATES, size_t RATES>
+struct Kernel
+{
+  /* the CLV of one site, expanded from the tip state if stored as tipchars */
+  static const double * site_clv( pll_partition_t const * const partition,
+                                  const unsigned int clv_index,
+                                  const size_t site,
+                                  double * buffer)
+  {
+    if ((partition->attributes & PLL_ATTRIB_PATTERN_TIP) and clv_index < partition->tips) {
+      // with 4 states, libpll stores the state itself as the tipchar
+      const auto code = partition->tipchars[clv_index][site];
+      const pll_state_t state = (STATES == 4) ? code : partition->tipmap[code];
+      for (size_t k = 0; k < STATES; ++k) {
+        buffer[k] = ((state >> k) & 1) ? 1.0 : 0.0;
+      }
+      for (size_t r = 1; r < RATES; ++r) {
+        std::copy(buffer, buffer + STATES, buffer + r * STATES);
+      }
+      return buffer;
+    }
+    return partition->clv[clv_index] + site * STATES * RATES;
+  }
+
+  static unsigned int const * scaler( pll_partition_t const * const partition,
+                                      const int scaler_index)
+  {
+    return (scaler_index == PLL_SCALE_BUFFER_NONE) ? nullptr : partition->scale_buffer[scaler_index];
+  }
+
+  static void update_partial( pll_partition_t * partition,
+                              const pll_operation_t& op)
+  {
+    const size_t sites = partition->sites;
+    double * parent = partition->clv[op.parent_clv_index];
+    const double * left_matrix  = partition->pmatrix[op.child1_matrix_index];
+    const double * right_matrix = partition->pmatrix[op.child2_matrix_index];
+
+    unsigned int * parent_scaler = (op.parent_scaler_index == PLL_SCALE_BUFFER_NONE)
+                                 ? nullptr : partition->scale_buffer[op.parent_scaler_index];
+    const auto left_scaler  = scaler(partition, op.child1_scaler_index);
+    const auto right_scaler = scaler(partition, op.child2_scaler_index);
+
+    double left_buffer[STATES * RATES];
+    double right_buffer[STATES * RATES];
+
+    for (size_t n = 0; n < sites; ++n) {
+      const auto left  = site_clv(partition, op.child1_clv_index, n, left_buffer);
+      const auto right = site_clv(partition, op.child2_clv_index, n, right_buffer);
+      auto site = parent + n * STATES * RATES;
+      bool scale = true;
+
+      for (size_t r = 0; r < RATES; ++r) {
+        const auto lmat = left_matrix  + r * STATES * STATES;
+        const auto rmat = right_matrix + r * STATES * STATES;
+        const auto lclv = left  + r * STATES;
+        const auto rclv = right + r * STATES;
+
+        for (size_t j = 0; j < STATES; ++j) {
+          double terma = 0.0;
+          double termb = 0.0;
+          for (size_t k = 0; k < STATES; ++k) {
+            terma += lmat[j * STATES + k] * lclv[k];
+            termb += rmat[j * STATES + k] * rclv[k];
+          }
+          site[r * STATES + j] = terma * termb;
+          scale = scale and (site[r * STATES + j] < PLL_SCALE_THRESHOLD);
+        }
+      }
+
+      if (parent_scaler) {
+        parent_scaler[n] = (left_scaler ? left_scaler[n] : 0)
+                         + (right_scaler ? right_scaler[n] : 0);
+        if (scale) {
+          for (size_t i = 0; i < STATES * RATES; ++i) {
+            site[i] *= PLL_SCALE_FACTOR;
+          }
+          parent_scaler[n] += 1;
+        }
+      }
+    }
+  }
+
+  static double edge_loglikelihood( pll_partition_t * partition,
+                                    const unsigned int parent_clv_index,
+                                    const int parent_scaler_index,
+                                    const unsigned int child_clv_index,
+                                    const int child_scaler_index,
+                                    const unsigned int matrix_index,
+                                    double * persite_lnl)
+  {
+    const size_t sites = partition->sites;
+    const double * freqs = partition->frequencies[0];
+    const double * rate_weights = partition->rate_weights;
+    const double * pmatrix = partition->pmatrix[matrix_index];
+    const auto parent_scaler = scaler(partition, parent_scaler_index);
+    const auto child_scaler  = scaler(partition, child_scaler_index);
+    const double log_threshold = std::log(PLL_SCALE_THRESHOLD);
+
+    double parent_buffer[STATES * RATES];
+    double child_buffer[STATES * RATES];
+
+    double logl = 0.0;
+    for (size_t n = 0; n < sites; ++n) {
+      const auto parent = site_clv(partition, parent_clv_index, n, parent_buffer);
+      const auto child  = site_clv(partition, child_clv_index, n, child_buffer);
+
+      double terma = 0.0;
+      for (size_t r = 0; r < RATES; ++r) {
+        const auto pmat = pmatrix + r * STATES * STATES;
+        double terma_r = 0.0;
+        for (size_t j = 0; j < STATES; ++j) {
+          double termb = 0.0;
+          for (size_t k = 0; k < STATES; ++k) {
+            termb += pmat[j * STATES + k] * child[r * STATES + k];
+          }
+          terma_r += parent[r * STATES + j] * freqs[j] * termb;
+        }
+        terma += terma_r * rate_weights[r];
+      }
+
+      const unsigned int scale = (parent_scaler ? parent_scaler[n] : 0)
+                               + (child_scaler ? child_scaler[n] : 0);
+      double site_lk = std::log(terma);
+      if (scale) {
+        site_lk += scale * log_threshold;
+      }
+      site_lk *= partition->pattern_weights[n];
+
+      if (persite_lnl) {
+        persite_lnl[n] = site_lk;
+      }
+      logl += site_lk;
+    }
+    return logl;
+  }
+
+  static void update_sumtable(pll_partition_t * partition,
+                              const unsigned int parent_clv_index,
+                              const unsigned int child_clv_index,
+                              double * sumtable)
+  {
+    const size_t sites = partition->sites;
+    const double * freqs = partition->frequencies[0];
+    const double * eigenvecs = partition->eigenvecs[0];
+    const double * inv_eigenvecs = partition->inv_eigenvecs[0];
+
+    // the left eigenvectors weighted by the frequencies, the same for every site
+    double left_vecs[STATES * STATES];
+    for (size_t k = 0; k < STATES; ++k) {
+      for (size_t j = 0; j < STATES; ++j) {
+        left_vecs[k * STATES + j] = freqs[k] * eigenvecs[k * STATES + j];
+      }
+    }
+
+    double parent_buffer[STATES * RATES];
+    double child_buffer[STATES * RATES];
+
+    for (size_t n = 0; n < sites; ++n) {
+      const auto parent = site_clv(partition, parent_clv_index, n, parent_buffer);
+      const auto child  = site_clv(partition, child_clv_index, n, child_buffer);
+      auto sum = sumtable + n * STATES * RATES;
+
+      for (size_t r = 0; r < RATES; ++r) {
+        const auto pclv = parent + r * STATES;
+        const auto cclv = child + r * STATES;
+        for (size_t j = 0; j < STATES; ++j) {
+          double lefterm = 0.0;
+          double righterm = 0.0;
+          for (size_t k = 0; k < STATES; ++k) {
+            lefterm  += pclv[k] * left_vecs[k * STATES + j];
+            righterm += inv_eigenvecs[j * STATES + k] * cclv[k];
+          }
+          sum[r * STATES + j] = lefterm * righterm;
+        }
+      }
+    }
+  }
+
+  static void likelihood_derivatives( pll_partition_t * partition,
+                                      const double branch_length,
+                                      const double * sumtable,
+                                      double * d_f,
+                                      double * dd_f)
+  {
+    const size_t sites = partition->sites;
+    const double * eigenvals = partition->eigenvals[0];
+    const double * rates = partition->rates;
+    const double * rate_weights = partition->rate_weights;
+
+    // exp(lambda * t) and its first two derivatives, per rate and state
+    double diag[3][STATES * RATES];
+    for (size_t r = 0; r < RATES; ++r) {
+      for (size_t j = 0; j < STATES; ++j) {
+        const double lambda = eigenvals[j] * rates[r];
+        const double value = std::exp(lambda * branch_length) * rate_weights[r];
+        diag[0][r * STATES + j] = value;
+        diag[1][r * STATES + j] = lambda * value;
+        diag[2][r * STATES + j] = lambda * lambda * value;
+      }
+    }
+
+    *d_f = 0.0;
+    *dd_f = 0.0;
+    for (size_t n = 0; n < sites; ++n) {
+      const auto sum = sumtable + n * STATES * RATES;
+      double site_lk[3] = {0.0, 0.0, 0.0};
+      for (size_t i = 0; i < STATES * RATES; ++i) {
+        site_lk[0] += sum[i] * diag[0][i];
+        site_lk[1] += sum[i] * diag[1][i];
+        site_lk[2] += sum[i] * diag[2][i];
+      }
+
+      const double deriv1 = -site_lk[1] / site_lk[0];
+      const double deriv2 = deriv1 * deriv1 - site_lk[2] / site_lk[0];
+      *d_f  += partition->pattern_weights[n] * deriv1;
+      *dd_f += partition->pattern_weights[n] * deriv2;
+    }
+  }
+};
+
+static bool specializable(pll_partition_t const * const partition, const bool needs_pinv_free)
+{
+  const auto unsupported = PLL_ATTRIB_RATE_SCALERS | PLL_ATTRIB_SITE_REPEATS | PLL_ATTRIB_AB_FLAG;
+  // they only beat the scalar libpll kernels, not the vectorized ones
+  return (partition->attributes & PLL_ATTRIB_ARCH_MASK) == PLL_ATTRIB_ARCH_CPU
+     and partition->rate_matrices == 1
+     and partition->states_padded == partition->states
+     and not (partition->attributes & unsupported)
+     and (not needs_pinv_free or partition->prop_invar[0] == 0.0);
+}
+
+/**
+ * Calls func with the kernel matching the partition, returning false if there
+ * is none.
+ */
+template <class Func>
+static bool dispatch(pll_partition_t const * const partition, const bool needs_pinv_free, Func func)
+{
+  if (not specializable(partition, needs_pinv_free)) {
+    return false;
+  }
+
+  if (partition->states == 4 and partition->rate_cats == 4) {
+    func(Kernel<4, 4>());
+    return true;
+  }
+  if (partition->states == 20 and partition->rate_cats == 4) {
+    func(Kernel<20, 4>());
+    return true;
+  }
+  return false;
+}
+
+void kernel_update_partials(pll_partition_t * partition,
+                            const pll_operation_t * operations,
+                            const unsigned int count)
+{
+  const bool done = dispatch(partition, false, [&](auto kernel) {
+    for (size_t i = 0; i < count; ++i) {
+      kernel.update_partial(partition, operations[i]);
+    }
+  });
+
+  if (not done) {
+    pll_update_partials(partition, operations, count);
+  }
+}
+
+double kernel_edge_loglikelihood( pll_partition_t * partition,
+                                  const unsigned int parent_clv_index,
+                                  const int parent_scaler_index,
+                                  const unsigned int child_clv_index,
+                                  const int child_scaler_index,
+                                  const unsigned int matrix_index,
+                                  const unsigned int * params_indices,
+                                  double * persite_lnl)
+{
+  double logl = 0.0;
+  const bool done = dispatch(partition, true, [&](auto kernel) {
+    logl = kernel.edge_loglikelihood( partition,
+                                      parent_clv_index,
+                                      parent_scaler_index,
+                                      child_clv_index,
+                                      child_scaler_index,
+                                      matrix_index,
+                                      persite_lnl);
+  });
+
+  if (not done) {
+    logl = pll_compute_edge_loglikelihood(partition,
+                                          parent_clv_index,
+                                          parent_scaler_index,
+                                          child_clv_index,
+                                          child_scaler_index,
+                                          matrix_index,
+                                          params_indices,
+                                          persite_lnl);
+  }
+  return logl;
+}
+
+int kernel_update_sumtable( pll_partition_t * partition,
+                            const unsigned int parent_clv_index,
+                            const unsigned int child_clv_index,
+                            const int parent_scaler_index,
+                            const int child_scaler_index,
+                            const unsigned int * params_indices,
+                            double * sumtable)
+{
+  const bool done = dispatch(partition, true, [&](auto kernel) {
+    kernel.update_sumtable(partition, parent_clv_index, child_clv_index, sumtable);
+  });
+
+  if (not done) {
+    return pll_update_sumtable( partition,
+                                parent_clv_index,
+                                child_clv_index,
+                                parent_scaler_index,
+                                child_scaler_index,
+                                params_indices,
+                                sumtable);
+  }
+  return PLL_SUCCESS;
+}
+
+int kernel_likelihood_derivatives(pll_partition_t * partition,
+                                  const int parent_scaler_index,
+                                  const int child_scaler_index,
+                                  const double branch_length,
+                                  const unsigned int * params_indices,
+                                  const double * sumtable,
+                                  double * d_f,
+                                  double * dd_f)
+{
+  const bool done = dispatch(partition, true, [&](auto kernel) {
+    kernel.likelihood_derivatives(partition, branch_length, sumtable, d_f, dd_f);
+  });
+
+  if (not done) {
+    return pll_compute_likelihood_derivatives(partition,
+                                              parent_scaler_index,
+                                              child_scaler_index,
+                                              branch_length,
+                                              params_indices,
+                                              sumtable,
+                                              d_f,
+                                              dd_f);
+  }
+  return PLL_SUCCESS;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "core/pll/pllhead.hpp"
+
+/**
+ * Drop-in replacements for the libpll functions of the same name, as used on
+ * the tiny trees. For the common cases of 4 or 20 states with 4 rate categories
+ * they run loops of compile-time size, otherwise they call libpll. As these
+ * loops are scalar, they are only used for partitions without SIMD kernels.
+ *
+ * The specialized loops cover a single rate matrix without invariant sites,
+ * per-rate scalers, site repeats or ascertainment bias correction. They sum in
+ * a different order than the vectorized libpll kernels, so results may differ
+ * in the last digits.
+ */
+void kernel_update_partials(pll_partition_t * partition,
+                            const pll_operation_t * operations,
+                            const unsigned int count);
+
+double kernel_edge_loglikelihood( pll_partition_t * partition,
+                                  const unsigned int parent_clv_index,
+                                  const int parent_scaler_index,
+                                  const unsigned int child_clv_index,
+                                  const int child_scaler_index,
+                                  const unsigned int matrix_index,
+                                  const unsigned int * params_indices,
+                                  double * persite_lnl);
+
+int kernel_update_sumtable( pll_partition_t * partition,
+                            const unsigned int parent_clv_index,
+                            const unsigned int child_clv_index,
+                            const int parent_scaler_index,
+                            const int child_scaler_index,
+                            const unsigned int * params_indices,
+                            double * sumtable);
+
+int kernel_likelihood_derivatives(pll_partition_t * partition,
+                                  const int parent_scaler_index,
+                                  const int child_scaler_index,
+                                  const double branch_length,
+                                  const unsigned int * params_indices,
+                                  const double * sumtable,
+                                  double * d_f,
+                                  double * dd_f);
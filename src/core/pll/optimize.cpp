@@ -7,10 +7,20 @@
 #include <stdexcept>
 #include <limits>
 #include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
 
 #include "core/pll/pll_util.hpp"
+#include "core/pll/kernels.hpp"
+#include "core/pll/Partition_Slices.hpp"
 #include "util/constants.hpp"
 #include "util/logging.hpp"
+#include "util/Timer.hpp"
 
 static void traverse_update_partials( pll_unode_t * root,
                                       pll_partition_t * partition,
@@ -51,7 +61,7 @@ static void traverse_update_partials( pll_unode_t * root,
 
   /* use the operations array to compute all num_ops inner CLVs. Operations
      will be carried out sequentially starting from operation 0 towrds num_ops-1 */
-  pll_update_partials(partition, operations, num_ops);
+  kernel_update_partials(partition, operations, num_ops);
 
 }
 
@@ -61,14 +71,14 @@ static void utree_derivative_func ( void * parameters,
                                     double *ddf)
 {
   auto params = static_cast<pll_newton_tree_params_t*>(parameters);
-  pll_compute_likelihood_derivatives (params->partition,
-                                      params->tree->scaler_index,
-                                      params->tree->back->scaler_index,
-                                      proposal,
-                                      params->params_indices,
-                                      params->sumtable,
-                                      df,
-                                      ddf);
+  kernel_likelihood_derivatives(params->partition,
+                                params->tree->scaler_index,
+                                params->tree->back->scaler_index,
+                                proposal,
+                                params->params_indices,
+                                params->sumtable,
+                                df,
+                                ddf);
 }
 
 /**
@@ -78,12 +88,14 @@ static void utree_derivative_func ( void * parameters,
  * @param  partition  the partition
  * @param  tree       the tree structure
  * @param  smoothings maximum number of iterations
+ * @param  pendant    optional pendant sumtables of the query, for the initial CLVs
  * @return            negative log likelihood after optimization
  */
 static double opt_branch_lengths_pplacer( pll_partition_t * partition,
                                           pll_unode_t * inner,
                                           unsigned int smoothings,
-                                          const double tolerance)
+                                          const double tolerance,
+                                          Pendant_Lookup * pendant)
 {
   const int max_iters = 30;
   double loglikelihood = 0.0, new_loglikelihood;
@@ -121,6 +133,8 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
   const auto original_length = blo_node->length * 2;
 
   bool opt_proximal = true;
+  // the inner CLV is the one of the pendant lookup until it is first recomputed
+  bool initial_clv = true;
 
   double lengths[3] = {
     blo_node->length,
@@ -144,14 +158,14 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
   nr_params.sumtable          = nullptr;
 
   /* get the initial likelihood score */
-  loglikelihood = -pll_compute_edge_loglikelihood (partition,
-                                                  score_node->back->clv_index,
-                                                  score_node->back->scaler_index,
-                                                  score_node->clv_index,
-                                                  score_node->scaler_index,
-                                                  score_node->pmatrix_index,
-                                                  &param_indices[0],
-                                                  nullptr);
+  loglikelihood = -kernel_edge_loglikelihood(partition,
+                                             score_node->back->clv_index,
+                                             score_node->back->scaler_index,
+                                             score_node->clv_index,
+                                             score_node->scaler_index,
+                                             score_node->pmatrix_index,
+                                             &param_indices[0],
+                                             nullptr);
 
   /* allocate the sumtable */
   auto sites_alloc = partition->sites;
@@ -159,7 +173,8 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
     sites_alloc += partition->states;
   }
 
-  if ((nr_params.sumtable = static_cast<double *> (
+  double * sumtable = nullptr;
+  if ((sumtable = static_cast<double *> (
       pll_aligned_alloc(sites_alloc
                         * partition->rate_cats
                         * partition->states_padded
@@ -186,13 +201,20 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
     }
 
     /* prepare sumtable for current branch */
-    pll_update_sumtable(partition,
-                        score_node->clv_index,
-                        score_node->back->clv_index,
-                        score_node->scaler_index,
-                        score_node->back->scaler_index,
-                        &param_indices[0],
-                        nr_params.sumtable);
+    if (pendant) {
+      nr_params.sumtable = initial_clv
+                         ? pendant->sumtable()
+                         : pendant->sumtable(partition->clv[score_node->clv_index]);
+    } else {
+      kernel_update_sumtable(partition,
+                             score_node->clv_index,
+                             score_node->back->clv_index,
+                             score_node->scaler_index,
+                             score_node->back->scaler_index,
+                             &param_indices[0],
+                             sumtable);
+      nr_params.sumtable = sumtable;
+    }
 
     nr_params.tree              = score_node;
     nr_params.branch_length_min = xmin;
@@ -222,7 +244,7 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
     if(opt_proximal)
     {
       // calculate partial toward blo node (proximal)
-      pll_update_partials(partition, &toward_blo_node, 1);
+      kernel_update_partials(partition, &toward_blo_node, 1);
 
       /* set N-R parameters */
       xguess = blo_node->length;
@@ -239,14 +261,15 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
       assert(xtol > 0.0);
 
       /* prepare sumtable for current branch */
-      pll_update_sumtable(partition,
-                          blo_node->clv_index,
-                          blo_node->back->clv_index,
-                          blo_node->scaler_index,
-                          blo_node->back->scaler_index,
-                          &param_indices[0],
-                          nr_params.sumtable);
-
+      kernel_update_sumtable(partition,
+                             blo_node->clv_index,
+                             blo_node->back->clv_index,
+                             blo_node->scaler_index,
+                             blo_node->back->scaler_index,
+                             &param_indices[0],
+                             sumtable);
+
+      nr_params.sumtable          = sumtable;
       nr_params.tree              = blo_node;
       nr_params.branch_length_min = xmin;
       nr_params.branch_length_max = xmax;
@@ -273,16 +296,17 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
             Calculate the score
      =============================================================*/
 
-    pll_update_partials(partition, &toward_score, 1);
+    kernel_update_partials(partition, &toward_score, 1);
+    initial_clv = false;
 
-    new_loglikelihood = -pll_compute_edge_loglikelihood(partition,
-                                        score_node->back->clv_index,
-                                        score_node->back->scaler_index,
-                                        score_node->clv_index,
-                                        score_node->scaler_index,
-                                        score_node->pmatrix_index,
-                                        &param_indices[0],
-                                        nullptr);
+    new_loglikelihood = -kernel_edge_loglikelihood(partition,
+                                                   score_node->back->clv_index,
+                                                   score_node->back->scaler_index,
+                                                   score_node->clv_index,
+                                                   score_node->scaler_index,
+                                                   score_node->pmatrix_index,
+                                                   &param_indices[0],
+                                                   nullptr);
 
 
     if(new_loglikelihood - loglikelihood > new_loglikelihood * 1e-14) {
@@ -308,7 +332,7 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
   }
 
   /* deallocate sumtable */
-  pll_aligned_free(nr_params.sumtable);
+  pll_aligned_free(sumtable);
 
   return loglikelihood;
 }
@@ -318,23 +342,27 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
 
 double optimize_branch_triplet( pll_partition_t * partition,
                                 pll_unode_t * root,
-                                const bool sliding)
+                                const bool sliding,
+                                Pendant_Lookup * pendant)
 {
   if (!root->next) {
     root = root->back;
   }
 
-  std::vector<pll_unode_t*> travbuffer(4);
-  std::vector<double> branch_lengths(3);
-  std::vector<unsigned int> matrix_indices(3);
-  std::vector<pll_operation_t> operations(4);
-
-  traverse_update_partials( root,
-                            partition,
-                            &travbuffer[0],
-                            &branch_lengths[0],
-                            &matrix_indices[0],
-                            &operations[0]);
+  // the pendant lookup is only given for current partials and pmatrices
+  if (not (sliding and pendant)) {
+    std::vector<pll_unode_t*> travbuffer(4);
+    std::vector<double> branch_lengths(3);
+    std::vector<unsigned int> matrix_indices(3);
+    std::vector<pll_operation_t> operations(4);
+
+    traverse_update_partials( root,
+                              partition,
+                              &travbuffer[0],
+                              &branch_lengths[0],
+                              &matrix_indices[0],
+                              &operations[0]);
+  }
 
   std::vector<unsigned int> param_indices(partition->rate_cats, 0);
 
@@ -345,7 +373,8 @@ double optimize_branch_triplet( pll_partition_t * partition,
     cur_logl = -opt_branch_lengths_pplacer( partition,
                                             root,
                                             smoothings,
-                                            OPT_BRANCH_EPSILON);
+                                            OPT_BRANCH_EPSILON,
+                                            pendant);
   } else {
     cur_logl = -pllmod_opt_optimize_branch_lengths_local(
                                                 partition,
@@ -359,250 +388,406 @@ double optimize_branch_triplet( pll_partition_t * partition,
                                                 1); // keep update
   }
 
-  pll_compute_edge_loglikelihood(partition,
-                                root->clv_index,
-                                root->scaler_index,
-                                root->back->clv_index,
-                                root->back->scaler_index,
-                                root->pmatrix_index,
-                                &param_indices[0],
-                                nullptr);
+  kernel_edge_loglikelihood(partition,
+                            root->clv_index,
+                            root->scaler_index,
+                            root->back->clv_index,
+                            root->back->scaler_index,
+                            root->pmatrix_index,
+                            &param_indices[0],
+                            nullptr);
 
   return cur_logl;
 }
 
-static double optimize_branch_lengths(pll_unode_t * root,
-                                      pll_partition_t * partition,
-                                      pll_optimize_options_t& params,
-                                      pll_unode_t ** travbuffer,
-                                      double cur_logl,
-                                      double lnl_monitor,
-                                      int* smoothings)
+/* state shared by the steps of the reference optimization */
+struct Reference_Opt
+{
+  pll_partition_t * partition;
+  Partition_Slices * slices;
+  std::vector<pll_unode_t*> branches;
+  std::vector<unsigned int> param_indices;
+
+  // full traversal toward the current root branch
+  pll_unode_t * root = nullptr;
+  std::vector<pll_unode_t*> travbuffer;
+  std::vector<pll_operation_t> operations;
+
+  // the substitution rates by symmetry class, and which classes are free
+  std::vector<int> rate_sym;
+  std::vector<double> uniq_rates;
+  std::vector<size_t> free_rates;
+
+  double alpha = 1.0;
+  int gamma_mode = PLL_GAMMA_RATES_MEAN;
+
+  // branch currently under Newton-Raphson
+  pll_unode_t * branch = nullptr;
+};
+
+static void set_root(Reference_Opt& opt, pll_unode_t * root)
 {
   if (!root->next) {
     root = root->back;
   }
+  opt.root = root;
 
-  traverse_update_partials( root,
-                            partition,
-                            travbuffer,
-                            params.lk_params.branch_lengths,
-                            params.lk_params.matrix_indices,
-                            params.lk_params.operations);
+  unsigned int traversal_size, num_matrices, num_ops;
+  pll_utree_traverse( root,
+                      PLL_TREE_TRAVERSE_POSTORDER,
+                      cb_full_traversal,
+                      &opt.travbuffer[0],
+                      &traversal_size);
+
+  // the pmatrices are updated separately, for all branches
+  std::vector<double> branch_lengths(opt.branches.size());
+  std::vector<unsigned int> matrix_indices(opt.branches.size());
+  opt.operations.resize(opt.travbuffer.size());
+  pll_utree_create_operations(&opt.travbuffer[0],
+                              traversal_size,
+                              &branch_lengths[0],
+                              &matrix_indices[0],
+                              &opt.operations[0],
+                              &num_matrices,
+                              &num_ops);
+  opt.operations.resize(num_ops);
+}
 
-  pll_errno = 0; // hotfix
+static void update_pmatrices(Reference_Opt& opt)
+{
+  std::vector<double> branch_lengths;
+  std::vector<unsigned int> matrix_indices;
+  for (auto node : opt.branches) {
+    branch_lengths.push_back(node->length);
+    matrix_indices.push_back(node->pmatrix_index);
+  }
 
-  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+  pll_update_prob_matrices( opt.partition,
+                            &opt.param_indices[0],
+                            &matrix_indices[0],
+                            &branch_lengths[0],
+                            matrix_indices.size());
+}
 
-  cur_logl = -1 * pllmod_opt_optimize_branch_lengths_iterative(
-    partition,
-    root,
-    &param_indices[0],
-    PLLMOD_OPT_MIN_BRANCH_LEN,
-    PLLMOD_OPT_MAX_BRANCH_LEN,
-    OPT_BRANCH_EPSILON,
-    *smoothings,
-    1); // keep updating BLs during call
-
-  if (cur_logl+1e-6 < lnl_monitor) {
-    throw std::runtime_error{std::string("cur_logl < lnl_monitor: ")
-                        + std::to_string(cur_logl)
-                        + std::string(" : ")
-                        + std::to_string(lnl_monitor)};
+/* recomputes the pmatrices and all CLVs toward the root branch */
+static double loglikelihood(Reference_Opt& opt)
+{
+  update_pmatrices(opt);
+  opt.slices->update_partials(&opt.operations[0], opt.operations.size());
+  return opt.slices->edge_loglikelihood(opt.root);
+}
+
+static void set_rates(Reference_Opt& opt, double const * const x)
+{
+  for (size_t i = 0; i < opt.free_rates.size(); ++i) {
+    opt.uniq_rates[ opt.free_rates[i] ] = x[i];
   }
 
-  // reupdate the indices as they may have changed
-  params.lk_params.where.unrooted_t.parent_clv_index = root->clv_index;
-  params.lk_params.where.unrooted_t.parent_scaler_index = root->scaler_index;
-  params.lk_params.where.unrooted_t.child_clv_index = root->back->clv_index;
-  params.lk_params.where.unrooted_t.child_scaler_index = root->back->scaler_index;
-  params.lk_params.where.unrooted_t.edge_pmatrix_index = root->pmatrix_index;
-
-  traverse_update_partials( root,
-                            partition,
-                            travbuffer,
-                            params.lk_params.branch_lengths,
-                            params.lk_params.matrix_indices,
-                            params.lk_params.operations);
-
-  cur_logl = pll_compute_edge_loglikelihood(partition,
-                                            root->clv_index,
-                                            root->scaler_index,
-                                            root->back->clv_index,
-                                            root->back->scaler_index,
-                                            root->pmatrix_index,
-                                            &param_indices[0],
-                                            nullptr);
+  std::vector<double> rates(opt.rate_sym.size());
+  for (size_t i = 0; i < rates.size(); ++i) {
+    rates[i] = opt.uniq_rates[ opt.rate_sym[i] ];
+  }
+  pll_set_subst_params(opt.partition, 0, &rates[0]);
+}
 
-  return cur_logl;
+static double rates_target(void * params, double * x)
+{
+  auto& opt = *static_cast<Reference_Opt*>(params);
+  set_rates(opt, x);
+  return -loglikelihood(opt);
 }
 
-void optimize(raxml::Model& model,
-              pll_utree_t * const tree,
-              pll_partition_t * partition,
-              const Tree_Numbers& nums,
-              const bool opt_branches,
-              const bool opt_model)
+static double optimize_rates(Reference_Opt& opt, const double cur_logl)
 {
+  const auto num_free = opt.free_rates.size();
 
-  if (not opt_branches and not opt_model) {
-    return;
+  std::vector<double> x(num_free);
+  for (size_t i = 0; i < num_free; ++i) {
+    x[i] = opt.uniq_rates[ opt.free_rates[i] ];
+  }
+  const auto old_x = x;
+
+  std::vector<double> min_rates(num_free, OPT_RATE_MIN);
+  std::vector<double> max_rates(num_free, OPT_RATE_MAX);
+  std::vector<int> bound(num_free, PLLMOD_OPT_LBFGSB_BOUND_BOTH);
+
+  pllmod_opt_minimize_lbfgsb( &x[0],
+                              &min_rates[0],
+                              &max_rates[0],
+                              &bound[0],
+                              num_free,
+                              OPT_FACTR,
+                              OPT_PARAM_EPSILON,
+                              &opt,
+                              rates_target);
+
+  // the optimizer leaves the partition at its last evaluation, not its best
+  set_rates(opt, &x[0]);
+  auto logl = loglikelihood(opt);
+
+  if (logl < cur_logl) {
+    set_rates(opt, &old_x[0]);
+    logl = loglikelihood(opt);
   }
+  return logl;
+}
+
+static void set_alpha(Reference_Opt& opt, const double alpha)
+{
+  std::vector<double> rates(opt.partition->rate_cats);
+  pll_compute_gamma_cats(alpha, rates.size(), &rates[0], opt.gamma_mode);
+  pll_set_category_rates(opt.partition, &rates[0]);
+  opt.alpha = alpha;
+}
 
-  const auto root = get_root(tree);
+static double alpha_target(void * params, double alpha)
+{
+  auto& opt = *static_cast<Reference_Opt*>(params);
+  set_alpha(opt, alpha);
+  return -loglikelihood(opt);
+}
 
-  if (opt_branches) {
-    set_branch_lengths(tree, DEFAULT_BRANCH_LENGTH);
+static double optimize_alpha(Reference_Opt& opt, const double cur_logl)
+{
+  const auto old_alpha = opt.alpha;
+  double fx, f2x;
+
+  const auto alpha = pllmod_opt_minimize_brent( OPT_ALPHA_MIN,
+                                                old_alpha,
+                                                OPT_ALPHA_MAX,
+                                                OPT_PARAM_EPSILON,
+                                                &fx,
+                                                &f2x,
+                                                &opt,
+                                                alpha_target);
+
+  set_alpha(opt, alpha);
+  auto logl = loglikelihood(opt);
+
+  if (logl < cur_logl) {
+    set_alpha(opt, old_alpha);
+    logl = loglikelihood(opt);
   }
+  return logl;
+}
 
-  compute_and_set_empirical_frequencies(partition, model);
+static void branch_derivative_func( void * parameters,
+                                    double proposal,
+                                    double *df,
+                                    double *ddf)
+{
+  auto& opt = *static_cast<Reference_Opt*>(parameters);
+  opt.slices->derivatives(opt.branch, proposal, df, ddf);
+}
+
+/* Newton-Raphson on the branch between node and node->back, whose CLVs must be current */
+static void optimize_branch(Reference_Opt& opt, pll_unode_t * node)
+{
+  const int max_iters = 30;
+  const double xtol = OPT_BRLEN_MIN / 10.0;
 
-  std::vector<int> symmetries = model.submodel(0).rate_sym();
-  std::vector<unsigned int> param_indices(model.num_ratecats(), 0);
+  auto xguess = node->length;
+  if ( (xguess < OPT_BRLEN_MIN) or (xguess > OPT_BRLEN_MAX) ) {
+    xguess = PLLMOD_OPT_DEFAULT_BRANCH_LEN;
+  }
 
-  // sadly we explicitly need these buffers here and in the params structure
-  std::vector<pll_unode_t*> travbuffer(nums.nodes);
-  std::vector<double> branch_lengths(nums.branches);
-  std::vector<unsigned int> matrix_indices(nums.branches);
-  std::vector<pll_operation_t> operations(nums.nodes);
+  opt.slices->update_sumtable(node);
+  opt.branch = node;
+
+  const auto length = pllmod_opt_minimize_newton( OPT_BRLEN_MIN,
+                                                  xguess,
+                                                  OPT_BRLEN_MAX,
+                                                  xtol,
+                                                  max_iters,
+                                                  &opt,
+                                                  branch_derivative_func);
+
+  if ( (length >= OPT_BRLEN_MIN) and (length <= OPT_BRLEN_MAX) ) {
+    node->length = node->back->length = length;
+    pll_update_prob_matrices( opt.partition,
+                              &opt.param_indices[0],
+                              &node->pmatrix_index,
+                              &node->length,
+                              1);
+  }
+}
 
-  traverse_update_partials( root,
-                            partition,
-                            &travbuffer[0],
-                            &branch_lengths[0],
-                            &matrix_indices[0],
-                            &operations[0]);
-
-  // compute logl once to give us a logl starting point
-  auto cur_logl = pll_compute_edge_loglikelihood( partition,
-                                                  root->clv_index,
-                                                  root->scaler_index,
-                                                  root->back->clv_index,
-                                                  root->back->scaler_index,
-                                                  root->pmatrix_index,
-                                                  &param_indices[0],
-                                                  nullptr);
-
-  // double cur_logl = -numeric_limits<double>::infinity();
-  int smoothings;
-  double lnl_monitor = cur_logl;
-
-  // set up high level options structure
-  pll_optimize_options_t params;
-  params.lk_params.partition = partition;
-  params.lk_params.operations = &operations[0];
-  params.lk_params.branch_lengths = &branch_lengths[0];
-  params.lk_params.matrix_indices = &matrix_indices[0];
-  params.lk_params.params_indices = &param_indices[0];
-  params.lk_params.alpha_value = model.alpha();
-  params.lk_params.rooted = 0;
-  params.lk_params.where.unrooted_t.parent_clv_index = root->clv_index;
-  params.lk_params.where.unrooted_t.parent_scaler_index = root->scaler_index;
-  params.lk_params.where.unrooted_t.child_clv_index = root->back->clv_index;
-  params.lk_params.where.unrooted_t.child_scaler_index =
-    root->back->scaler_index;
-  params.lk_params.where.unrooted_t.edge_pmatrix_index = root->pmatrix_index;
-
-  /* optimization parameters */
-  params.params_index = 0;
-  params.subst_params_symmetries = &symmetries[0];
-  params.factr = OPT_FACTR;
-  params.pgtol = OPT_PARAM_EPSILON;
-
-  std::vector<pll_unode_t*> branches(nums.branches);
-  auto num_traversed = utree_query_branches(tree, &branches[0]);
-  assert (num_traversed == nums.branches);
-  unsigned int branch_index = 0;
+/* recomputes the CLV of an inner node from the two it points away from */
+static void update_partial(Reference_Opt& opt, pll_unode_t * node)
+{
+  const auto child1 = node->next->back;
+  const auto child2 = node->next->next->back;
+
+  pll_operation_t op;
+  op.parent_clv_index    = node->clv_index;
+  op.parent_scaler_index = node->scaler_index;
+  op.child1_clv_index    = child1->clv_index;
+  op.child1_scaler_index = child1->scaler_index;
+  op.child1_matrix_index = child1->pmatrix_index;
+  op.child2_clv_index    = child2->clv_index;
+  op.child2_scaler_index = child2->scaler_index;
+  op.child2_matrix_index = child2->pmatrix_index;
+
+  opt.slices->update_partials(&op, 1);
+}
 
-  double logl = cur_logl;
+/**
+ * Optimizes the branch of node, then all branches of the subtree node points to,
+ * depth first. The CLVs of node and node->back must be current when called, and
+ * that of node is again when done.
+ */
+static void smooth_subtree(Reference_Opt& opt, pll_unode_t * node)
+{
+  optimize_branch(opt, node);
 
-  if (opt_branches) {
-    smoothings = 8;
-    cur_logl = optimize_branch_lengths( branches[branch_index],
-                                        partition,
-                                        params,
-                                        &travbuffer[0],
-                                        cur_logl,
-                                        lnl_monitor,
-                                        &smoothings);
+  if (!node->next) {
+    return;
   }
 
-  const auto rates_size = model.subst_rates(0).size();
+  const auto first  = node->next;
+  const auto second = node->next->next;
 
-  std::vector<double> min_rates(rates_size, OPT_RATE_MIN);
-  std::vector<double> max_rates(rates_size, OPT_RATE_MAX);
+  update_partial(opt, first);
+  smooth_subtree(opt, first->back);
 
-  do {
-    branch_index = rand () % num_traversed;
+  update_partial(opt, second);
+  smooth_subtree(opt, second->back);
 
-    // LOG_INFO << "Start: " << to_string(cur_logl) << "\n";
-    logl = cur_logl;
+  update_partial(opt, node);
+}
+
+static double optimize_branch_lengths(Reference_Opt& opt, const unsigned int smoothings)
+{
+  auto logl = loglikelihood(opt);
+
+  for (size_t i = 0; i < smoothings; ++i) {
+    smooth_subtree(opt, opt.root);
+    smooth_subtree(opt, opt.root->back);
+
+    const auto new_logl = opt.slices->edge_loglikelihood(opt.root);
+    const bool converged = new_logl - logl < OPT_BRANCH_EPSILON;
+    logl = new_logl;
 
-    if (opt_model) {
+    if (converged) {
+      break;
+    }
+  }
+  return logl;
+}
 
-      params.which_parameters = PLLMOD_OPT_PARAM_SUBST_RATES;
-      cur_logl = -pllmod_opt_optimize_multidim(&params, &min_rates[0], &max_rates[0]);
+void optimize(raxml::Model& model,
+              pll_utree_t * const tree,
+              pll_partition_t * partition,
+              const Tree_Numbers& nums,
+              const bool opt_branches,
+              const bool opt_model,
+              const unsigned int num_threads,
+              const unsigned int seed)
+{
 
-      // LOG_INFO << "after rates: " << to_string(cur_logl) << "\n";
+  if (not opt_branches and not opt_model) {
+    return;
+  }
 
-      if (opt_branches) {
-        smoothings = 2;
-        cur_logl = optimize_branch_lengths( branches[branch_index],
-                                            partition,
-                                            params,
-                                            &travbuffer[0],
-                                            cur_logl,
-                                            lnl_monitor,
-                                            &smoothings);
+  if (opt_branches) {
+    set_branch_lengths(tree, DEFAULT_BRANCH_LENGTH);
+  }
 
-        // LOG_INFO << "after blo 1: " << to_string(cur_logl) << "\n";
+  if ( model.empirical_base_freqs() ) {
+    compute_and_set_empirical_frequencies(partition, model);
+  }
 
+#ifdef __OMP
+  const unsigned int threads = num_threads ? num_threads : omp_get_max_threads();
+#else
+  (void) num_threads;
+  const unsigned int threads = 1;
+#endif
+
+  Partition_Slices slices(partition, threads);
+
+  Reference_Opt opt;
+  opt.partition = partition;
+  opt.slices = &slices;
+  opt.param_indices.assign(partition->rate_cats, 0);
+  opt.travbuffer.resize(nums.nodes);
+  opt.branches.resize(nums.branches);
+  auto num_traversed = utree_query_branches(tree, &opt.branches[0]);
+  assert (num_traversed == nums.branches);
+  (void) num_traversed;
+
+  const auto params = model.params_to_optimize();
+
+  // the rates of the last symmetry class stay fixed, as the matrix is normalized anyway
+  const bool opt_rates = opt_model
+                     and (params & PLLMOD_OPT_PARAM_SUBST_RATES)
+                     and model.num_submodels() == 1;
+  if (opt_rates) {
+    const auto submodel = model.submodel(0);
+    opt.uniq_rates = submodel.uniq_subst_rates();
+    opt.rate_sym = submodel.rate_sym();
+    if (opt.rate_sym.empty()) {
+      opt.rate_sym.resize(submodel.num_rates());
+      std::iota(opt.rate_sym.begin(), opt.rate_sym.end(), 0);
+    }
+    const size_t fixed = opt.rate_sym.back();
+    for (size_t i = 0; i < opt.uniq_rates.size(); ++i) {
+      if (i != fixed) {
+        opt.free_rates.push_back(i);
       }
+    }
+  }
 
-      // params.which_parameters = PLL_PARAMETER_FREQUENCIES;
-      // pll_optimize_parameters_multidim(&params, nullptr, nullptr);
+  const bool opt_alpha = opt_model
+                     and (params & PLLMOD_OPT_PARAM_ALPHA)
+                     and model.ratehet_mode() == PLLMOD_UTIL_MIXTYPE_GAMMA
+                     and partition->rate_cats > 1;
+  opt.alpha = model.alpha();
+  opt.gamma_mode = model.gamma_mode();
 
-      if (opt_branches) {
-        smoothings = 2;
-        cur_logl = optimize_branch_lengths( branches[branch_index],
-                                            partition,
-                                            params,
-                                            &travbuffer[0],
-                                            cur_logl,
-                                            lnl_monitor,
-                                            &smoothings);
+  // seeded explicitly, such that every run (and MPI rank) ends up with the same model
+  std::mt19937 engine(seed);
+  std::uniform_int_distribution<size_t> pick_branch(0, opt.branches.size() - 1);
 
-        // LOG_INFO << "after blo 2: " << to_string(cur_logl) << "\n";
+  set_root(opt, get_root(tree));
+  auto cur_logl = loglikelihood(opt);
 
-      }
+  LOG_INFO << "Optimizing the reference "
+           << (opt_model ? (opt_branches ? "model and branch lengths" : "model") : "branch lengths")
+           << " over " << slices.size() << " site slices, starting from log-likelihood "
+           << std::to_string(cur_logl);
 
-      // params.which_parameters = PLL_PARAMETER_PINV;
-      // cur_logl = -1 * pll_optimize_parameters_brent(&params);
-      params.which_parameters = PLLMOD_OPT_PARAM_ALPHA;
-      cur_logl = -pllmod_opt_optimize_onedim(&params, 0.02, 10000.);
+  double logl;
+  size_t round = 0;
+  do {
+    Timer<std::chrono::milliseconds> round_time;
+    round_time.start();
+    logl = cur_logl;
 
-      // LOG_INFO << "after alpha: " << to_string(cur_logl) << "\n";
+    set_root(opt, opt.branches[pick_branch(engine)]);
 
+    if (opt_rates and not opt.free_rates.empty()) {
+      cur_logl = optimize_rates(opt, cur_logl);
+    }
+
+    if (opt_alpha) {
+      cur_logl = optimize_alpha(opt, cur_logl);
     }
 
     if (opt_branches) {
-      smoothings = 3;
-      cur_logl = optimize_branch_lengths( branches[branch_index],
-                                          partition,
-                                          params,
-                                          &travbuffer[0],
-                                          cur_logl,
-                                          lnl_monitor,
-                                          &smoothings);
+      cur_logl = optimize_branch_lengths(opt, round ? 3 : 8);
+    }
 
-      // LOG_INFO << "after blo 3: " << to_string(cur_logl) << "\n";
+    round_time.stop();
+    LOG_INFO << "Optimization round " << ++round << ": log-likelihood "
+             << std::to_string(cur_logl) << " (" << round_time.seconds() << "s)";
 
-    }
   } while (fabs (cur_logl - logl) > OPT_EPSILON);
 
   if (opt_model) {
     // update epa model object as well
     raxml::assign(model, partition);
+    model.alpha(opt.alpha);
   }
 }
 
@@ -3,6 +3,7 @@
 #include "core/pll/pllhead.hpp"
 #include "core/raxml/Model.hpp"
 #include "tree/Tree_Numbers.hpp"
+#include "tree/Pendant_Lookup.hpp"
 
 constexpr double OPT_EPSILON        = 1.0;
 constexpr double OPT_PARAM_EPSILON  = 1e-4;
@@ -12,18 +13,37 @@ constexpr double OPT_BRLEN_MIN      = PLLMOD_OPT_MIN_BRANCH_LEN;
 constexpr double OPT_BRLEN_MAX      = PLLMOD_OPT_MAX_BRANCH_LEN;
 constexpr double OPT_RATE_MIN       = 1e-4;
 constexpr double OPT_RATE_MAX       = 1e6;
+constexpr double OPT_ALPHA_MIN      = 0.02;
+constexpr double OPT_ALPHA_MAX      = 10000.;
+constexpr unsigned int OPT_SEED     = 42;
 
 // interface
+
+/**
+ * Optimizes the model parameters and/or branch lengths of the reference tree.
+ * The likelihood is evaluated site-parallel on num_threads threads (0 for all
+ * available). The tree needs unique CLV indices per direction.
+ */
 void optimize(raxml::Model& model,
               pll_utree_t * const tree,
               pll_partition_t * partition,
               const Tree_Numbers& nums,
               const bool opt_branches,
-              const bool opt_model);
+              const bool opt_model,
+              const unsigned int num_threads = 0,
+              const unsigned int seed = OPT_SEED);
 
 void compute_and_set_empirical_frequencies( pll_partition_t * partition,
                                             raxml::Model& model);
 
+/**
+ * Optimizes the branch lengths around the inner node of a tiny tree.
+ * For the sliding optimization, pendant may give the sumtables of the pendant
+ * branch for the current query (see Pendant_Lookup): the partials and
+ * pmatrices of the tiny tree are then expected to be current, and are not
+ * recomputed.
+ */
 double optimize_branch_triplet( pll_partition_t * partition,
                                 pll_unode_t * inner,
-                                const bool sliding);
+                                const bool sliding,
+                                Pendant_Lookup * pendant = nullptr);
@@ -409,8 +409,10 @@ void shift_partition_focus( pll_partition_t * partition,
   }
 
   // shift the scalers
+  const auto scaler_size = static_cast<int>((partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+                                            ? partition->rate_cats : 1u);
   for (size_t i = 0; i < partition->scale_buffers; i++) {
-    partition->scale_buffer[i] += offset;
+    partition->scale_buffer[i] += offset * scaler_size;
   }
 
   // shift the pattern weights
@@ -56,18 +56,38 @@ pll_utree_t* make_utree_struct(pll_unode_t * root, const unsigned int num_nodes)
 // deprecated
 void shift_partition_focus(pll_partition_t * partition, const int offset, const unsigned int span);
 
+/**
+ * Focuses the partition on a range of its sites for as long as it lives, such
+ * that all pll operations on it only concern the sites in that range.
+ */
+class Partition_Focus
+{
+public:
+  Partition_Focus(pll_partition_t * partition, const Range& range)
+    : partition_(partition)
+    , num_sites_(partition->sites)
+    , offset_(static_cast<int>(range.begin))
+  {
+    shift_partition_focus(partition_, offset_, range.span);
+  }
+  ~Partition_Focus()
+  {
+    shift_partition_focus(partition_, -offset_, num_sites_);
+  }
+
+  Partition_Focus(Partition_Focus const& other) = delete;
+  Partition_Focus& operator= (Partition_Focus const& other) = delete;
+
+private:
+  pll_partition_t * partition_;
+  unsigned int num_sites_;
+  int offset_;
+};
+
 // templates
 template<typename Func, typename ...Args>
 double call_focused(Func func, Range& range, pll_partition_t * partition, Args && ...args)
 {
-  const auto num_sites = partition->sites;
-  // Shift there...
-  shift_partition_focus(partition, range.begin, range.span);
-
-  double ret = func(partition, args...);
-
-  // ... and shift back again
-  shift_partition_focus(partition, -range.begin, num_sites);
-
-  return ret;
+  Partition_Focus focus(partition, range);
+  return func(partition, args...);
 }
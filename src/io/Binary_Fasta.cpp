@@ -0,0 +1,298 @@
+#include "io/Binary_Fasta.hpp"
+
+#include <fstream>
+#include <vector>
+#include <array>
+#include <cstring>
+
+#ifdef __PREFETCH
+#include <future>
+#endif
+
+#include "core/heuristics.hpp"
+#include "io/Fasta_Index.hpp"
+
+#include "genesis/utils/core/fs.hpp"
+#include "genesis/utils/core/options.hpp"
+
+using fasta_block = std::vector<sequence::Sequence>;
+
+template <class T>
+static void put_raw_int(std::ostream& out, const T value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static bool is_space(const char c)
+{
+  return c == '\n' or c == '\r' or c == ' ' or c == '\t';
+}
+
+/**
+ * First phase of the conversion: count the records, the sites of the first
+ * record and find the narrowest encoding for all sequences, in one pass over
+ * the raw bytes of the file.
+ */
+static void scan_fasta( const std::string& fasta_file,
+                        size_t& num_sequences,
+                        size_t& sites,
+                        Encoding& encoding)
+{
+  num_sequences = 0;
+  sites = 0;
+  encoding = Encoding::kFourBit;
+
+  // can't look at the raw bytes of compressed files, parse them instead
+  if (is_gzipped(fasta_file)) {
+    auto it = sequence::FastaInputIterator( utils::from_file(fasta_file) );
+    if (it) {
+      sites = it->length();
+    }
+    while (it) {
+      ++num_sequences;
+      encoding = widen_encoding(encoding, it->sites());
+      ++it;
+    }
+    return;
+  }
+
+  std::ifstream in(fasta_file, std::ios::binary);
+  if (not in) {
+    throw std::runtime_error{std::string("Cannot open file: ") + fasta_file};
+  }
+
+  // which characters every encoding supports
+  std::array<bool, 256> four_valid;
+  std::array<bool, 256> five_valid;
+  for (size_t c = 0; c < 256; ++c) {
+    four_valid[c] = code_().valid(static_cast<char>(c));
+    five_valid[c] = aa_code_().valid(static_cast<char>(c));
+  }
+
+  std::vector<char> block(1 << 20);
+  bool line_start = true;
+  bool in_label = false;
+  while (in) {
+    in.read(block.data(), block.size());
+    const auto count = static_cast<size_t>(in.gcount());
+
+    for (size_t i = 0; i < count; ++i) {
+      const auto c = block[i];
+      if (line_start and c == '>') {
+        ++num_sequences;
+        in_label = true;
+      } else if (c == '\n') {
+        in_label = false;
+      } else if (not in_label and not is_space(c)) {
+        const auto uc = static_cast<unsigned char>(c);
+        if (num_sequences == 1) {
+          ++sites;
+        }
+        if (not four_valid[uc]) {
+          if (not five_valid[uc]) {
+            throw std::runtime_error{std::string("Unsupported character for conversion to bfast: ") + c};
+          }
+          encoding = Encoding::kFiveBit;
+        }
+      }
+      line_start = (c == '\n');
+    }
+  }
+}
+
+static void read_block( sequence::FastaInputIterator& it,
+                        const size_t max_bytes,
+                        fasta_block& block)
+{
+  block.clear();
+  size_t bytes = 0;
+  // always take at least one record, even if it exceeds the buffer
+  while (it and (block.empty() or bytes < max_bytes)) {
+    bytes += it->label().size() + it->sites().size();
+    block.push_back(*it);
+    ++it;
+  }
+}
+
+std::string Binary_Fasta::fasta_to_bfast( const std::string& fasta_file,
+                                          std::string out_dir,
+                                          const Options& options)
+{
+  auto parts = split_by_delimiter(fasta_file, "/");
+
+  out_dir += parts.back() + ".bfast";
+  const auto& out_file = out_dir;
+
+  if ( utils::file_exists(out_file) and not utils::Options::get().allow_file_overwriting() ) {
+    throw std::runtime_error{out_file + " already exists! To overwrite existing output files, rerun with --redo"};
+  }
+
+  // Phase one: a cheap pass over the raw bytes, telling us how large the header is
+  size_t num_sequences = 0;
+  size_t sites = 0;
+  auto encoding = Encoding::kFourBit;
+  scan_fasta(fasta_file, num_sequences, sites, encoding);
+
+  LOG_DBG << "Sequences: " << num_sequences << ", sites: " << sites
+          << ", using " << (encoding == Encoding::kFiveBit ? "5bit" : "4bit") << " encoding";
+
+  // Phase two: write a placeholder header, then stream encoded blocks of
+  // records to the data section. The gap mask and the offset table are patched
+  // in as we go / at the end.
+  std::fstream out(out_file, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+  if (not out) {
+    throw std::runtime_error{std::string("Cannot open file: ") + out_file};
+  }
+
+  out.write(MAGIC_V2, MAGIC_SIZE);
+  put_raw_int(out, static_cast<uint8_t>(encoding));
+  put_raw_int(out, static_cast<uint64_t>(num_sequences));
+
+  // mask string: <length><one char per site>
+  const auto mask_pos = static_cast<uint64_t>(out.tellp()) + sizeof(size_t);
+  put_raw_int(out, sites);
+  out.write(std::string(sites, '0').data(), sites);
+
+  // offset table
+  const auto table_pos = static_cast<uint64_t>(out.tellp());
+  {
+    const std::vector<uint64_t> zeros(2 * 4096, 0);
+    size_t left = num_sequences;
+    while (left) {
+      const size_t n = std::min(left, zeros.size() / 2);
+      out.write(reinterpret_cast<const char*>(zeros.data()), n * 2 * sizeof(uint64_t));
+      left -= n;
+    }
+  }
+
+  uint64_t position = out.tellp();
+  assert(position == data_section_offset(num_sequences, sites));
+
+  const auto num_threads = get_num_threads(options);
+
+  // two blocks are in flight at any time: one being encoded and written, one
+  // being read. The encoded form of the former counts toward the buffer as well
+  const size_t coded_size = packed_size(encoding, sites);
+  const size_t buffer_bytes = options.bfast_buffer * (1ul << 20);
+  const size_t block_bytes = std::max<size_t>(1,
+    buffer_bytes / (2 * sites + coded_size) * std::max<size_t>(1, sites));
+
+  auto it = sequence::FastaInputIterator( utils::from_file(fasta_file) );
+
+  mask_type gap_mask(sites, true);
+  std::vector<mask_type> thread_masks(num_threads, mask_type(sites, true));
+
+  fasta_block block;
+  fasta_block next_block;
+  // the encoded sequences of a block, back to back
+  std::string coded;
+  std::vector<uint64_t> table;
+  size_t seq_id = 0;
+
+  read_block(it, block_bytes, block);
+
+  while (not block.empty()) {
+    #ifdef __PREFETCH
+    auto prefetcher = std::async( std::launch::async,
+                                  read_block,
+                                  std::ref(it),
+                                  block_bytes,
+                                  std::ref(next_block));
+    #else
+    read_block(it, block_bytes, next_block);
+    #endif
+
+    // encode the block in parallel
+    coded.resize(block.size() * coded_size);
+    std::string error;
+
+    #ifdef __OMP
+    #pragma omp parallel for schedule(dynamic)
+    #endif
+    for (size_t i = 0; i < block.size(); ++i) {
+      try {
+        const auto& seq = block[i];
+        if (seq.length() != sites) {
+          throw std::runtime_error{fasta_file
+            + " does not contain equal size sequences! First offending sequence: "
+            + seq.label()};
+        }
+        const auto encoded = encode(encoding, seq.sites());
+        assert(encoded.size() == coded_size);
+        std::memcpy(&coded[i * coded_size], encoded.data(), coded_size);
+        thread_masks[get_thread_id()] &= sequence::gap_sites(seq);
+      } catch (const std::exception& e) {
+        #ifdef __OMP
+        #pragma omp critical
+        #endif
+        error = e.what();
+      }
+    }
+
+    if (not error.empty()) {
+      #ifdef __PREFETCH
+      prefetcher.wait();
+      #endif
+      throw std::runtime_error{error};
+    }
+
+    if (seq_id + block.size() > num_sequences) {
+      throw std::runtime_error{"Number of sequences changed during conversion of " + fasta_file};
+    }
+
+    // write the entries:
+    // <header_length (bytes/chars)><header string><sequence_length><encoded sequence padded to next byte>
+    table.clear();
+    for (size_t i = 0; i < block.size(); ++i) {
+      const auto& label = block[i].label();
+
+      table.push_back(seq_id + i);
+      table.push_back(position);
+
+      put_raw_int(out, static_cast<size_t>(label.size()));
+      out.write(label.data(), label.size());
+      put_raw_int(out, static_cast<uint64_t>(sites));
+      out.write(coded.data() + i * coded_size, coded_size);
+
+      position += sizeof(size_t) + label.size() + sizeof(uint64_t) + coded_size;
+    }
+
+    // back-patch this blocks part of the offset table
+    out.seekp(table_pos + seq_id * 2 * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(uint64_t));
+    out.seekp(position);
+
+    if (not out) {
+      throw std::runtime_error{std::string("Failed writing to file: ") + out_file};
+    }
+
+    seq_id += block.size();
+
+    #ifdef __PREFETCH
+    prefetcher.wait();
+    #endif
+    std::swap(block, next_block);
+  }
+
+  if (seq_id != num_sequences) {
+    throw std::runtime_error{"Number of sequences changed during conversion of " + fasta_file};
+  }
+
+  // back-patch the gap mask
+  for (const auto& m : thread_masks) {
+    gap_mask &= m;
+  }
+  std::stringstream ss;
+  ss << gap_mask;
+  const auto mask_string = ss.str();
+  assert(mask_string.size() == sites);
+
+  out.seekp(mask_pos);
+  out.write(mask_string.data(), mask_string.size());
+
+  if (not out) {
+    throw std::runtime_error{std::string("Failed writing to file: ") + out_file};
+  }
+
+  return out_dir;
+}
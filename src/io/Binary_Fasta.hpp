@@ -4,13 +4,17 @@
 #include <limits>
 #include <memory>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
 
 #include "seq/MSA.hpp"
 #include "seq/MSA_Info.hpp"
 #include "io/encoding.hpp"
+#include "io/Mapped_File.hpp"
 #include "util/template_magic.hpp"
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
+#include "util/Options.hpp"
 
 #include "genesis/utils/io/serializer.hpp"
 #include "genesis/utils/io/deserializer.hpp"
@@ -18,8 +22,12 @@
 #include "genesis/sequence/functions/functions.hpp"
 #include "genesis/sequence/sequence.hpp"
 
+// version 1 files are always 4bit encoded, version 2 files store the encoding
+// right after the magic string
 constexpr char MAGIC[] = "BFAST\0";
+constexpr char MAGIC_V2[] = "BFAST\1";
 constexpr size_t MAGIC_SIZE = array_size(MAGIC);
+static_assert(array_size(MAGIC_V2) == MAGIC_SIZE, "Magic strings must have equal size");
 
 using mask_type = MSA_Info::mask_type;
 
@@ -31,9 +39,74 @@ static FourBit& code_()
   return obj;
 }
 
+static FiveBit& aa_code_()
+{
+  static FiveBit obj;
+  return obj;
+}
+
+static inline size_t packed_size(const Encoding encoding, const size_t n)
+{
+  return (encoding == Encoding::kFiveBit)
+    ? aa_code_().packed_size(n)
+    : code_().packed_size(n);
+}
+
+static inline std::string encode(const Encoding encoding, const std::string& seq)
+{
+  return (encoding == Encoding::kFiveBit)
+    ? aa_code_().to_fivebit(seq)
+    : code_().to_fourbit(seq);
+}
+
+static inline void decode(const Encoding encoding,
+                          const char* coded,
+                          const size_t n,
+                          char* out)
+{
+  if (encoding == Encoding::kFiveBit) {
+    aa_code_().decode(coded, n, out);
+  } else {
+    code_().decode(coded, n, out);
+  }
+}
+
+static inline void decode_sites(const Encoding encoding,
+                                const char* coded,
+                                const size_t n,
+                                const std::vector<size_t>& sites,
+                                char* out)
+{
+  if (encoding == Encoding::kFiveBit) {
+    aa_code_().decode_sites(coded, n, sites, out);
+  } else {
+    code_().decode_sites(coded, sites, out);
+  }
+}
+
+/**
+ * Returns the most compact encoding that can represent both the given sequence
+ * and everything that needed the current encoding.
+ */
+static inline Encoding widen_encoding(const Encoding current, const std::string& seq)
+{
+  if (current == Encoding::kFourBit
+      and std::all_of(seq.begin(), seq.end(), [](const char c){ return code_().valid(c); })) {
+    return Encoding::kFourBit;
+  }
+
+  for (const auto c : seq) {
+    if (not aa_code_().valid(c)) {
+      throw std::runtime_error{std::string("Unsupported character for conversion to bfast: ") + c};
+    }
+  }
+  return Encoding::kFiveBit;
+}
+
 static inline size_t data_section_offset(const size_t num_sequences, const size_t mask_size)
 {
   return MAGIC_SIZE
+      + sizeof(uint8_t)
       + sizeof(num_sequences)
       + (num_sequences *
         sizeof(uint64_t) * 2 )
@@ -42,13 +115,15 @@ static inline size_t data_section_offset(const size_t num_sequences, const size_
 
 static inline void write_header(utils::Serializer& ser,
                                 const std::vector<size_t>& entry_sizes,
-                                const mask_type& mask)
+                                const mask_type& mask,
+                                const Encoding encoding)
 {
   const uint64_t num_sequences = entry_sizes.size();
 
   // First part:
-  // <magic string><num_sequences>
-  ser.put_raw(MAGIC, MAGIC_SIZE);
+  // <magic string><encoding><num_sequences>
+  ser.put_raw(MAGIC_V2, MAGIC_SIZE);
+  ser.put_int(static_cast<uint8_t>(encoding));
   ser.put_int(num_sequences);
 
   // Second part: the gap mask
@@ -71,12 +146,12 @@ static inline void write_header(utils::Serializer& ser,
   }
 }
 
-static inline std::vector<size_t> get_entry_sizes(const MSA& msa)
+static inline std::vector<size_t> get_entry_sizes(const MSA& msa, const Encoding encoding)
 {
   std::vector<size_t> res;
   for (const auto& s : msa) {
     res.push_back(
-      code_().packed_size(s.sequence().size()) +
+      packed_size(encoding, s.sequence().size()) +
       s.header().size()
     );
   }
@@ -84,42 +159,55 @@ static inline std::vector<size_t> get_entry_sizes(const MSA& msa)
 }
 
 static inline void put_encoded(utils::Serializer& ser,
-                        const std::string& seq)
+                        const std::string& seq,
+                        const Encoding encoding)
 {
-  const auto encoded_seq = code_().to_fourbit(seq);
+  const auto encoded_seq = encode(encoding, seq);
   // put the size of actual characters
   ser.put_int<uint64_t>(seq.size());
   // pack characters into encoding, write them out
   ser.put_raw_string(encoded_seq);
 }
 
-static std::string get_decoded(utils::Deserializer& des)
+static std::string get_decoded(utils::Deserializer& des, const Encoding encoding)
 {
-  std::string res;
-
   // get the size of characters that were packed
   const auto decoded_size = des.get_int<uint64_t>();
 
   // figure out how much that is in bytes
-  // (decoded_size = 3 would mean 2 bytes, one for the first two, one for the third plus padding)
-  const auto coded_size = code_().packed_size(decoded_size);
+  // (for 4bit, decoded_size = 3 would mean 2 bytes, one for the first two, one for the third plus padding)
+  const auto coded_size = packed_size(encoding, decoded_size);
 
   // get the bytes
   auto coded_str = des.get_raw_string(coded_size);
 
   // decode and return
-  return code_().from_fourbit(coded_str, decoded_size);
+  std::string res(decoded_size, '-');
+  decode(encoding, coded_str.data(), decoded_size, &res[0]);
+  return res;
 }
 
-static void read_header(utils::Deserializer& des,
-                        std::vector<uint64_t>& offset,
-                        mask_type& mask)
+static Encoding to_encoding(const uint8_t value)
+{
+  if (value > static_cast<uint8_t>(Encoding::kFiveBit)) {
+    throw std::runtime_error{std::string("Unknown sequence encoding in bfast file: ")
+      + std::to_string(value)};
+  }
+  return static_cast<Encoding>(value);
+}
+
+static Encoding read_header(utils::Deserializer& des,
+                            std::vector<uint64_t>& offset,
+                            mask_type& mask)
 {
   // read the header info
   char magic[MAGIC_SIZE];
   des.get_raw(magic, MAGIC_SIZE);
 
-  if (strcmp(magic, MAGIC)) {
+  Encoding encoding = Encoding::kFourBit;
+  if (not std::memcmp(magic, MAGIC_V2, MAGIC_SIZE)) {
+    encoding = to_encoding(des.get_int<uint8_t>());
+  } else if (std::memcmp(magic, MAGIC, MAGIC_SIZE)) {
     throw std::runtime_error{std::string("File is not an epa::Binary_Fasta file")};
   }
 
@@ -138,18 +226,21 @@ static void read_header(utils::Deserializer& des,
     // offset
     offset[idx] = des.get_int<uint64_t>();
   }
+
+  return encoding;
 }
 
 static MSA read_sequences(utils::Deserializer& des,
                           const mask_type& mask,
                           const size_t number,
+                          const Encoding encoding,
                           const size_t sites = 0)
 {
   MSA msa(sites);
 
   for (size_t i = 0; i < number; ++i) {
     auto label    = des.get_string();
-    auto sequence = get_decoded(des);
+    auto sequence = get_decoded(des, encoding);
 
     if ( mask.count() ) {
       sequence = subset_sequence(sequence, mask);
@@ -161,21 +252,6 @@ static MSA read_sequences(utils::Deserializer& des,
   return msa;
 }
 
-static void ensure_dna(const std::string& seq)
-{
-  for (const auto& s : seq) {
-    bool found = false;
-    for (size_t i = 0; i < NT_MAP_SIZE and not found; ++i) {
-      found = (s == NT_MAP[i]);
-    }
-    if (not found) {
-      throw std::runtime_error{std::string("AA DATA NOT SUPPORTED for conversion to bfast!")
-        + " Sorry! Offending char: " + s
-      };
-    }
-  }
-}
-
 class Binary_Fasta
 {
 private:
@@ -209,19 +285,24 @@ public:
       gap_mask &= cur_mask;
     }
 
+    auto encoding = Encoding::kFourBit;
+    for (const auto& s : msa) {
+      encoding = widen_encoding(encoding, s.sequence());
+    }
+
     utils::Serializer ser(file_name);
 
     // Write the header
-    auto sizes = get_entry_sizes(msa);
-    write_header(ser, sizes, gap_mask);
+    auto sizes = get_entry_sizes(msa, encoding);
+    write_header(ser, sizes, gap_mask, encoding);
 
     // Write the data. Every entry:
     // <header_length (bytes/chars)><header string><sequence_length><encoded sequence padded to next byte>
     // (note: the sequence_length is in number of encoded characters, so for
-    // 4bit the number of bytes to be read is sequence_length * 2)
+    // 4bit the number of bytes to be read is sequence_length / 2, rounded up)
     for (const auto& s : msa) {
       ser.put_string(s.header());
-      put_encoded(ser, s.sequence());
+      put_encoded(ser, s.sequence(), encoding);
     }
 
   }
@@ -233,54 +314,22 @@ public:
 
     std::vector<uint64_t> offset;
     mask_type mask;
-    read_header(des, offset, mask);
+    const auto encoding = read_header(des, offset, mask);
 
     if (not premasking) {
       mask = mask_type();
     }
 
-    return read_sequences( des, mask, offset.size() );
+    return read_sequences( des, mask, offset.size(), encoding );
   }
 
+  /**
+   * Streaming conversion of a fasta file to bfast. Memory use is bounded by
+   * options.bfast_buffer (MiB), independent of the size of the input.
+   */
   static std::string fasta_to_bfast( const std::string& fasta_file,
-                              std::string out_dir)
-  {
-    auto parts = split_by_delimiter(fasta_file, "/");
-
-    out_dir += parts.back() + ".bfast";
-
-    // specific, per sequence sizes
-    std::vector<size_t> entry_sizes;
-    // and a function to get it during msa info fetch
-    auto get_sizes = [&](const genesis::sequence::Sequence& s)
-    {
-      entry_sizes.push_back(
-        s.label().size() +
-        code_().packed_size(s.sites().size())
-      );
-    };
-
-    MSA_Info info(fasta_file, get_sizes);
-
-    LOG_DBG << info;
-
-    // write the header
-    utils::Serializer ser(out_dir);
-    write_header(ser, entry_sizes, info.gap_mask());
-
-    // write the data
-    auto it = sequence::FastaInputIterator( utils::from_file(fasta_file) );
-
-    // probe first seq to see if this might be AA data
-    ensure_dna(it->sites());
-
-    while ( it ) {
-      ser.put_string(it->label());
-      put_encoded(ser, it->sites());
-      ++it;
-    }
-    return out_dir;
-  }
+                                     std::string out_dir,
+                                     const Options& options = Options() );
 
 };
 
@@ -299,7 +348,7 @@ public:
     , mask_(info.gap_mask())
   {
     mask_type dummy_mask;
-    read_header(des_, seq_offsets_, dummy_mask);
+    encoding_ = read_header(des_, seq_offsets_, dummy_mask);
 
     assert(seq_offsets_.size() == info.sequences());
 
@@ -335,13 +384,30 @@ public:
     const auto to_read =
       std::min( number, max_read_ - num_read_ );
 
-    result = read_sequences( des_, mask_, to_read );
+    result = read_sequences( des_, mask_, to_read, encoding_ );
 
     num_read_ += result.size();
 
     return result.size();
   }
 
+  virtual size_t read_range(MSA& result, const size_t begin, const size_t number) override
+  {
+    if (begin >= seq_offsets_.size()) {
+      result.clear();
+      return 0;
+    }
+    const auto to_read = std::min( number, seq_offsets_.size() - begin );
+
+    istream_.clear();
+    istream_.seekg( seq_offsets_[ begin ], istream_.beg );
+    des_ = utils::Deserializer( istream_ );
+
+    result = read_sequences( des_, mask_, to_read, encoding_ );
+
+    return result.size();
+  }
+
   virtual size_t num_sequences() const override
   {
     return seq_offsets_.size();
@@ -357,7 +423,197 @@ private:
   std::ifstream istream_;
   utils::Deserializer des_;
   mask_type mask_;
+  Encoding encoding_ = Encoding::kFourBit;
+  std::vector<uint64_t> seq_offsets_;
+  size_t num_read_  = 0;
+  size_t max_read_  = std::numeric_limits<size_t>::max();
+  size_t local_seq_offset_ = 0;
+};
+
+template <class T>
+static inline T get_mapped(const Mapped_File& file, size_t& pos)
+{
+  if (pos + sizeof(T) > file.size()) {
+    throw std::runtime_error{"Unexpected end of bfast file"};
+  }
+  T value;
+  std::memcpy(&value, file.data() + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+/**
+ * Reader working directly on a memory mapping of the bfast file: headers and
+ * packed sequences are accessed in place, and sequences are decoded (and
+ * masked) straight into the strings handed to the placement.
+ */
+class Binary_Fasta_Mapped_Reader : public msa_reader
+{
+public:
+  struct entry_view
+  {
+    const char* header;
+    size_t header_size;
+    const char* coded;
+    size_t sites;
+  };
+
+  Binary_Fasta_Mapped_Reader( const std::string& file_name,
+                              const MSA_Info info,
+                              const bool premasking = false,
+                              const bool split = false)
+    : file_(file_name)
+  {
+    size_t pos = 0;
+
+    if ( file_.size() < MAGIC_SIZE ) {
+      throw std::runtime_error{std::string("File is not an epa::Binary_Fasta file")};
+    }
+    if ( not std::memcmp(file_.data(), MAGIC_V2, MAGIC_SIZE) ) {
+      pos += MAGIC_SIZE;
+      encoding_ = to_encoding( get_mapped<uint8_t>(file_, pos) );
+    } else if ( not std::memcmp(file_.data(), MAGIC, MAGIC_SIZE) ) {
+      pos += MAGIC_SIZE;
+    } else {
+      throw std::runtime_error{std::string("File is not an epa::Binary_Fasta file")};
+    }
+
+    const auto num_sequences = get_mapped<uint64_t>(file_, pos);
+
+    // the stored mask is the one of the file alone, we use the one from the info
+    const auto mask_string_size = get_mapped<size_t>(file_, pos);
+    pos += mask_string_size;
+
+    seq_offsets_ = std::vector<uint64_t>(num_sequences);
+    for (size_t i = 0; i < num_sequences; ++i) {
+      const auto idx = get_mapped<uint64_t>(file_, pos);
+      if (idx >= num_sequences) {
+        throw std::runtime_error{std::string("Corrupt offset table in bfast file")};
+      }
+      seq_offsets_[idx] = get_mapped<uint64_t>(file_, pos);
+    }
+
+    assert(seq_offsets_.size() == info.sequences());
+
+    #ifdef __MPI
+    if ( split ) {
+      std::tie( local_seq_offset_, max_read_ ) = local_seq_package( info.sequences() );
+    }
+    #else
+    static_cast<void>(split);
+    #endif
+
+    local_seq_offset_ = std::min( seq_offsets_.size(), local_seq_offset_ );
+    max_read_ = std::min( seq_offsets_.size() - local_seq_offset_, max_read_ );
+
+    const auto& mask = info.gap_mask();
+    if ( premasking and mask.count() ) {
+      for (size_t i = 0; i < mask.size(); ++i) {
+        if (not mask[i]) {
+          kept_sites_.push_back(i);
+        }
+      }
+      mask_size_ = mask.size();
+      masked_ = true;
+    }
+
+    // we read our part front to back, and want it to be paged in ahead of time
+    if ( max_read_ ) {
+      const size_t begin = seq_offsets_[local_seq_offset_];
+      const size_t end = ( local_seq_offset_ + max_read_ < seq_offsets_.size() )
+                       ? seq_offsets_[local_seq_offset_ + max_read_]
+                       : file_.size();
+      file_.advise( begin, end - begin, MADV_SEQUENTIAL );
+      file_.advise( begin, end - begin, MADV_WILLNEED );
+    }
+  }
+
+  ~Binary_Fasta_Mapped_Reader() = default;
+
+  /**
+   * View of the (packed) entry of a sequence, pointing into the mapped file.
+   */
+  entry_view entry(const size_t seq_id) const
+  {
+    size_t pos = seq_offsets_.at(seq_id);
+
+    entry_view view;
+    view.header_size  = get_mapped<size_t>(file_, pos);
+    view.header       = file_.data() + pos;
+    pos += view.header_size;
+    view.sites        = get_mapped<uint64_t>(file_, pos);
+    view.coded        = file_.data() + pos;
+
+    if ( pos + packed_size(encoding_, view.sites) > file_.size() ) {
+      throw std::runtime_error{"Unexpected end of bfast file"};
+    }
+
+    return view;
+  }
+
+  virtual size_t read_next(MSA& result, const size_t number) override
+  {
+    const auto to_read =
+      std::min( number, max_read_ - num_read_ );
+
+    read_( result, local_seq_offset_ + num_read_, to_read );
+    num_read_ += result.size();
+
+    return result.size();
+  }
+
+  virtual size_t read_range(MSA& result, const size_t begin, const size_t number) override
+  {
+    const auto to_read = begin < seq_offsets_.size()
+                       ? std::min( number, seq_offsets_.size() - begin )
+                       : 0;
+
+    read_( result, begin, to_read );
+
+    return result.size();
+  }
+
+  virtual size_t num_sequences() const override
+  {
+    return seq_offsets_.size();
+  }
+
+  virtual size_t local_seq_offset() const override
+  {
+    return local_seq_offset_;
+  }
+
+private:
+  void read_(MSA& result, const size_t begin, const size_t number) const
+  {
+    MSA chunk;
+    for (size_t i = 0; i < number; ++i) {
+      const auto view = entry( begin + i );
+
+      std::string sequence;
+      if ( masked_ ) {
+        if ( view.sites != mask_size_ ) {
+          throw std::runtime_error{"In Binary_Fasta_Mapped_Reader: mask and seq incompatible"};
+        }
+        sequence.resize( kept_sites_.size() );
+        decode_sites( encoding_, view.coded, view.sites, kept_sites_, &sequence[0] );
+      } else {
+        sequence.resize( view.sites );
+        decode( encoding_, view.coded, view.sites, &sequence[0] );
+      }
+
+      chunk.append( std::string( view.header, view.header_size ), std::move(sequence) );
+    }
+
+    std::swap( result, chunk );
+  }
+
+  Mapped_File file_;
+  Encoding encoding_ = Encoding::kFourBit;
   std::vector<uint64_t> seq_offsets_;
+  std::vector<size_t> kept_sites_;
+  size_t mask_size_ = 0;
+  bool masked_ = false;
   size_t num_read_  = 0;
   size_t max_read_  = std::numeric_limits<size_t>::max();
   size_t local_seq_offset_ = 0;
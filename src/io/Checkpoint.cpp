@@ -0,0 +1,129 @@
+#include "io/Checkpoint.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char CHECKPOINT_MAGIC[] = "EPAC\0";
+constexpr size_t CHECKPOINT_MAGIC_SIZE = sizeof(CHECKPOINT_MAGIC);
+
+template <class T>
+static void put(std::ofstream& out, const T& value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+static T get(std::ifstream& in)
+{
+  T value;
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  if (not in) {
+    throw std::runtime_error{"Checkpoint: unexpected end of checkpoint file"};
+  }
+  return value;
+}
+
+Checkpoint::Checkpoint( const uint64_t reference_hash,
+                        const uint64_t settings_hash,
+                        const std::string& query_file,
+                        const size_t chunk_size,
+                        const size_t num_ranks)
+  : reference_hash_(reference_hash)
+  , settings_hash_(settings_hash)
+  , chunk_size_(chunk_size)
+  , num_ranks_(num_ranks)
+{
+  struct stat st;
+  if (stat(query_file.c_str(), &st)) {
+    throw std::runtime_error{std::string("Cannot open file: ") + query_file};
+  }
+  query_size_ = static_cast<uint64_t>(st.st_size);
+  query_mtime_ = static_cast<int64_t>(st.st_mtime);
+}
+
+void Checkpoint::save(const std::string& file_name) const
+{
+  // a crash while writing must leave the previous checkpoint intact
+  const auto tmp_name = file_name + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+    if (not out) {
+      throw std::runtime_error{std::string("Cannot write checkpoint file: ") + tmp_name};
+    }
+
+    out.write(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+    put(out, reference_hash_);
+    put(out, settings_hash_);
+    put(out, query_size_);
+    put(out, query_mtime_);
+    put(out, chunk_size_);
+    put(out, num_ranks_);
+    put(out, chunks_done_);
+    put(out, bytes_written_);
+    put(out, blocks_written_);
+
+    out.flush();
+    if (not out) {
+      std::remove(tmp_name.c_str());
+      throw std::runtime_error{std::string("Failed writing checkpoint file: ") + tmp_name};
+    }
+  }
+
+  if (std::rename(tmp_name.c_str(), file_name.c_str())) {
+    std::remove(tmp_name.c_str());
+    throw std::runtime_error{std::string("Cannot write checkpoint file: ") + file_name};
+  }
+}
+
+Checkpoint Checkpoint::load(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  if (not in) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+
+  char magic[CHECKPOINT_MAGIC_SIZE];
+  in.read(magic, CHECKPOINT_MAGIC_SIZE);
+  if (not in or std::memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE)) {
+    throw std::runtime_error{file_name + " is not an epa::Checkpoint file"};
+  }
+
+  Checkpoint result;
+  result.reference_hash_  = get<uint64_t>(in);
+  result.settings_hash_   = get<uint64_t>(in);
+  result.query_size_      = get<uint64_t>(in);
+  result.query_mtime_     = get<int64_t>(in);
+  result.chunk_size_      = get<uint64_t>(in);
+  result.num_ranks_       = get<uint64_t>(in);
+  result.chunks_done_     = get<uint64_t>(in);
+  result.bytes_written_   = get<uint64_t>(in);
+  result.blocks_written_  = get<uint64_t>(in);
+
+  return result;
+}
+
+void Checkpoint::check_resumable(const Checkpoint& other) const
+{
+  const std::string prefix("Cannot resume from the checkpoint: ");
+  if (reference_hash_ != other.reference_hash_) {
+    throw std::runtime_error{prefix + "it was taken with a different reference tree or model."};
+  }
+  if (settings_hash_ != other.settings_hash_) {
+    throw std::runtime_error{prefix + "it was taken with different heuristic, filter or output settings."};
+  }
+  if (query_size_ != other.query_size_ or query_mtime_ != other.query_mtime_) {
+    throw std::runtime_error{prefix + "the query file has changed since."};
+  }
+  if (chunk_size_ != other.chunk_size_) {
+    throw std::runtime_error{prefix + "it was taken with a chunk size of "
+                            + std::to_string(other.chunk_size_)};
+  }
+  if (num_ranks_ != other.num_ranks_) {
+    throw std::runtime_error{prefix + "it was taken with "
+                            + std::to_string(other.num_ranks_) + " MPI ranks"};
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Progress of a placement run, persisted next to its output such that a run
+ * that was interrupted can continue after the last chunk whose results are
+ * safely on disk, instead of starting from zero.
+ *
+ * Besides the progress (the number of completed chunks per rank, and where the
+ * next block goes in the jplace file), a checkpoint identifies the run it was
+ * taken from: the reference tree and model, the settings that change the
+ * output, the query file and the way it was cut into chunks. It may only be
+ * resumed from by a run that matches in all of these.
+ */
+class Checkpoint
+{
+public:
+  Checkpoint() = default;
+  Checkpoint( const uint64_t reference_hash,
+              const uint64_t settings_hash,
+              const std::string& query_file,
+              const size_t chunk_size,
+              const size_t num_ranks);
+  ~Checkpoint() = default;
+
+  static std::string file_name(const std::string& out_dir)
+  {
+    return out_dir + "epa_result.ckp";
+  }
+
+  /**
+   * Atomically replaces the given file.
+   */
+  void save(const std::string& file_name) const;
+  static Checkpoint load(const std::string& file_name);
+
+  /**
+   * Throws if the given checkpoint was taken from a different run than the one
+   * described by this one.
+   */
+  void check_resumable(const Checkpoint& other) const;
+
+  void progress( const size_t chunks_done,
+                 const size_t bytes_written,
+                 const size_t blocks_written)
+  {
+    chunks_done_ = chunks_done;
+    bytes_written_ = bytes_written;
+    blocks_written_ = blocks_written;
+  }
+
+  size_t chunks_done() const { return chunks_done_; }
+  size_t bytes_written() const { return bytes_written_; }
+  size_t blocks_written() const { return blocks_written_; }
+
+private:
+  uint64_t reference_hash_ = 0;
+  uint64_t settings_hash_ = 0;
+  uint64_t query_size_ = 0;
+  int64_t query_mtime_ = 0;
+  uint64_t chunk_size_ = 0;
+  uint64_t num_ranks_ = 0;
+
+  uint64_t chunks_done_ = 0;
+  uint64_t bytes_written_ = 0;
+  uint64_t blocks_written_ = 0;
+};
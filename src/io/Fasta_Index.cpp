@@ -0,0 +1,195 @@
+#include "io/Fasta_Index.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "net/mpihead.hpp"
+#include "util/logging.hpp"
+
+constexpr char INDEX_MAGIC[] = "EPAI\0";
+constexpr size_t INDEX_MAGIC_SIZE = sizeof(INDEX_MAGIC);
+constexpr size_t SCAN_BLOCK_SIZE = 1 << 20;
+
+static bool file_stats(const std::string& file_name, uint64_t& size, int64_t& mtime)
+{
+  struct stat st;
+  if (stat(file_name.c_str(), &st)) {
+    return false;
+  }
+  size = static_cast<uint64_t>(st.st_size);
+  mtime = static_cast<int64_t>(st.st_mtime);
+  return true;
+}
+
+template <class T>
+static void put(std::ofstream& out, const T& value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+static T get(std::ifstream& in)
+{
+  T value;
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  if (not in) {
+    throw std::runtime_error{"Fasta_Index: unexpected end of index file"};
+  }
+  return value;
+}
+
+bool is_gzipped(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  unsigned char magic[2] = {0, 0};
+  in.read(reinterpret_cast<char*>(magic), 2);
+  return in and magic[0] == 0x1f and magic[1] == 0x8b;
+}
+
+Fasta_Index::Fasta_Index(const std::string& fasta_file)
+{
+  if (not file_stats(fasta_file, file_size_, mtime_)) {
+    throw std::runtime_error{std::string("Cannot open file: ") + fasta_file};
+  }
+
+  std::ifstream in(fasta_file, std::ios::binary);
+  if (not in) {
+    throw std::runtime_error{std::string("Cannot open file: ") + fasta_file};
+  }
+
+  // plain byte scan: a record starts with a '>' at the beginning of a line
+  std::vector<char> block(SCAN_BLOCK_SIZE);
+  uint64_t block_start = 0;
+  bool line_start = true;
+  while (in) {
+    in.read(block.data(), block.size());
+    const auto count = static_cast<size_t>(in.gcount());
+    for (size_t i = 0; i < count; ++i) {
+      if (line_start and block[i] == '>') {
+        offsets_.push_back(block_start + i);
+      }
+      line_start = (block[i] == '\n');
+    }
+    block_start += count;
+  }
+}
+
+void Fasta_Index::save(const std::string& file_name) const
+{
+  // write to a temporary file first, so that concurrent runs never see a
+  // partially written index
+  const auto tmp_name = file_name + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+    if (not out) {
+      throw std::runtime_error{std::string("Cannot write index file: ") + tmp_name};
+    }
+
+    out.write(INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    put(out, file_size_);
+    put(out, mtime_);
+    put(out, static_cast<uint64_t>(offsets_.size()));
+    out.write(reinterpret_cast<const char*>(offsets_.data()),
+              offsets_.size() * sizeof(uint64_t));
+
+    if (not out) {
+      std::remove(tmp_name.c_str());
+      throw std::runtime_error{std::string("Failed writing index file: ") + tmp_name};
+    }
+  }
+
+  if (std::rename(tmp_name.c_str(), file_name.c_str())) {
+    std::remove(tmp_name.c_str());
+    throw std::runtime_error{std::string("Cannot write index file: ") + file_name};
+  }
+}
+
+Fasta_Index Fasta_Index::load(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  if (not in) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+
+  char magic[INDEX_MAGIC_SIZE];
+  in.read(magic, INDEX_MAGIC_SIZE);
+  if (not in or std::memcmp(magic, INDEX_MAGIC, INDEX_MAGIC_SIZE)) {
+    throw std::runtime_error{file_name + " is not an epa::Fasta_Index file"};
+  }
+
+  Fasta_Index index;
+  index.file_size_  = get<uint64_t>(in);
+  index.mtime_      = get<int64_t>(in);
+  const auto num    = get<uint64_t>(in);
+
+  index.offsets_.resize(num);
+  in.read(reinterpret_cast<char*>(index.offsets_.data()), num * sizeof(uint64_t));
+  if (not in) {
+    throw std::runtime_error{std::string("Truncated index file: ") + file_name};
+  }
+
+  return index;
+}
+
+bool Fasta_Index::matches(const std::string& fasta_file) const
+{
+  uint64_t size;
+  int64_t mtime;
+  return file_stats(fasta_file, size, mtime)
+    and size == file_size_
+    and mtime == mtime_;
+}
+
+Fasta_Index Fasta_Index::load_or_build(const std::string& fasta_file)
+{
+  if (is_gzipped(fasta_file)) {
+    LOG_DBG << "Input is gzipped, cannot build a byte offset index for it.";
+    return Fasta_Index();
+  }
+
+  const auto index_file = index_file_name(fasta_file);
+
+  try {
+    auto index = load(index_file);
+    if (index.matches(fasta_file)) {
+      LOG_DBG << "Using FASTA index " << index_file;
+      return index;
+    }
+    LOG_DBG << "FASTA index " << index_file << " is outdated, rebuilding.";
+  } catch (const std::exception&) {
+    // no usable index yet
+  }
+
+  Fasta_Index index(fasta_file);
+
+  try {
+    index.save(index_file);
+  } catch (const std::exception& e) {
+    LOG_WARN << "Could not persist the FASTA index: " << e.what();
+  }
+
+  return index;
+}
+
+Fasta_Index Fasta_Index::shared(const std::string& fasta_file)
+{
+  int local_rank = 0;
+  MPI_COMM_RANK(MPI_COMM_WORLD, &local_rank);
+
+  Fasta_Index index;
+  if (local_rank == 0) {
+    index = load_or_build(fasta_file);
+  }
+
+  // the others wait for rank 0 to have written the index, then pick it up
+  MPI_BARRIER(MPI_COMM_WORLD);
+
+  if (local_rank != 0) {
+    index = load_or_build(fasta_file);
+  }
+
+  return index;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+/**
+ * Byte offset index of a FASTA file, similar in spirit to samtools' .fai:
+ * stores the position of the '>' of every record, so that a reader can seek
+ * directly to the n-th sequence instead of parsing all preceding ones.
+ *
+ * The index is persisted next to the FASTA file (see index_file_name) and
+ * reused for as long as the size and modification time of the FASTA file match
+ * the ones recorded in the index.
+ */
+class Fasta_Index
+{
+public:
+  /**
+   * Build the index by scanning the raw bytes of the given file.
+   */
+  explicit Fasta_Index(const std::string& fasta_file);
+  Fasta_Index() = default;
+  ~Fasta_Index() = default;
+
+  /**
+   * Load the persisted index of the given FASTA file, or build and persist it if
+   * there is none or it is outdated. Returns an empty index for inputs that
+   * cannot be seeked into (gzipped files).
+   */
+  static Fasta_Index load_or_build(const std::string& fasta_file);
+
+  /**
+   * Same as load_or_build, but under MPI only rank 0 builds and writes the index
+   * while the others wait and then load it. Collective call.
+   */
+  static Fasta_Index shared(const std::string& fasta_file);
+
+  static std::string index_file_name(const std::string& fasta_file)
+  {
+    return fasta_file + ".epai";
+  }
+
+  void save(const std::string& file_name) const;
+  static Fasta_Index load(const std::string& file_name);
+
+  /**
+   * Checks if this index was built from the given file in its current state.
+   */
+  bool matches(const std::string& fasta_file) const;
+
+  // access
+  size_t size() const { return offsets_.size(); }
+  bool empty() const { return offsets_.empty(); }
+  const std::vector<uint64_t>& offsets() const { return offsets_; }
+  uint64_t offset(const size_t seq_id) const
+  {
+    if (seq_id >= offsets_.size()) {
+      throw std::runtime_error{std::string("Fasta_Index: no record with id ")
+        + std::to_string(seq_id)};
+    }
+    return offsets_[seq_id];
+  }
+
+private:
+  uint64_t file_size_ = 0;
+  int64_t mtime_ = 0;
+  std::vector<uint64_t> offsets_;
+};
+
+/**
+ * Checks the magic bytes of the file for gzip compression.
+ */
+bool is_gzipped(const std::string& file_name);
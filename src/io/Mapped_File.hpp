@@ -0,0 +1,106 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <cstddef>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Read-only memory mapping of a whole file.
+ *
+ * Pages are shared with the OS page cache, so mapping a file that was read
+ * recently costs next to nothing.
+ */
+class Mapped_File
+{
+public:
+  explicit Mapped_File(const std::string& file_name)
+  {
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+    }
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+      close(fd);
+      throw std::runtime_error{std::string("Cannot stat file: ") + file_name};
+    }
+    size_ = static_cast<size_t>(st.st_size);
+
+    if (size_) {
+      auto addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error{std::string("Cannot map file: ") + file_name};
+      }
+      data_ = static_cast<const char*>(addr);
+    }
+
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+  }
+
+  Mapped_File() = default;
+  ~Mapped_File() { unmap_(); }
+
+  Mapped_File(Mapped_File const& other) = delete;
+  Mapped_File(Mapped_File&& other)
+  {
+    *this = std::move(other);
+  }
+
+  Mapped_File& operator= (Mapped_File const& other) = delete;
+  Mapped_File& operator= (Mapped_File&& other)
+  {
+    if (this != &other) {
+      unmap_();
+      data_ = other.data_;
+      size_ = other.size_;
+      other.data_ = nullptr;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  /**
+   * Tell the kernel how we are going to access [offset, offset + length).
+   * Purely a hint, failures are ignored.
+   */
+  void advise(const size_t offset, size_t length, const int advice) const
+  {
+    if (not data_ or offset >= size_) {
+      return;
+    }
+    length = std::min(length, size_ - offset);
+
+    // madvise requires a page aligned start address
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t aligned = offset - (offset % page_size);
+    madvise(const_cast<char*>(data_) + aligned, length + (offset - aligned), advice);
+  }
+
+  // access
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+private:
+  void unmap_()
+  {
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
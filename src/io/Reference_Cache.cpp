@@ -0,0 +1,91 @@
+#include "io/Reference_Cache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io/Binary.hpp"
+#include "io/file_io.hpp"
+#include "core/pll/pll_util.hpp"
+#include "util/hash.hpp"
+
+// to be bumped whenever the way a reference is built changes its result
+constexpr uint64_t CACHE_VERSION = 1;
+
+static uint64_t hash_file(const std::string& file_name, const uint64_t seed)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  if (not in) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+  std::ostringstream content;
+  content << in.rdbuf();
+  return fnv1a(content.str(), seed);
+}
+
+Reference_Cache::Reference_Cache( const std::string& cache_dir,
+                                  const std::string& tree_file,
+                                  const MSA& ref_msa,
+                                  const std::string& model_desc,
+                                  const Options& options)
+  : tree_file_(tree_file)
+{
+  auto hash = fnv1a_value(CACHE_VERSION);
+  hash = hash_file(tree_file, hash);
+  for (const auto& sequence : ref_msa) {
+    hash = fnv1a(sequence.header(), hash);
+    hash = fnv1a(sequence.sequence(), hash);
+  }
+  hash = fnv1a(model_desc, hash);
+  hash = fnv1a_value(options.opt_model, hash);
+  hash = fnv1a_value(options.opt_branches, hash);
+  hash = fnv1a_value(options.premasking, hash);
+  hash = fnv1a_value(options.repeats, hash);
+  hash = fnv1a_value(options.scaling, hash);
+  key_ = hash;
+
+  std::ostringstream name;
+  name << cache_dir;
+  if (not cache_dir.empty() and cache_dir.back() != '/') {
+    name << '/';
+  }
+  name << "epa_reference_" << std::hex << std::setw(16) << std::setfill('0') << key_ << ".bin";
+  file_name_ = name.str();
+}
+
+bool Reference_Cache::contains() const
+{
+  struct stat st;
+  return stat(file_name_.c_str(), &st) == 0 and S_ISREG(st.st_mode);
+}
+
+Tree Reference_Cache::load(raxml::Model& model, const Options& options) const
+{
+  Tree tree(file_name_, model, options);
+
+  Tree_Numbers nums;
+  auto utree = build_tree_from_file(tree_file_, nums, tree.mapper());
+  utree_destroy(utree);
+
+  return tree;
+}
+
+void Reference_Cache::store(Tree& tree) const
+{
+  const auto tmp_name = file_name_ + ".tmp." + std::to_string(getpid());
+  try {
+    dump_to_binary(tree, tmp_name);
+  } catch (...) {
+    std::remove(tmp_name.c_str());
+    throw;
+  }
+
+  if (std::rename(tmp_name.c_str(), file_name_.c_str())) {
+    std::remove(tmp_name.c_str());
+    throw std::runtime_error{std::string("Cannot write reference cache file: ") + file_name_};
+  }
+}
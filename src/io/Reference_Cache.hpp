@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "seq/MSA.hpp"
+#include "tree/Tree.hpp"
+#include "core/raxml/Model.hpp"
+#include "util/Options.hpp"
+
+/**
+ * Directory of built reference trees (--cache-dir), in the binary format of
+ * --dump-binary, such that repeated runs against the same reference can load it
+ * instead of optimizing the model and computing all CLVs again.
+ *
+ * Entries are addressed by a hash of everything that goes into building the
+ * reference: the tree file, the reference MSA (after masking, as the mask also
+ * depends on the query file), the model and the settings that change the
+ * partition.
+ *
+ * Only the tree and its CLVs are cached. The prescoring lookup tables are
+ * still computed by every run.
+ */
+class Reference_Cache
+{
+public:
+  Reference_Cache(const std::string& cache_dir,
+                  const std::string& tree_file,
+                  const MSA& ref_msa,
+                  const std::string& model_desc,
+                  const Options& options);
+  Reference_Cache() = delete;
+  ~Reference_Cache() = default;
+
+  uint64_t key() const { return key_; }
+  const std::string& file_name() const { return file_name_; }
+
+  bool contains() const;
+
+  /**
+   * Loads the tree of this entry. The binary format knows nothing of the root
+   * of a rooted input tree, so it is taken from the tree file again.
+   */
+  Tree load(raxml::Model& model, const Options& options) const;
+
+  /**
+   * Adds the given tree to the cache. The entry appears atomically, such that
+   * concurrent runs never load a partially written one.
+   */
+  void store(Tree& tree) const;
+
+private:
+  std::string tree_file_;
+  uint64_t key_;
+  std::string file_name_;
+};
@@ -1,13 +1,25 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <string>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
 
 #include "util/Matrix.hpp"
 #include "util/maps.hpp"
 
-
+/**
+ * Identifiers of the packed sequence encodings, as stored in files.
+ */
+enum class Encoding : uint8_t {
+  kFourBit = 0,
+  kFiveBit = 1
+};
 
 class FourBit
 {
@@ -71,6 +83,12 @@ public:
       to_fourbit_.at(row, col) = packed_char;
     }
 
+    valid_.fill(false);
+    for (uchar i = 0; i < map_size; ++i) {
+      valid_[NT_MAP[i]] = true;
+      valid_[std::tolower(NT_MAP[i])] = true;
+    }
+
     // make the reverse lookup
     for (size_t i = 0; i < from_fourbit_.max_size() * 2; i+=2) {
       auto pair = unpack_(i/2);
@@ -82,11 +100,16 @@ public:
   }
   ~FourBit() = default;
 
-  inline size_t packed_size(const size_t size)
+  inline size_t packed_size(const size_t size) const
   {
     return std::ceil(size / 2.0);
   }
 
+  bool valid(const char c) const
+  {
+    return valid_[static_cast<uchar>(c)];
+  }
+
   // conversion functions
   inline std::basic_string<char> to_fourbit(const std::string& s)
   {
@@ -140,8 +163,183 @@ public:
 
     return res;
   }
+
+  /**
+   * Decode n characters from the packed buffer straight into out, which must
+   * have room for n characters. No intermediate strings are created.
+   */
+  void decode(const char* coded, const size_t n, char* out) const
+  {
+    const size_t pairs = n / 2;
+    for (size_t i = 0; i < pairs; ++i) {
+      std::memcpy(out + 2*i, &from_fourbit_[static_cast<uchar>(coded[i])], 2);
+    }
+
+    // odd length: the last byte only holds one character
+    if (n % 2) {
+      out[n - 1] = NT_MAP[unpack_(static_cast<uchar>(coded[pairs])).first];
+    }
+  }
+
+  /**
+   * Decode only the given (ascending) sites of the packed buffer into out,
+   * i.e. apply a gap mask while decoding.
+   */
+  void decode_sites(const char* coded, const std::vector<size_t>& sites, char* out) const
+  {
+    for (size_t k = 0; k < sites.size(); ++k) {
+      const auto site = sites[k];
+      const auto pair = unpack_(static_cast<uchar>(coded[site / 2]));
+      out[k] = NT_MAP[(site % 2) ? pair.second : pair.first];
+    }
+  }
   
 private:
   Matrix<char> to_fourbit_;
   std::array<char16_t, 256> from_fourbit_;
+  std::array<bool, 256> valid_;
+};
+
+/**
+ * Packs 8 characters into 5 bytes. Covers all amino acid one letter codes plus
+ * the usual ambiguity and gap characters (see FIVEBIT_MAP).
+ */
+class FiveBit
+{
+  // shorthand
+  using uchar = unsigned char;
+private:
+  static constexpr uchar INVALID = 0xFF;
+
+  uchar code_(const char c) const
+  {
+    const auto code = to_fivebit_[static_cast<uchar>(c)];
+    if (code == INVALID) {
+      throw std::runtime_error{std::string("Character not supported by the 5bit encoding: ") + c};
+    }
+    return code;
+  }
+
+  static void put_block_(const uint64_t bits, uchar* out, const size_t bytes)
+  {
+    for (size_t k = 0; k < bytes; ++k) {
+      out[k] = (bits >> (8 * (4 - k))) & 0xFF;
+    }
+  }
+
+  static uint64_t get_block_(const uchar* in, const size_t bytes)
+  {
+    uint64_t bits = 0;
+    for (size_t k = 0; k < 5; ++k) {
+      bits = (bits << 8) | (k < bytes ? in[k] : 0u);
+    }
+    return bits;
+  }
+
+public:
+  FiveBit()
+  {
+    static_assert(FIVEBIT_MAP_SIZE <= 32, "Weird 5bit map size, go adjust encoder code!");
+
+    to_fivebit_.fill(uchar{INVALID});
+    for (uchar i = 0; i < FIVEBIT_MAP_SIZE; ++i) {
+      assert(FIVEBIT_MAP[i] == std::toupper(FIVEBIT_MAP[i]));
+      to_fivebit_[FIVEBIT_MAP[i]] = i;
+      to_fivebit_[std::tolower(FIVEBIT_MAP[i])] = i;
+    }
+  }
+  ~FiveBit() = default;
+
+  inline size_t packed_size(const size_t size) const
+  {
+    return (size * 5 + 7) / 8;
+  }
+
+  bool valid(const char c) const
+  {
+    return to_fivebit_[static_cast<uchar>(c)] != INVALID;
+  }
+
+  // conversion functions
+  std::string to_fivebit(const std::string& s) const
+  {
+    std::string res(packed_size(s.size()), '\0');
+    auto out = reinterpret_cast<uchar*>(&res[0]);
+
+    // full blocks of 8 characters / 5 bytes
+    const size_t blocks = s.size() / 8;
+    for (size_t b = 0; b < blocks; ++b) {
+      uint64_t bits = 0;
+      for (size_t k = 0; k < 8; ++k) {
+        bits = (bits << 5) | code_(s[b * 8 + k]);
+      }
+      put_block_(bits, out + b * 5, 5);
+    }
+
+    // trailing partial block, padded with gaps
+    const size_t rest = s.size() - blocks * 8;
+    if (rest) {
+      uint64_t bits = 0;
+      for (size_t k = 0; k < 8; ++k) {
+        bits = (bits << 5) | (k < rest ? code_(s[blocks * 8 + k]) : 0u);
+      }
+      put_block_(bits, out + blocks * 5, res.size() - blocks * 5);
+    }
+
+    return res;
+  }
+
+  std::string from_fivebit(const std::string& s, const size_t n) const
+  {
+    std::string res(n, '-');
+    decode(s.data(), n, &res[0]);
+    return res;
+  }
+
+  /**
+   * Decode n characters from the packed buffer straight into out.
+   */
+  void decode(const char* coded, const size_t n, char* out) const
+  {
+    auto in = reinterpret_cast<const uchar*>(coded);
+
+    const size_t blocks = n / 8;
+    for (size_t b = 0; b < blocks; ++b) {
+      const auto bits = get_block_(in + b * 5, 5);
+      for (size_t k = 0; k < 8; ++k) {
+        out[b * 8 + k] = FIVEBIT_MAP[(bits >> (5 * (7 - k))) & 0x1F];
+      }
+    }
+
+    const size_t rest = n - blocks * 8;
+    if (rest) {
+      const auto bits = get_block_(in + blocks * 5, packed_size(n) - blocks * 5);
+      for (size_t k = 0; k < rest; ++k) {
+        out[blocks * 8 + k] = FIVEBIT_MAP[(bits >> (5 * (7 - k))) & 0x1F];
+      }
+    }
+  }
+
+  /**
+   * Decode only the given (ascending) sites of a packed buffer holding n
+   * characters into out, i.e. apply a gap mask while decoding.
+   */
+  void decode_sites(const char* coded,
+                    const size_t n,
+                    const std::vector<size_t>& sites,
+                    char* out) const
+  {
+    auto in = reinterpret_cast<const uchar*>(coded);
+    const size_t bytes = packed_size(n);
+
+    for (size_t k = 0; k < sites.size(); ++k) {
+      const size_t bit = sites[k] * 5;
+      const size_t byte = bit / 8;
+      const unsigned window = (in[byte] << 8) | (byte + 1 < bytes ? in[byte + 1] : 0u);
+      out[k] = FIVEBIT_MAP[(window >> (11 - (bit % 8))) & 0x1F];
+    }
+  }
+
+private:
+  std::array<uchar, 256> to_fivebit_;
 };
@@ -6,6 +6,11 @@
 #include <sstream>
 #include <cassert>
 #include <iomanip>
+#include <deque>
+#include <array>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
 
 #include "sample/Sample.hpp"
 #include "util/logging.hpp"
@@ -19,15 +24,36 @@
 class jplace_writer
 {
 public:
+  /**
+   * Where the next block of placements goes: byte offset into the file, and
+   * the number of placement blocks before it.
+   */
+  struct Position
+  {
+    Position(const size_t bytes = 0, const size_t blocks = 0)
+      : bytes(bytes)
+      , blocks(blocks)
+    { }
+
+    size_t bytes;
+    size_t blocks;
+  };
+
   jplace_writer() = default;
+  /**
+   * If a start position is given, continues the file of an interrupted run
+   * from there (see sync()) instead of starting a new one.
+   */
   jplace_writer(const std::string& out_dir,
                 const std::string& file_name,
                 const std::string& tree_string,
                 const std::string& invocation_string,
-                rtree_mapper const& mapper)
+                rtree_mapper const& mapper,
+                Position const& start = Position())
     : tree_string_(tree_string)
     , invocation_(invocation_string)
     , mapper_(mapper)
+    , start_(start)
   {
     init_mpi_();
     init_file_(out_dir, file_name);
@@ -36,27 +62,41 @@ public:
   ~jplace_writer()
   {
     // ensure last write/gather was completed
-    wait();
+    finish();
 
     // finalize and close
     #ifdef __MPI
 
+    std::stringstream trailing;
+    trailing.precision( precision_ );
+    trailing.setf( std::ios::fixed, std:: ios::floatfield );
+    finalize_jplace_string( invocation_, trailing );
+    const auto trailing_str = trailing.str();
+    const auto end = unordered_ ? end_offset_ : bytes_written_;
+
     if (local_rank_ == 0) {
-      std::stringstream trailing;
-      trailing.precision( precision_ );
-      trailing.setf( std::ios::fixed, std:: ios::floatfield );
-      finalize_jplace_string( invocation_, trailing );
-      MPI_File_seek(shared_file_, 0, MPI_SEEK_END);
-      MPI_File_write(shared_file_, trailing.str().c_str(), trailing.str().size(),
-                      MPI_CHAR, MPI_STATUS_IGNORE);
+      MPI_File_write_at(shared_file_, end, trailing_str.c_str(), trailing_str.size(),
+                        MPI_CHAR, MPI_STATUS_IGNORE);
     }
+
+    // cut off what is left of a previous, longer file
+    MPI_File_set_size(shared_file_, end + trailing_str.size());
     MPI_File_close(&shared_file_);
+    MPI_Comm_free(&comm_);
 
     #else
 
     if (file_) {
       finalize_jplace_string(invocation_, *file_);
+      const std::streamoff end = file_->tellp();
       file_->close();
+
+      // cut off what is left of the previous run
+      if (start_.bytes and end > 0) {
+        if (truncate(file_path_.c_str(), static_cast<off_t>(end))) {
+          LOG_WARN << "Could not truncate " << file_path_;
+        }
+      }
     }
 
     #endif
@@ -64,7 +104,7 @@ public:
 
   void write( Sample<>& chunk )
   {
-    #ifdef __PREFETCH
+    #if defined(__PREFETCH) && !defined(__MPI)
     // ensure the last write has finished
     if (prev_gather_.valid()) {
       prev_gather_.get();
@@ -74,6 +114,7 @@ public:
         this->write_(chunk);
       });
     #else
+    // under MPI, the writes are nonblocking anyway
     write_(chunk);
     #endif
   }
@@ -85,8 +126,130 @@ public:
       prev_gather_.get();
     }
     #endif
+    #ifdef __MPI
+    progress_(0);
+    #endif
+  }
+
+  /**
+   * Waits for the last writes. Collective under MPI: ranks that ran out of
+   * chunks keep taking part in the rounds of the others, until all of them
+   * have. Has to happen before any other collective call that the ranks may
+   * reach after different numbers of chunks.
+   */
+  void finish()
+  {
+    wait();
+    #ifdef __MPI
+    if (not unordered_ and not finished_) {
+      finish_rounds_();
+    }
+    finished_ = true;
+    #endif
+  }
+
+  /**
+   * Waits for everything written so far to be on disk, and returns where the
+   * next block goes, for a later run to continue from.
+   *
+   * Collective under MPI, where every rank has to call it after the same
+   * number of chunks.
+   */
+  Position sync()
+  {
+    wait();
+
+    Position result;
+    #ifdef __MPI
+    assert(not unordered_ and not finished_);
+    MPI_File_sync(shared_file_);
+    // the blocks of the other ranks have to be on disk as well
+    MPI_Barrier(comm_);
+    result.bytes = bytes_written_;
+    result.blocks = blocks_written_;
+    #else
+    file_->flush();
+    result.bytes = static_cast<size_t>(file_->tellp());
+    result.blocks = first_ ? 0u : 1u;
+    #endif
+    return result;
+  }
+
+  #ifdef __MPI
+  /**
+   * Switch to unordered mode, where every rank writes its blocks independently
+   * at offsets decided elsewhere (see Work_Distributor), instead of all ranks
+   * writing one block each per round.
+   *
+   * Returns the size of the header in bytes.
+   */
+  size_t begin_unordered()
+  {
+    assert(pending_.empty());
+    unordered_ = true;
+    end_offset_ = bytes_written_;
+    return bytes_written_;
+  }
+
+  /**
+   * Serialize a chunk for write_at. Non-empty blocks start with a separator of
+   * fixed size, so their size is known before their position in the file is.
+   */
+  std::string serialize( Sample<>& chunk ) const
+  {
+    if (chunk.size() == 0) {
+      return std::string();
+    }
+    std::stringstream buffer;
+    buffer.precision( precision_ );
+    buffer.setf( std::ios::fixed, std:: ios::floatfield );
+    buffer << ",\n";
+    sample_to_jplace_string( chunk, buffer, mapper_ );
+    return buffer.str();
+  }
+
+  /**
+   * Write a serialized block at the given offset. The first block in the file
+   * must not be preceded by a separator.
+   */
+  void write_at( std::string&& block, const size_t offset, const bool first )
+  {
+    assert(unordered_);
+    if (block.empty()) {
+      return;
+    }
+    if (first) {
+      block[0] = ' ';
+      block[1] = ' ';
+    }
+
+    #ifdef __PREFETCH
+    if (prev_gather_.valid()) {
+      prev_gather_.get();
+    }
+    // the caller keeps making MPI calls while the block is written
+    if (epa_mpi_thread_level() == MPI_THREAD_MULTIPLE) {
+      prev_gather_ = std::async(std::launch::async,
+        [block = std::move(block), offset, this]() {
+          MPI_File_write_at(shared_file_, offset, block.c_str(), block.size(),
+                            MPI_CHAR, MPI_STATUS_IGNORE);
+        });
+      return;
+    }
+    #endif
+    MPI_File_write_at(shared_file_, offset, block.c_str(), block.size(),
+                      MPI_CHAR, MPI_STATUS_IGNORE);
   }
 
+  /**
+   * Total size of header and blocks, where the trailing part of the file goes.
+   */
+  void end_unordered( const size_t total_bytes )
+  {
+    end_offset_ = total_bytes;
+  }
+  #endif
+
   jplace_writer& set_precision( size_t n )
   {
     precision_ = n;
@@ -106,55 +269,28 @@ protected:
     #ifdef __MPI // ========== MPI ==============
 
     if (shared_file_) {
-      // serialize the sample
-      std::stringstream buffer;
-      buffer.precision( precision_ );
-      buffer.setf( std::ios::fixed, std:: ios::floatfield );
-      if (first_){
-        // account for the leading string
-        if (local_rank_ == 0) {
-          init_jplace_string( tree_string_, buffer );
-        }
-        first_ = false;
-      } else {
-        buffer << ",\n";
-      }
-      sample_to_jplace_string(chunk, buffer, mapper_);
-
-      // how much this rank intends to write this turn
-      const auto buffer_str = buffer.str();
-      size_t num_bytes = buffer_str.size();
-      buffer.clear();
-
-      // make the displacements known to all
-      std::vector<size_t> block_sizes( all_ranks_.size() );
-      MPI_Allgather(&num_bytes, 1, MPI_SIZE_T, block_sizes.data(), 1, MPI_SIZE_T, MPI_COMM_WORLD);
-      size_t displacement = bytes_written_; // displacement is from cur file view
-      size_t total_written = 0;
-      for (size_t i = 0; i < block_sizes.size(); ++i) {
-        if ( i < static_cast<size_t>(local_rank_) ) {
-          displacement += block_sizes[i];
-        }
-        total_written += block_sizes[i];
-      }
-
-      // write the local chunk
-      MPI_File_write_at_all(shared_file_,
-                            displacement,
-                            buffer_str.c_str(),
-                            buffer_str.size(),
-                            MPI_CHAR,
-                            MPI_STATUS_IGNORE);
-
-      bytes_written_ += total_written;
+      // every round, ranks exchange the size of their block (and whether it
+      // holds any placements, for the separators) to work out where it goes.
+      // Both that and the write itself are nonblocking, in order, such that
+      // a slow rank only holds up the others once they are max_pending_
+      // chunks ahead
+      pending_.emplace_back();
+      auto& round = pending_.back();
+      round.block = serialize(chunk);
+      round.local = {{round.block.size(), round.block.empty() ? 0u : 1u, 0u}};
+      round.all.resize(round.local.size() * num_ranks_);
+      MPI_Iallgather( round.local.data(), round.local.size(), MPI_SIZE_T,
+                      round.all.data(), round.local.size(), MPI_SIZE_T,
+                      comm_, &round.gather);
+
+      progress_(max_pending_);
     }
 
     #else // ========== NOT MPI ==============
 
-    if (file_) {
+    if (file_ and chunk.size()) {
       if (first_){
         first_ = false;
-        init_jplace_string(tree_string_, *file_);
       } else {
         *file_ << ",\n";
       }
@@ -168,17 +304,43 @@ protected:
   virtual void init_file_(const std::string& out_dir,
                           const std::string& file_name)
   {
-    const auto file_path = out_dir + file_name;
+    file_path_ = out_dir + file_name;
+    const auto& file_path = file_path_;
     #ifdef __MPI
     MPI_File_open(MPI_COMM_WORLD,
               file_path.c_str(),
               MPI_MODE_WRONLY | MPI_MODE_CREATE,
               MPI_INFO_NULL,
               &shared_file_);
+
+    // the header is the same everywhere, so everyone knows where the blocks start
+    std::stringstream header;
+    init_jplace_string( tree_string_, header );
+    const auto header_str = header.str();
+    if (local_rank_ == 0) {
+      MPI_File_write_at(shared_file_, 0, header_str.c_str(), header_str.size(),
+                        MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+    bytes_written_ = header_str.size();
+
+    if (start_.bytes) {
+      MPI_Offset size = 0;
+      MPI_File_get_size(shared_file_, &size);
+      if (start_.bytes < bytes_written_ or static_cast<size_t>(size) < start_.bytes) {
+        throw std::runtime_error{file_path + ": too short to continue from byte "
+                                + std::to_string(start_.bytes)};
+      }
+      bytes_written_ = start_.bytes;
+      blocks_written_ = start_.blocks;
+    }
     #else
     file_ = std::make_unique<std::fstream>();
-    file_->open(file_path,
-                std::fstream::in | std::fstream::out | std::fstream::trunc);
+    if (start_.bytes) {
+      file_->open(file_path, std::fstream::in | std::fstream::out);
+    } else {
+      file_->open(file_path,
+                  std::fstream::in | std::fstream::out | std::fstream::trunc);
+    }
 
     if (not file_->is_open()) {
       throw std::runtime_error{file_path + ": could not open!"};
@@ -186,41 +348,168 @@ protected:
 
     set_precision( precision_ );
 
+    if (start_.bytes) {
+      file_->seekg(0, std::ios::end);
+      if (static_cast<size_t>(file_->tellg()) < start_.bytes) {
+        throw std::runtime_error{file_path + ": too short to continue from byte "
+                                + std::to_string(start_.bytes)};
+      }
+      file_->seekp(start_.bytes);
+      first_ = (start_.blocks == 0);
+    } else {
+      init_jplace_string( tree_string_, *file_ );
+    }
+
     #endif
   }
 
   void init_mpi_()
   {
-    #ifdef __MPI // then have one outfile per rank
-    int num_ranks = 0;
+    #ifdef __MPI
     MPI_COMM_RANK(MPI_COMM_WORLD, &local_rank_);
-    MPI_COMM_SIZE(MPI_COMM_WORLD, &num_ranks);
+    MPI_COMM_SIZE(MPI_COMM_WORLD, &num_ranks_);
+    // own communicator for the size exchanges, which may be in flight at any time
+    MPI_Comm_dup(MPI_COMM_WORLD, &comm_);
+    #endif
+  }
 
-    all_ranks_.resize(num_ranks);
-    for (int i = 0; i < num_ranks; ++i) {
-      all_ranks_[i] = i;
+  #ifdef __MPI
+  struct Pending_Write
+  {
+    std::string block;
+    // size of the block, number of placement blocks in it (0 or 1), and
+    // whether the rank is out of chunks
+    std::array<size_t, 3> local;
+    std::vector<size_t> all;
+    MPI_Request gather = MPI_REQUEST_NULL;
+    MPI_Request write = MPI_REQUEST_NULL;
+    bool posted = false;
+  };
+
+  /**
+   * Posts the writes whose offsets are known (in order, as they are
+   * collective) and retires the completed ones. Blocks until no more than
+   * limit chunks are pending.
+   */
+  void progress_( const size_t limit )
+  {
+    for (auto& round : pending_) {
+      if (round.posted) {
+        continue;
+      }
+      int done = 0;
+      MPI_Test(&round.gather, &done, MPI_STATUS_IGNORE);
+      if (not done) {
+        break;
+      }
+      post_write_(round);
     }
 
-    // ensure non-rank-0 blocks start with a comma
-    if (local_rank_ != 0) {
-      first_ = false;
+    while (not pending_.empty()) {
+      auto& round = pending_.front();
+      if (pending_.size() > limit) {
+        if (not round.posted) {
+          MPI_Wait(&round.gather, MPI_STATUS_IGNORE);
+          post_write_(round);
+        }
+        MPI_Wait(&round.write, MPI_STATUS_IGNORE);
+      } else {
+        int done = 0;
+        if (round.posted) {
+          MPI_Test(&round.write, &done, MPI_STATUS_IGNORE);
+        }
+        if (not done) {
+          break;
+        }
+      }
+      pending_.pop_front();
     }
-    #endif
   }
 
+  void post_write_( Pending_Write& round )
+  {
+    const size_t stride = round.local.size();
+    size_t offset = bytes_written_;
+    size_t blocks_before = blocks_written_;
+    for (size_t i = 0; i < static_cast<size_t>(num_ranks_); ++i) {
+      if (i < static_cast<size_t>(local_rank_)) {
+        offset += round.all[i * stride];
+        blocks_before += round.all[i * stride + 1];
+      }
+      bytes_written_ += round.all[i * stride];
+      blocks_written_ += round.all[i * stride + 1];
+    }
+
+    // the first block of placements in the file must not be preceded by a separator
+    if (not round.block.empty() and blocks_before == 0) {
+      round.block[0] = ' ';
+      round.block[1] = ' ';
+    }
+
+    MPI_File_iwrite_at_all( shared_file_,
+                            offset,
+                            &round.block[0],
+                            round.block.size(),
+                            MPI_CHAR,
+                            &round.write);
+    round.posted = true;
+  }
+
+  /**
+   * Ranks may run out of chunks after different numbers of rounds. Those that
+   * are done keep taking part in (empty) rounds, until all of them are.
+   */
+  void finish_rounds_()
+  {
+    while (true) {
+      Pending_Write round;
+      round.local = {{0u, 0u, 1u}};
+      round.all.resize(round.local.size() * num_ranks_);
+      // nonblocking, to match the rounds of the ranks that are still writing
+      MPI_Iallgather( round.local.data(), round.local.size(), MPI_SIZE_T,
+                      round.all.data(), round.local.size(), MPI_SIZE_T,
+                      comm_, &round.gather);
+      MPI_Wait(&round.gather, MPI_STATUS_IGNORE);
+
+      bool all_done = true;
+      for (size_t i = 0; i < static_cast<size_t>(num_ranks_); ++i) {
+        all_done &= (round.all[i * round.local.size() + 2] == 1u);
+      }
+      if (all_done) {
+        break;
+      }
+      post_write_(round);
+      MPI_Wait(&round.write, MPI_STATUS_IGNORE);
+    }
+  }
+  #endif
+
 protected:
   std::string tree_string_;
   std::string invocation_;
   std::future<void> prev_gather_;
+  // no placements written yet (serial path)
   bool first_ = true;
   unsigned int precision_ = 6;
   rtree_mapper const mapper_;
+  Position start_;
+  std::string file_path_;
 
   #ifdef __MPI
   MPI_File shared_file_;
+  MPI_Comm comm_;
+  // where the next round of blocks goes, and how many placement blocks precede it
   size_t bytes_written_ = 0;
+  size_t blocks_written_ = 0;
+  bool unordered_ = false;
+  bool finished_ = false;
+  size_t end_offset_ = 0;
   int local_rank_ = 0;
-  std::vector<int> all_ranks_ = {0};
+  int num_ranks_ = 1;
+  // how many chunks a rank may get ahead of the slowest one before write() blocks
+  size_t max_pending_ = 4;
+  // in order of the rounds, stable references
+  std::deque<Pending_Write> pending_;
   #else
   std::unique_ptr<std::fstream> file_ = nullptr;
   #endif
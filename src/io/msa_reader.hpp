@@ -1,16 +1,36 @@
 #pragma once
 
 #include <memory>
+#include <fstream>
+#include <cstring>
 
 #include "seq/MSA_Stream.hpp"
 #include "seq/MSA_Info.hpp"
 #include "io/Binary_Fasta.hpp"
+#include "io/Fasta_Index.hpp"
 #include "io/file_io.hpp"
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
 #include "util/Options.hpp"
 #include "io/msa_reader_interface.hpp"
 
+/**
+ * Collective. Makes random access (read_range) into the given query file cheap
+ * on every rank, by having rank 0 build the byte offset index of FASTA files up
+ * front. bfast files have an offset table already.
+ */
+inline void prepare_random_access(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  char magic[MAGIC_SIZE] = {};
+  in.read(magic, MAGIC_SIZE);
+  const bool is_bfast = in and ( not std::memcmp(magic, MAGIC, MAGIC_SIZE)
+                              or not std::memcmp(magic, MAGIC_V2, MAGIC_SIZE) );
+  if (not is_bfast) {
+    Fasta_Index::shared( file_name );
+  }
+}
+
 inline auto make_msa_reader(const std::string& file_name,
                             const MSA_Info& info,
                             const bool premasking = true,
@@ -19,7 +39,7 @@ inline auto make_msa_reader(const std::string& file_name,
   std::unique_ptr<msa_reader> result(nullptr);
 
   try {
-    result = std::make_unique<Binary_Fasta_Reader>( file_name, info, premasking, split );
+    result = std::make_unique<Binary_Fasta_Mapped_Reader>( file_name, info, premasking, split );
   } catch(const std::exception& e) {
     LOG_DBG << "Failed to parse input as binary fasta (bfast), trying `fasta` instead.";
     result = std::make_unique<MSA_Stream>( file_name, info, premasking, split );
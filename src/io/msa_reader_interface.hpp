@@ -13,4 +13,11 @@ public:
   virtual size_t local_seq_offset() const = 0;
   virtual size_t read_next(MSA& result, const size_t number) = 0;
 
+  /**
+   * Random access: read the sequences [begin, begin + number) of the file,
+   * regardless of which part of the file was assigned to this rank.
+   * Not meant to be mixed with read_next.
+   */
+  virtual size_t read_range(MSA& result, const size_t begin, const size_t number) = 0;
+
 };
@@ -2,6 +2,7 @@
 #include <string>
 #include <algorithm>
 #include <chrono>
+#include <memory>
 
 #include <CLI/CLI.hpp>
 
@@ -11,8 +12,10 @@
 #include "util/stringify.hpp"
 #include "util/parse_model.hpp"
 #include "util/split.hpp"
+#include "util/topology.hpp"
 #include "io/Binary_Fasta.hpp"
 #include "io/Binary.hpp"
+#include "io/Reference_Cache.hpp"
 #include "io/file_io.hpp"
 #include "io/msa_reader.hpp"
 #include "tree/Tree.hpp"
@@ -109,6 +112,12 @@ int main(int argc, char** argv)
                   bfast_conv_file,
                   "Convert the given fasta file to bfast format."
                 )->group("Convert")->check(CLI::ExistingFile);
+  app.add_option( "--bfast-buffer",
+                  options.bfast_buffer,
+                  "Memory (in MiB) used to buffer sequences during --bfast conversion.",
+                  true
+                )->group("Convert")->check(CLI::Range(1u, 1u << 20));
+  auto dump_binary =
   app.add_flag( "-B,--dump-binary",
                   options.dump_binary_mode,
                   "Binary Dump mode: write ref. tree in binary format then exit. NOTE: not compatible with premasking!"
@@ -137,6 +146,14 @@ int main(int argc, char** argv)
                   "Path to binary reference file, as created using --dump-binary."
                 )->group("Input")->check(CLI::ExistingFile);
 
+  auto cache_dir =
+  app.add_option( "--cache-dir",
+                  options.cache_dir,
+                  "Directory of built reference trees. If it holds one built from the same tree, reference MSA, "
+                  "model and settings, that one is loaded instead of building it again. Otherwise, the newly built "
+                  "one is added to it."
+                )->group("Input")->check(CLI::ExistingDirectory)->excludes(binary_file_opt);
+
   binary_file_opt->excludes(tree_file_opt)->excludes(reference_file_opt);
   tree_file_opt->excludes(binary_file_opt);
   reference_file_opt->excludes(binary_file_opt);
@@ -204,6 +221,18 @@ int main(int argc, char** argv)
                   redo,
                   "Overwrite existing files."
                 )->group("Output");
+  auto checkpoint =
+  app.add_option( "--checkpoint",
+                  options.checkpoint_interval,
+                  "Every this many chunks, record the progress of the run and flush the partial output, "
+                  "such that an interrupted run can be continued with --resume. 0 disables checkpoints."
+                )->group("Output");
+  auto resume =
+  app.add_flag( "--resume",
+                  options.resume,
+                  "Continue an interrupted run from its last checkpoint in the output directory. "
+                  "All inputs and settings have to be the same as for the interrupted run."
+                )->group("Output");
 
   //  ============== COMPUTE OPTIONS ==============
 
@@ -241,6 +270,39 @@ int main(int argc, char** argv)
                   "Number of query sequences to be read in at a time. May influence performance.",
                   true
                 )->group("Compute");
+  auto adaptive_chunk_size =
+  app.add_flag( "--adaptive-chunk-size",
+                  options.adaptive_chunk_size,
+                  "Start with --chunk-size, then adjust the number of query sequences per chunk to the memory "
+                  "budget, the number of candidate branches of the heuristic and the measured throughput."
+                )->group("Compute");
+  app.add_option( "--min-chunk-size",
+                  options.min_chunk_size,
+                  "Lower bound of --adaptive-chunk-size.",
+                  true
+                )->group("Compute")->check(CLI::Range(1u, 1u << 30));
+  app.add_option( "--max-chunk-size",
+                  options.max_chunk_size,
+                  "Upper bound of --adaptive-chunk-size.",
+                  true
+                )->group("Compute")->check(CLI::Range(1u, 1u << 30));
+  app.add_option( "--chunk-memory",
+                  options.chunk_memory,
+                  "Memory budget of a chunk for --adaptive-chunk-size, in MiB. "
+                  "By default a quarter of the physical memory."
+                )->group("Compute");
+  // checkpoints count chunks of a fixed size
+  adaptive_chunk_size->excludes(checkpoint)->excludes(resume);
+  app.add_flag( "--pipeline",
+                  options.pipeline,
+                  "Overlap reading, prescoring, thorough placement and output of consecutive chunks, "
+                  "splitting the threads between the stages."
+                )->group("Compute");
+  app.add_flag( "--numa-bind",
+                  options.numa_bind,
+                  "Bind every MPI rank to one NUMA domain of its machine and pin its threads to that domain's cores. "
+                  "Best used with one rank per domain. Unless specified, the thread count is set to the number of bound cores."
+                )->group("Compute");
   app.add_flag( "--raxml-blo",
                   raxml_blo,
                   "Employ old style of branch length optimization during thorough insertion as opposed to sliding approach. "
@@ -250,6 +312,22 @@ int main(int argc, char** argv)
                   no_pre_mask,
                   "Do NOT pre-mask sequences. Enables repeats unless --no-repeats is also specified."
                 )->group("Compute");
+  app.add_flag( "--compress-patterns",
+                  options.compress_patterns,
+                  "Compute and store the reference CLVs and lookup tables once per site pattern "
+                  "(columns that are identical across the reference MSA) instead of once per site."
+                )->group("Compute")->excludes(binary_file_opt)->excludes(dump_binary)->excludes(cache_dir);
+  auto opt_model =
+  app.add_flag( "--opt-model",
+                  options.opt_model,
+                  "Optimize the model parameters (substitution rates, alpha) on the reference tree before placement. "
+                  "The likelihood is evaluated on all threads."
+                )->group("Compute")->excludes(binary_file_opt);
+  auto opt_ref_branches =
+  app.add_flag( "--opt-ref-branches",
+                  options.opt_branches,
+                  "Optimize the branch lengths of the reference tree before placement, starting from default lengths."
+                )->group("Compute")->excludes(binary_file_opt);
 
   std::string rate_scalers_option("auto");
   app.add_set( "--rate-scalers",
@@ -259,6 +337,20 @@ int main(int argc, char** argv)
                 true
                 )->group("Compute");
 
+  #ifdef __MPI
+  bool static_distribution = false;
+  app.add_flag( "--static-distribution",
+                  static_distribution,
+                  "Give every MPI rank a fixed, equal share of the queries, instead of handing out "
+                  "chunks to whichever rank is idle."
+                )->group("Compute");
+  app.add_flag( "--shared-memory",
+                  options.shared_memory,
+                  "Keep only one copy of the reference CLVs and lookup tables per machine, shared by all "
+                  "MPI ranks running on it."
+                )->group("Compute")->excludes(opt_model)->excludes(opt_ref_branches);
+  #endif
+
   #ifdef __OMP
   auto threads =
   app.add_option( "-T,--threads",
@@ -292,7 +384,10 @@ int main(int argc, char** argv)
   // no log file for conversion functions
   if (not bfast_conv_file.empty()) {
     LOG_INFO << "Converting given FASTA file to BFAST format...";
-    auto resultfile = Binary_Fasta::fasta_to_bfast(bfast_conv_file, work_dir);
+    if ( redo ) {
+      genesis::utils::Options::get().allow_file_overwriting( true );
+    }
+    auto resultfile = Binary_Fasta::fasta_to_bfast(bfast_conv_file, work_dir, options);
     LOG_INFO << "Resulting bfast file was written to: " << resultfile;
     exit_epa();
   }
@@ -320,7 +415,7 @@ int main(int argc, char** argv)
   log_file = work_dir + "epa_info.log";
   #endif
 
-  if ( not redo and genesis::utils::file_exists( log_file ) ) {
+  if ( not redo and not options.resume and genesis::utils::file_exists( log_file ) ) {
     throw std::runtime_error{ log_file + " already exists! To overwrite existing output files, rerun with --redo" };
   } else {
     genesis::utils::Logging::log_to_file( log_file );
@@ -350,6 +445,10 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: Binary CLV store: " << binary_file;
   }
 
+  if (not options.cache_dir.empty()) {
+    LOG_INFO << "Selected: Reference cache dir: " << options.cache_dir;
+  }
+
   if (*filter_acc_lwr)
   {
     options.acc_threshold = true;
@@ -403,6 +502,22 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: Disabling pre-masking. (repeats enabled!)";
   }
 
+  if (options.compress_patterns) {
+    LOG_INFO << "Selected: Compressing the reference into site patterns";
+    if (options.repeats) {
+      options.repeats = false;
+      LOG_INFO << "Site pattern compression replaces the site repeats";
+    }
+  }
+
+  if (options.opt_model) {
+    LOG_INFO << "Selected: Optimizing the model parameters on the reference tree";
+  }
+
+  if (options.opt_branches) {
+    LOG_INFO << "Selected: Optimizing the branch lengths of the reference tree";
+  }
+
   if (rate_scalers_option == "auto") {
     options.scaling = Options::NumericalScaling::kAuto;
     LOG_INFO << "Selected: Automatic switching of use of per rate scalers";
@@ -448,6 +563,42 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: Using threads: " << options.num_threads;
   }
   #endif
+  if (options.adaptive_chunk_size) {
+    LOG_INFO << "Selected: Adaptive chunk size between " << options.min_chunk_size
+             << " and " << options.max_chunk_size;
+    if (options.pipeline) {
+      LOG_WARN << "The pipeline reads chunks of a fixed size, ignoring --adaptive-chunk-size";
+    }
+  }
+  if (options.pipeline) {
+    LOG_INFO << "Selected: Pipelined processing of query chunks";
+  }
+  if (options.numa_bind) {
+    LOG_INFO << "Selected: Binding ranks and threads to NUMA domains";
+  }
+  if (options.checkpoint_interval) {
+    LOG_INFO << "Selected: Checkpoint every " << options.checkpoint_interval << " chunks";
+  }
+  if (options.resume) {
+    LOG_INFO << "Selected: Resuming from the last checkpoint";
+  }
+  #ifdef __MPI
+  if (static_distribution) {
+    options.dynamic_distribution = false;
+    LOG_INFO << "Selected: Static distribution of queries across MPI ranks";
+  }
+  if (options.shared_memory) {
+    LOG_INFO << "Selected: Sharing the reference between the MPI ranks of each machine";
+  }
+  if (options.dynamic_distribution and (options.checkpoint_interval or options.resume)) {
+    options.dynamic_distribution = false;
+    LOG_INFO << "Checkpoints require a static distribution of queries across MPI ranks";
+  }
+  if (options.dynamic_distribution and options.adaptive_chunk_size) {
+    options.dynamic_distribution = false;
+    LOG_INFO << "Adaptive chunk sizes require a static distribution of queries across MPI ranks";
+  }
+  #endif
 
   //================================================================
   //============    EPA    =========================================
@@ -463,6 +614,14 @@ int main(int argc, char** argv)
 
   LOG_INFO << banner << std::endl;
 
+  // bind before anything sizeable is allocated, so that the reference MSA, the
+  // CLVs and the lookup tables are first touched on the local NUMA domain
+  if (options.numa_bind) {
+    const auto binding = bind_to_numa_domain(options);
+    pin_threads(binding, options);
+    log_topology(binding, options);
+  }
+
   LOG_DBG << "Peeking into MSA files and generating masks";
 
   MSA_Info ref_info;
@@ -496,10 +655,18 @@ int main(int argc, char** argv)
   }
 
   // build the Tree
+  std::unique_ptr<Reference_Cache> cache;
+  if (not options.cache_dir.empty() and not options.load_binary_mode) {
+    cache = std::make_unique<Reference_Cache>(options.cache_dir, tree_file, ref_msa, model_desc, options);
+  }
+
   Tree tree;
   if (options.load_binary_mode) {
     LOG_INFO << "Loading from binary";
     tree = Tree(binary_file, model, options);
+  } else if (cache and cache->contains()) {
+    LOG_INFO << "Loading the reference from the cache: " << cache->file_name();
+    tree = cache->load(model, options);
   } else {
     // build the full tree with all possible clv's
     if (not *model_option) {
@@ -511,6 +678,21 @@ int main(int argc, char** argv)
       exit_epa(EXIT_FAILURE);
     }
     tree = Tree(tree_file, ref_msa, model, options);
+
+    #ifdef __MPI
+    const bool store = cache and local_rank == 0;
+    #else
+    const bool store = static_cast<bool>(cache);
+    #endif
+    if (store) {
+      LOG_INFO << "Adding the reference to the cache: " << cache->file_name();
+      // the run itself does not depend on the cache
+      try {
+        cache->store(tree);
+      } catch (const std::exception& e) {
+        LOG_WARN << "Could not add the reference to the cache: " << e.what();
+      }
+    }
   }
 
   if (not options.dump_binary_mode) {
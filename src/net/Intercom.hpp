@@ -1,5 +1,8 @@
 #pragma once
 
+#include <vector>
+#include <utility>
+
 #include "pipeline/schedule.hpp"
 #include "net/mpihead.hpp"
 #include "net/epa_mpi_util.hpp"
@@ -18,14 +21,25 @@
 class Intercom
 {
 public:
-  Intercom(const size_t num_stages)
+  /**
+   * @param fixed_nodes number of ranks a stage must always have, 0 for stages
+   *                    that may grow and shrink. Defaults to pinning the first
+   *                    stage (reading the input) to a single rank.
+   */
+  Intercom(const size_t num_stages, std::vector<unsigned int> fixed_nodes = {})
+    : fixed_nodes_(std::move(fixed_nodes))
   {
+    if (fixed_nodes_.empty()) {
+      fixed_nodes_.resize(num_stages, 0u);
+      fixed_nodes_[0] = 1u;
+    }
+
     std::vector<double> initial_difficulty(num_stages, 1.0);
     MPI_Comm_rank(MPI_COMM_WORLD, &local_rank_);
     MPI_Comm_size(MPI_COMM_WORLD, &world_size_);
 
     // get initial schedule
-    auto init_nps = solve(num_stages, world_size_, initial_difficulty);
+    auto init_nps = solve(num_stages, world_size_, initial_difficulty, fixed_nodes_);
     assign(local_rank_, init_nps, schedule_, &local_stage_);
 
     LOG_DBG << "Schedule: " << stringify(schedule_);
@@ -75,6 +89,29 @@ public:
     return stage_id == static_cast<size_t>(local_stage_);
   }
 
+  /**
+   * Number of ranks currently assigned to each stage.
+   */
+  std::vector<unsigned int> nodes_per_stage() const
+  {
+    std::vector<unsigned int> result;
+    for (const auto& stage : schedule_) {
+      result.push_back(stage.size());
+    }
+    return result;
+  }
+
+  /**
+   * Weight of a new measurement in the running average of the stage difficulty
+   * (1.0: no damping), and the relative improvement of the bottleneck stage
+   * needed before ranks are moved.
+   */
+  void damping(const double alpha, const double hysteresis)
+  {
+    alpha_ = alpha;
+    hysteresis_ = hysteresis;
+  }
+
   /**
    * Calculates, and propagates, a global pipeline schedule, based on local timing 
    * measurements. 
@@ -84,7 +121,7 @@ public:
    * @param timer local timing value used to calcuate the difficulty of a stage, and
    *              consequently the global schedule.
    */
-  void rebalance(Timer<>& timer) 
+  void rebalance(stage_timer& timer) 
   {
     MPI_BARRIER(MPI_COMM_WORLD);
     // if (local_rank == 0) 
@@ -98,10 +135,10 @@ public:
     const auto foreman = schedule_[local_stage_][0];
     const auto num_stages = schedule_.size(); 
     // Step 0: get per node average
-    Timer<> per_node_avg(timer.avg_duration());
+    stage_timer per_node_avg(timer.avg_duration());
     // Step 1: aggregate the runtime statistics, first at the lowest rank per stage
     LOG_DBG1 << "aggregate the runtime statistics...";
-    Timer<> dummy;
+    stage_timer dummy;
     epa_mpi_gather(per_node_avg, foreman, schedule_[local_stage_], local_rank_, dummy);
     LOG_DBG1 << "Runtime aggregate done!";
 
@@ -129,7 +166,6 @@ public:
     // epa_mpi_bcast(perstage_total, foreman, schedule_[local_stage_], local_rank_);
     LOG_DBG1 << "Broadcasting...";
     MPI_Comm stage_comm;
-    MPI_Comm_split(MPI_COMM_WORLD, local_stage_, local_rank_, &stage_comm);
 
     // foreman must always be rank 0 in stage communicator:
     int split_key = local_rank_ == foreman ? -1 : local_rank_;
@@ -145,10 +181,19 @@ public:
 
     LOG_DBG1 << "perstage difficulty: " << stringify(perstage_total);
 
-    auto nps = solve(num_stages, world_size_, perstage_total);
-    reassign(local_rank_, nps, schedule_, &local_stage_);
-    // Step 6: re-engage pipeline with new assignments
-    LOG_DBG1 << "New Schedule: " << stringify(nps);
+    // damping: a running average over the rebalancing rounds
+    smooth_difficulty(difficulty_, perstage_total, alpha_);
+
+    auto nps = solve(num_stages, world_size_, difficulty_, fixed_nodes_);
+
+    // hysteresis: only move ranks if it pays off noticeably
+    if (worth_reassigning(nodes_per_stage(), nps, difficulty_, hysteresis_)) {
+      reassign(local_rank_, nps, schedule_, &local_stage_);
+      // Step 6: re-engage pipeline with new assignments
+      LOG_DBG1 << "New Schedule: " << stringify(nps);
+    } else {
+      LOG_DBG1 << "Keeping the current schedule";
+    }
 
     // compute stages should try to keep their edge assignment! affinity!
     LOG_DBG << "Rebalancing done!";
@@ -184,6 +229,11 @@ private:
   schedule_type schedule_;
   previous_request_storage_t prev_requests_;
 
+  std::vector<unsigned int> fixed_nodes_;
+  std::vector<double> difficulty_;
+  double alpha_ = 0.5;
+  double hysteresis_ = 0.1;
+
 };
 
 #else
@@ -191,7 +241,7 @@ private:
 class Intercom
 {
 public:
-  Intercom(const size_t) {}
+  Intercom(const size_t, std::vector<unsigned int> = {}) {}
   Intercom() = default;
   ~Intercom()= default;
 
@@ -199,7 +249,7 @@ public:
   // auto& schedule(const size_t) { }
   // auto& previous_requests() { }
   bool stage_active(const size_t) const { return true; }
-  void rebalance(Timer<>&) { } 
+  void rebalance(stage_timer&) { } 
   void barrier() const { }
   int rank() { return 0; }
   
@@ -0,0 +1,74 @@
+#include "net/Shared_Segment.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+
+// enough for any vectorized access to the CLVs
+constexpr size_t SEGMENT_ALIGNMENT = 64;
+
+static void* align_up(void* ptr)
+{
+  const auto address = reinterpret_cast<uintptr_t>(ptr);
+  return reinterpret_cast<void*>((address + SEGMENT_ALIGNMENT - 1) & ~(SEGMENT_ALIGNMENT - 1));
+}
+
+Shared_Segment::Shared_Segment(const size_t bytes)
+  : size_(bytes)
+{
+#ifdef __MPI
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &comm_);
+  MPI_Comm_rank(comm_, &node_rank_);
+  MPI_Comm_size(comm_, &node_size_);
+
+  // one contiguous block held by the owner, so that offsets mean the same to everyone
+  MPI_Info info;
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "alloc_shared_noncontig", "false");
+
+  const MPI_Aint local_bytes = owner() ? bytes + SEGMENT_ALIGNMENT : 0;
+  const auto err = MPI_Win_allocate_shared(local_bytes, 1, info, comm_, &base_, &win_);
+  MPI_Info_free(&info);
+
+  if (err != MPI_SUCCESS) {
+    MPI_Comm_free(&comm_);
+    throw std::runtime_error{std::string("Could not allocate shared memory of size: ")
+                            + std::to_string(bytes)};
+  }
+
+  MPI_Aint owner_bytes = 0;
+  int disp_unit = 1;
+  MPI_Win_shared_query(win_, 0, &owner_bytes, &disp_unit, &base_);
+  // mappings keep the offset within the page, so everyone ends up at the same place
+  base_ = align_up(base_);
+
+  // passive target epoch for the lifetime of the segment, see barrier()
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+#else
+  memory_ = std::unique_ptr<char[]>(new char[bytes + SEGMENT_ALIGNMENT]);
+  base_ = align_up(memory_.get());
+#endif
+}
+
+Shared_Segment::~Shared_Segment()
+{
+#ifdef __MPI
+  // the segment may outlive MPI when its owner is a local in main
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  if (not finalized) {
+    MPI_Win_unlock_all(win_);
+    MPI_Win_free(&win_);
+    MPI_Comm_free(&comm_);
+  }
+#endif
+}
+
+void Shared_Segment::barrier()
+{
+#ifdef __MPI
+  MPI_Win_sync(win_);
+  MPI_Barrier(comm_);
+  MPI_Win_sync(win_);
+#endif
+}
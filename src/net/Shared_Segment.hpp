@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#ifdef __MPI
+#include <mpi.h>
+#endif
+
+/**
+ * A block of memory shared by all MPI ranks running on the same machine.
+ *
+ * Allocated as an MPI-3 shared window: the first rank of the machine (the
+ * owner) holds the memory, everyone else maps it. Writes by one rank become
+ * visible to the others after a barrier(). Without MPI this is plain heap
+ * memory, of which the single process is the owner.
+ */
+class Shared_Segment
+{
+public:
+  /**
+   * Collective over all ranks of MPI_COMM_WORLD.
+   */
+  explicit Shared_Segment(const size_t bytes);
+  Shared_Segment() = delete;
+  ~Shared_Segment();
+
+  Shared_Segment(Shared_Segment const& other) = delete;
+  Shared_Segment& operator= (Shared_Segment const& other) = delete;
+
+  void* data() { return base_; }
+  size_t size() const { return size_; }
+
+  // the owner is responsible for filling the segment
+  bool owner() const { return node_rank_ == 0; }
+  int node_rank() const { return node_rank_; }
+  int node_size() const { return node_size_; }
+
+  /**
+   * Collective over the ranks of this machine. Makes all writes to the segment
+   * done so far visible to every rank.
+   */
+  void barrier();
+
+private:
+  void* base_ = nullptr;
+  size_t size_ = 0;
+  int node_rank_ = 0;
+  int node_size_ = 1;
+
+#ifdef __MPI
+  MPI_Comm comm_;
+  MPI_Win win_;
+#else
+  std::unique_ptr<char[]> memory_;
+#endif
+};
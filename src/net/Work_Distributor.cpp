@@ -0,0 +1,211 @@
+#include "net/Work_Distributor.hpp"
+
+#ifdef __MPI
+
+#include <stdexcept>
+#include <exception>
+
+#include "net/epa_mpi_util.hpp"
+#include "util/logging.hpp"
+#include "util/Timer.hpp"
+
+Work_Distributor::Work_Distributor( const size_t num_sequences,
+                                    const size_t chunk_size,
+                                    const size_t header_bytes)
+  : num_sequences_(num_sequences)
+  , chunk_size_(chunk_size)
+{
+  if (not chunk_size) {
+    throw std::runtime_error{"Work_Distributor: chunk size must be greater than zero"};
+  }
+
+  // own communicator, so our messages never mix with anyone elses
+  MPI_Comm_dup(MPI_COMM_WORLD, &comm_);
+  MPI_Comm_rank(comm_, &local_rank_);
+  MPI_Comm_size(comm_, &num_ranks_);
+
+  num_chunks_ = (num_sequences + chunk_size - 1) / chunk_size;
+
+  // serving requests concurrently to MPI calls of the main thread requires
+  // full thread support, otherwise rank 0 does nothing but serve
+  dedicated_master_ = (num_ranks_ > 1)
+                  and (epa_mpi_thread_level() < MPI_THREAD_MULTIPLE);
+
+  if (local_rank_ == 0) {
+    offset_ = header_bytes;
+    owner_.resize(num_chunks_);
+    bytes_.resize(num_chunks_);
+    finished_.resize(num_chunks_);
+    slots_.resize(num_ranks_);
+
+    LOG_INFO << "Distributing " << num_chunks_ << " chunks dynamically over "
+             << num_ranks_ << " MPI ranks"
+             << (dedicated_master_ ? " (rank 0 is a dedicated master)" : "");
+
+    if (num_ranks_ > 1 and not dedicated_master_) {
+      server_ = std::thread(&Work_Distributor::serve_remote_, this);
+    }
+  }
+}
+
+Work_Distributor::~Work_Distributor()
+{
+  // only reachable with a running server when unwinding from an error
+  if (server_.joinable()) {
+    stop_server_();
+  }
+  MPI_Comm_free(&comm_);
+}
+
+void Work_Distributor::stop_server_()
+{
+  // nonblocking, as the server may stop on its own in the meantime, in which
+  // case we take the message back ourselves
+  Request stop;
+  stop.stop = true;
+  request_tuple pending;
+  try {
+    epa_mpi_isend_archive(stop, 0, comm_, pending);
+  } catch (const std::exception& e) {
+    LOG_ERR << "Could not stop the work server: " << e.what();
+    std::terminate();
+  }
+
+  server_.join();
+
+  int done = 0;
+  MPI_Test(&pending.req, &done, MPI_STATUS_IGNORE);
+  if (not done) {
+    stage_timer dummy;
+    epa_mpi_receive(stop, 0, comm_, dummy);
+    MPI_Wait(&pending.req, MPI_STATUS_IGNORE);
+  }
+  delete[] pending.buf;
+}
+
+Work_Distributor::Ticket Work_Distributor::next(const size_t finished_bytes,
+                                                const bool wants_chunk)
+{
+  Request request;
+  request.rank = local_rank_;
+  request.has_finished = has_current_;
+  request.chunk_id = current_;
+  request.bytes = finished_bytes;
+  request.wants_chunk = wants_chunk;
+
+  Ticket ticket;
+  if (local_rank_ == 0) {
+    if (dedicated_master_) {
+      return ticket;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    ticket = serve_(request);
+  } else {
+    epa_mpi_send(request, 0, comm_);
+    stage_timer dummy;
+    epa_mpi_receive(ticket, 0, comm_, dummy);
+  }
+
+  has_current_ = ticket.has_chunk;
+  current_ = ticket.chunk_id;
+  return ticket;
+}
+
+size_t Work_Distributor::finish(std::vector<Slot>& slots)
+{
+  // every rank is out of chunks, so every output has its slot. Those not
+  // handed out yet go to everyone, as (rank, chunk, offset, first) tuples
+  std::vector<size_t> rest;
+  if (local_rank_ == 0) {
+    if (server_.joinable()) {
+      server_.join();
+    } else if (dedicated_master_) {
+      serve_remote_();
+    }
+    for (size_t rank = 0; rank < slots_.size(); ++rank) {
+      for (auto const& slot : slots_[rank]) {
+        rest.insert(rest.end(), {rank, slot.chunk_id, slot.offset, slot.first_block});
+      }
+    }
+  }
+
+  size_t sizes[2] = {offset_, rest.size()};
+  MPI_Bcast(sizes, 2, MPI_SIZE_T, 0, comm_);
+  rest.resize(sizes[1]);
+  MPI_Bcast(rest.data(), rest.size(), MPI_SIZE_T, 0, comm_);
+
+  for (size_t i = 0; i < rest.size(); i += 4) {
+    if (rest[i] == static_cast<size_t>(local_rank_)) {
+      Slot slot;
+      slot.chunk_id = rest[i + 1];
+      slot.offset = rest[i + 2];
+      slot.first_block = rest[i + 3];
+      slots.push_back(slot);
+    }
+  }
+
+  return sizes[0];
+}
+
+Work_Distributor::Ticket Work_Distributor::serve_(const Request& request)
+{
+  if (request.has_finished) {
+    bytes_[request.chunk_id] = request.bytes;
+    finished_[request.chunk_id] = true;
+  }
+
+  // lay out the outputs in chunk order, as far as they are known
+  while (next_slot_ < num_chunks_ and finished_[next_slot_]) {
+    const auto chunk_id = next_slot_++;
+    if (bytes_[chunk_id]) {
+      Slot slot;
+      slot.chunk_id = chunk_id;
+      slot.offset = offset_;
+      slot.first_block = first_block_;
+      first_block_ = false;
+      offset_ += bytes_[chunk_id];
+      slots_[owner_[chunk_id]].push_back(slot);
+    }
+  }
+
+  Ticket ticket;
+  ticket.slots.swap(slots_[request.rank]);
+
+  if (request.wants_chunk and next_chunk_ < num_chunks_) {
+    ticket.has_chunk = true;
+    ticket.chunk_id = next_chunk_++;
+    owner_[ticket.chunk_id] = request.rank;
+  }
+
+  return ticket;
+}
+
+void Work_Distributor::serve_remote_()
+{
+  // every other rank keeps asking until it is told there is nothing left
+  size_t active = num_ranks_ - 1;
+  stage_timer dummy;
+
+  while (active) {
+    Request request;
+    epa_mpi_receive(request, MPI_ANY_SOURCE, comm_, dummy);
+
+    if (request.stop) {
+      return;
+    }
+
+    Ticket ticket;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ticket = serve_(request);
+    }
+
+    epa_mpi_send(ticket, request.rank, comm_);
+
+    if (request.wants_chunk and not ticket.has_chunk) {
+      --active;
+    }
+  }
+}
+
+#endif // __MPI
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+
+#ifdef __MPI
+#include <mpi.h>
+
+#include <thread>
+#include <mutex>
+#include <vector>
+
+/**
+ * Hands out chunks of query sequences to the MPI ranks on demand, instead of
+ * giving every rank a fixed slice of the input up front. Ranks that finish
+ * their chunks quickly simply ask for more.
+ *
+ * Rank 0 does the bookkeeping: which chunk is next, and where in the shared
+ * output file the output of each chunk goes. If the MPI library supports
+ * MPI_THREAD_MULTIPLE, rank 0 serves requests from a background thread and
+ * works on chunks itself. Otherwise it acts as a dedicated master.
+ *
+ * Every request reports the size of the output of the previous chunk. The
+ * outputs are laid out in the order of the chunks, so the write offset of a
+ * chunk is only known once all chunks before it are finished. Until then, the
+ * rank that computed it has to hold on to it: every ticket carries the write
+ * slots of those of its chunks that have become known since the last one, and
+ * finish() those that are left. A rank that holds on to too much can ask for
+ * slots only, without taking on a new chunk.
+ */
+class Work_Distributor
+{
+public:
+  struct Request
+  {
+    int rank = 0;
+    // was a chunk finished, which one, and how large is its output
+    bool has_finished = false;
+    size_t chunk_id = 0;
+    size_t bytes = 0;
+    // or does the rank only want its write slots
+    bool wants_chunk = true;
+    // only sent by rank 0 to itself, to stop its server thread
+    bool stop = false;
+
+    template <class Archive>
+    void serialize( Archive & ar )
+    { ar( rank, has_finished, chunk_id, bytes, wants_chunk, stop ); }
+  };
+
+  /**
+   * Where to write the (non-empty) output of a chunk.
+   */
+  struct Slot
+  {
+    size_t chunk_id = 0;
+    size_t offset = 0;
+    // whether that output is the first block of placements in the file
+    bool first_block = false;
+
+    template <class Archive>
+    void serialize( Archive & ar )
+    { ar( chunk_id, offset, first_block ); }
+  };
+
+  struct Ticket
+  {
+    // is there another chunk to process
+    bool has_chunk = false;
+    size_t chunk_id = 0;
+    // outputs of this rank that can be written now
+    std::vector<Slot> slots;
+
+    template <class Archive>
+    void serialize( Archive & ar )
+    { ar( has_chunk, chunk_id, slots ); }
+  };
+
+  /**
+   * Collective. The output blocks are placed after header_bytes bytes.
+   */
+  Work_Distributor( const size_t num_sequences,
+                    const size_t chunk_size,
+                    const size_t header_bytes);
+  Work_Distributor() = delete;
+  ~Work_Distributor();
+
+  Work_Distributor(Work_Distributor const& other) = delete;
+  Work_Distributor& operator= (Work_Distributor const& other) = delete;
+
+  /**
+   * Report the size of the output of the previously assigned chunk (if there
+   * was one), and get the next chunk, unless wants_chunk is false.
+   */
+  Ticket next(const size_t finished_bytes, const bool wants_chunk = true);
+
+  /**
+   * Collective. Waits for all ranks to run out of work, appends the slots of
+   * the outputs of this rank that were not handed out yet, and returns the
+   * total number of bytes of the output, including the header.
+   */
+  size_t finish(std::vector<Slot>& slots);
+
+  size_t num_chunks() const { return num_chunks_; }
+
+  size_t chunk_begin(const size_t chunk_id) const
+  {
+    return chunk_id * chunk_size_;
+  }
+
+  size_t chunk_length(const size_t chunk_id) const
+  {
+    const auto begin = chunk_begin(chunk_id);
+    return begin < num_sequences_ ? std::min(chunk_size_, num_sequences_ - begin) : 0;
+  }
+
+private:
+  Ticket serve_(const Request& request);
+  void serve_remote_();
+  void stop_server_();
+
+  MPI_Comm comm_;
+  int local_rank_ = 0;
+  int num_ranks_ = 1;
+  bool dedicated_master_ = false;
+
+  size_t num_sequences_ = 0;
+  size_t chunk_size_ = 0;
+  size_t num_chunks_ = 0;
+
+  // the chunk this rank is working on
+  bool has_current_ = false;
+  size_t current_ = 0;
+
+  // rank 0 only
+  std::mutex mutex_;
+  std::thread server_;
+  size_t next_chunk_ = 0;
+  // chunks before this one have their write offset
+  size_t next_slot_ = 0;
+  size_t offset_ = 0;
+  bool first_block_ = true;
+  std::vector<int> owner_;
+  std::vector<size_t> bytes_;
+  std::vector<bool> finished_;
+  // per rank, the slots not yet handed out
+  std::vector<std::vector<Slot>> slots_;
+};
+
+#endif // __MPI
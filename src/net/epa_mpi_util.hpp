@@ -1,20 +1,29 @@
 #pragma once
 
 #include "net/mpihead.hpp"
+#include "util/Timer.hpp"
 #include <cstddef>
 #include <utility>
 
+// time spent computing in a pipeline stage, paused while waiting for messages.
+// Per-chunk stage times are mostly below a second, hence milliseconds
+using stage_timer = Timer<std::chrono::milliseconds>;
+
 std::pair<size_t, size_t> local_seq_package( const size_t num_seqs );
 
 #ifdef __MPI
 
-#include "util/Timer.hpp"
+#include "net/flat_format.hpp"
 #include "util/logging.hpp"
 
 #include <sstream>
 #include <memory>
 #include <cstring>
 #include <unordered_map>
+#include <type_traits>
+#include <limits>
+#include <vector>
+#include <string>
 
 #include <cereal/archives/binary.hpp>
 #include <cereal/types/vector.hpp>
@@ -37,11 +46,21 @@ std::pair<size_t, size_t> local_seq_package( const size_t num_seqs );
    #error "what is happening here?"
 #endif
 
+// serialized (cereal) messages, and the two parts of a flat message (see
+// net/flat_format.hpp)
+constexpr int EPA_MPI_ARCHIVE_TAG       = 0;
+constexpr int EPA_MPI_FLAT_HEADER_TAG   = 1;
+constexpr int EPA_MPI_FLAT_PAYLOAD_TAG  = 2;
+
 // types to keep track of previous async sends
 typedef struct
 {
-  MPI_Request req;
+  MPI_Request req = MPI_REQUEST_NULL;
   char*       buf = nullptr;
+  // flat sends: the payload request, and what has to stay alive until it completes
+  MPI_Request           payload_req = MPI_REQUEST_NULL;
+  flat_header_type      header;
+  std::shared_ptr<void> obj;
 } request_tuple;
 
 using previous_request_storage_t = typename std::unordered_map<int, request_tuple>;
@@ -75,23 +94,63 @@ static void err_check(int errval)
   }
 }
 
+inline void epa_mpi_wait(request_tuple& r)
+{
+  MPI_Status status;
+  if (r.req != MPI_REQUEST_NULL) {
+    err_check(MPI_Wait(&r.req, &status));
+  }
+  if (r.payload_req != MPI_REQUEST_NULL) {
+    err_check(MPI_Wait(&r.payload_req, &status));
+  }
+  delete[] r.buf;
+  r.buf = nullptr;
+  r.obj.reset();
+}
+
 inline void epa_mpi_waitall(previous_request_storage_t& reqs)
 {
   for (auto& pair : reqs) {
-    auto& r = pair.second;
-    if (r.req) {
-      MPI_Status status;
-      err_check(MPI_Wait(&r.req, &status));
-      delete[] r.buf;
-      r.buf = nullptr;
+    epa_mpi_wait(pair.second);
+  }
+}
+
+/**
+ * Datatype covering the given blocks by their absolute address, to be used
+ * with MPI_BOTTOM as the buffer.
+ */
+inline MPI_Datatype make_flat_datatype(const flat_blocks_type& blocks)
+{
+  std::vector<int> lengths;
+  std::vector<MPI_Aint> displacements;
+  lengths.reserve(blocks.size());
+  displacements.reserve(blocks.size());
+
+  for (const auto& block : blocks) {
+    if (block.second > static_cast<size_t>(std::numeric_limits<int>::max())) {
+      throw std::runtime_error{std::string("Block too large for a flat MPI message: ")
+                              + std::to_string(block.second)};
     }
+    MPI_Aint address;
+    MPI_Get_address(block.first, &address);
+    displacements.push_back(address);
+    lengths.push_back(block.second);
   }
+
+  MPI_Datatype type;
+  err_check( MPI_Type_create_hindexed(blocks.size(),
+                                      lengths.data(),
+                                      displacements.data(),
+                                      MPI_BYTE,
+                                      &type) );
+  err_check(MPI_Type_commit(&type));
+  return type;
 }
 
 template <typename T>
-void epa_mpi_send(T& obj,
-                  const int dest_rank,
-                  const MPI_Comm comm)
+void epa_mpi_send_archive(T& obj,
+                          const int dest_rank,
+                          const MPI_Comm comm)
 {
   // serialize the obj
   std::stringstream ss;
@@ -106,31 +165,60 @@ void epa_mpi_send(T& obj,
                       data.size(),
                       MPI_CHAR,
                       dest_rank,
-                      0,
+                      EPA_MPI_ARCHIVE_TAG,
                       comm));
   delete[] buffer;
 }
 
 template <typename T>
-void epa_mpi_isend( T& obj,
-                    const int dest_rank,
-                    const MPI_Comm comm,
-                    request_tuple& prev_req,
-                    Timer<>& timer)
+void epa_mpi_send_flat( T& obj,
+                        const int dest_rank,
+                        const MPI_Comm comm)
 {
-  // wait for completion of previous send
-  if (prev_req.req) {
+  auto header = Flat_Format<T>::describe(obj);
+  err_check( MPI_Send(header.data(),
+                      header.size(),
+                      MPI_SIZE_T,
+                      dest_rank,
+                      EPA_MPI_FLAT_HEADER_TAG,
+                      comm));
 
-    MPI_Status status;
-    timer.pause();
-    LOG_DBG2 << "previous request detected, calling wait...";
-    err_check(MPI_Wait(&prev_req.req, &status));
-    LOG_DBG2 << "Done!";
-    timer.resume();
-    delete[] prev_req.buf;
-    // free previous request?
-  }
+  auto type = make_flat_datatype(Flat_Format<T>::blocks(obj));
+  err_check( MPI_Send(MPI_BOTTOM,
+                      1,
+                      type,
+                      dest_rank,
+                      EPA_MPI_FLAT_PAYLOAD_TAG,
+                      comm));
+  MPI_Type_free(&type);
+}
+
+template <typename T>
+void epa_mpi_send(T& obj, const int dest_rank, const MPI_Comm comm, std::true_type)
+{
+  epa_mpi_send_flat(obj, dest_rank, comm);
+}
 
+template <typename T>
+void epa_mpi_send(T& obj, const int dest_rank, const MPI_Comm comm, std::false_type)
+{
+  epa_mpi_send_archive(obj, dest_rank, comm);
+}
+
+template <typename T>
+void epa_mpi_send(T& obj,
+                  const int dest_rank,
+                  const MPI_Comm comm)
+{
+  epa_mpi_send(obj, dest_rank, comm, is_flat<typename std::remove_const<T>::type>());
+}
+
+template <typename T>
+void epa_mpi_isend_archive( const T& obj,
+                            const int dest_rank,
+                            const MPI_Comm comm,
+                            request_tuple& prev_req)
+{
   // serialize the obj
   std::stringstream ss;
   cereal::BinaryOutputArchive out_archive(ss);
@@ -144,25 +232,108 @@ void epa_mpi_isend( T& obj,
                         data.size(),
                         MPI_CHAR,
                         dest_rank,
-                        0,
+                        EPA_MPI_ARCHIVE_TAG,
                         comm,
                         &prev_req.req));
 
   prev_req.buf = buffer;
 }
 
+/**
+ * The object is sent directly from its own memory, so it is kept alive in the
+ * request until the send completes.
+ */
 template <typename T>
-void epa_mpi_receive( T& obj,
-                      const int src_rank,
-                      const MPI_Comm comm,
-                      Timer<>& timer)
+void epa_mpi_isend_flat(std::shared_ptr<T> obj,
+                        const int dest_rank,
+                        const MPI_Comm comm,
+                        request_tuple& prev_req)
 {
-  // probe to find out the message size
+  prev_req.header = Flat_Format<T>::describe(*obj);
+  err_check( MPI_Isend( prev_req.header.data(),
+                        prev_req.header.size(),
+                        MPI_SIZE_T,
+                        dest_rank,
+                        EPA_MPI_FLAT_HEADER_TAG,
+                        comm,
+                        &prev_req.req));
+
+  auto type = make_flat_datatype(Flat_Format<T>::blocks(*obj));
+  err_check( MPI_Issend(MPI_BOTTOM,
+                        1,
+                        type,
+                        dest_rank,
+                        EPA_MPI_FLAT_PAYLOAD_TAG,
+                        comm,
+                        &prev_req.payload_req));
+  MPI_Type_free(&type);
+
+  prev_req.obj = std::move(obj);
+}
+
+template <typename T>
+void epa_mpi_isend( T&& obj,
+                    const int dest_rank,
+                    const MPI_Comm comm,
+                    request_tuple& prev_req,
+                    std::true_type)
+{
+  using type = typename std::decay<T>::type;
+  epa_mpi_isend_flat( std::make_shared<type>(std::forward<T>(obj)),
+                      dest_rank,
+                      comm,
+                      prev_req);
+}
+
+template <typename T>
+void epa_mpi_isend( T&& obj,
+                    const int dest_rank,
+                    const MPI_Comm comm,
+                    request_tuple& prev_req,
+                    std::false_type)
+{
+  epa_mpi_isend_archive(obj, dest_rank, comm, prev_req);
+}
+
+/**
+ * Pass an rvalue to avoid copying flat objects.
+ */
+template <typename T>
+void epa_mpi_isend( T&& obj,
+                    const int dest_rank,
+                    const MPI_Comm comm,
+                    request_tuple& prev_req,
+                    stage_timer& timer)
+{
+  // wait for completion of previous send
+  if (prev_req.req != MPI_REQUEST_NULL) {
+    timer.pause();
+    LOG_DBG2 << "previous request detected, calling wait...";
+    epa_mpi_wait(prev_req);
+    LOG_DBG2 << "Done!";
+    timer.resume();
+  }
+
+  epa_mpi_isend(std::forward<T>(obj),
+                dest_rank,
+                comm,
+                prev_req,
+                is_flat<typename std::decay<T>::type>());
+}
+
+template <typename T>
+void epa_mpi_receive_archive( T& obj,
+                              const int src_rank,
+                              const MPI_Comm comm,
+                              stage_timer& timer)
+{
+  // probe to find out the message size. Flat messages from the same rank must
+  // not be mistaken for this one
   MPI_Status status;
   int size = 0;
   timer.pause();
   err_check( MPI_Probe( src_rank,
-                        MPI_ANY_TAG,
+                        EPA_MPI_ARCHIVE_TAG,
                         comm,
                         &status) );
   timer.resume();
@@ -183,7 +354,7 @@ void epa_mpi_receive( T& obj,
                       size,
                       MPI_CHAR,
                       status.MPI_SOURCE,
-                      status.MPI_TAG,
+                      EPA_MPI_ARCHIVE_TAG,
                       comm,
                       &status) );
 
@@ -202,15 +373,80 @@ void epa_mpi_receive( T& obj,
 }
 
 template <typename T>
-static inline void isend_all( const std::vector<T>& parts,
+void epa_mpi_receive_flat(T& obj,
+                          const int src_rank,
+                          const MPI_Comm comm,
+                          stage_timer& timer)
+{
+  MPI_Status status;
+  int size = 0;
+  timer.pause();
+  err_check( MPI_Probe( src_rank,
+                        EPA_MPI_FLAT_HEADER_TAG,
+                        comm,
+                        &status) );
+  timer.resume();
+  MPI_Get_count(&status, MPI_SIZE_T, &size);
+
+  // the payload has to come from whoever sent this header
+  const auto source = status.MPI_SOURCE;
+
+  flat_header_type header(size);
+  err_check( MPI_Recv(header.data(),
+                      size,
+                      MPI_SIZE_T,
+                      source,
+                      EPA_MPI_FLAT_HEADER_TAG,
+                      comm,
+                      &status) );
+
+  LOG_DBG1 << "Receiving flat data from rank " << source;
+
+  // shape the object, then receive straight into it
+  Flat_Format<T>::shape(obj, header);
+  auto type = make_flat_datatype(Flat_Format<T>::blocks(obj));
+  err_check( MPI_Recv(MPI_BOTTOM,
+                      1,
+                      type,
+                      source,
+                      EPA_MPI_FLAT_PAYLOAD_TAG,
+                      comm,
+                      &status) );
+  MPI_Type_free(&type);
+}
+
+template <typename T>
+void epa_mpi_receive(T& obj, const int src_rank, const MPI_Comm comm, stage_timer& timer, std::true_type)
+{
+  epa_mpi_receive_flat(obj, src_rank, comm, timer);
+}
+
+template <typename T>
+void epa_mpi_receive(T& obj, const int src_rank, const MPI_Comm comm, stage_timer& timer, std::false_type)
+{
+  epa_mpi_receive_archive(obj, src_rank, comm, timer);
+}
+
+template <typename T>
+void epa_mpi_receive( T& obj,
+                      const int src_rank,
+                      const MPI_Comm comm,
+                      stage_timer& timer)
+{
+  epa_mpi_receive(obj, src_rank, comm, timer, is_flat<T>());
+}
+
+template <typename T>
+static inline void isend_all( std::vector<T>& parts,
                               const std::vector<int>& dest_ranks,
                               const MPI_Comm comm,
                               previous_request_storage_t& prev_reqs,
-                              Timer<>& timer)
+                              stage_timer& timer)
 {
+  // the parts are consumed
   for (size_t i = 0; i < parts.size(); ++i) {
     auto dest = dest_ranks[i];
-    epa_mpi_isend(parts[i],
+    epa_mpi_isend(std::move(parts[i]),
                   dest,
                   comm,
                   prev_reqs[dest],
@@ -223,7 +459,7 @@ void epa_mpi_split_send(T& obj,
                         const std::vector<int>& dest_ranks,
                         const MPI_Comm comm,
                         previous_request_storage_t& prev_reqs,
-                        Timer<>& timer)
+                        stage_timer& timer)
 {
   LOG_DBG1 << "Sending...";
 
@@ -244,7 +480,7 @@ template <typename T>
 void epa_mpi_receive_merge( T& obj,
                             const std::vector<int>& src_ranks,
                             const MPI_Comm comm,
-                            Timer<>& timer)
+                            stage_timer& timer)
 {
   for (const auto rank : src_ranks) {
     T remote_obj;
@@ -261,7 +497,7 @@ void epa_mpi_gather(T& obj,
                     const int dest_rank,
                     const std::vector<int>& src_ranks,
                     const int local_rank,
-                    Timer<>& timer)
+                    stage_timer& timer)
 {
   if (local_rank == dest_rank) {
     for (const auto src_rank : src_ranks) {
@@ -289,7 +525,7 @@ void epa_mpi_bcast( T& obj,
                     const int src_rank,
                     const std::vector<int>& dest_ranks,
                     const int local_rank,
-                    Timer<>& timer)
+                    stage_timer& timer)
 {
   if (src_rank == local_rank) {
     for (auto dest_rank : dest_ranks) {
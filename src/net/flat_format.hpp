@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+
+#include "sample/Sample.hpp"
+#include "core/Work.hpp"
+#include "pipeline/Token.hpp"
+
+/**
+ * Flat wire formats for the token types that make up the bulk of the MPI
+ * traffic, such that they can be sent straight from (and received straight
+ * into) their own storage instead of going through a serialization archive.
+ *
+ * A message consists of two parts:
+ *  - a header of size_t's describing the shape of the object (counts and
+ *    lengths), and
+ *  - the payload: a list of memory blocks of the object, in an order that both
+ *    sides agree on.
+ *
+ * On the receiving side, the object is first shaped according to the header,
+ * after which the blocks it lists can be received into directly.
+ *
+ * Types without a specialization are not flat, and are sent via cereal.
+ */
+template <class T>
+struct Flat_Format;
+
+template <class T, class = void>
+struct is_flat : std::false_type {};
+
+template <class T>
+struct is_flat<T, decltype(void(sizeof(Flat_Format<T>)))> : std::true_type {};
+
+using flat_header_type = std::vector<size_t>;
+// (address, length in bytes)
+using flat_blocks_type = std::vector<std::pair<void*, size_t>>;
+
+// the blocks are written to when receiving, so strings have to be passed as
+// &str[0], as writing through str.data() is not allowed before C++17
+template <class T>
+static inline void add_block(flat_blocks_type& blocks, T* data, const size_t count)
+{
+  if (count) {
+    blocks.emplace_back(data, count * sizeof(T));
+  }
+}
+
+template <class Placement_Type>
+struct Flat_Format<Sample<Placement_Type>>
+{
+  using type = Sample<Placement_Type>;
+
+  static_assert(std::is_trivially_copyable<Placement_Type>::value,
+                "Placements must be trivially copyable to be sent as flat memory");
+
+  // layout: status, number of pqueries, newick length,
+  // then per pquery: sequence id, number of placements, header length
+  static flat_header_type describe(const type& sample)
+  {
+    flat_header_type result;
+    result.reserve(3 + 3 * sample.size());
+    result.push_back(static_cast<size_t>(sample.status()));
+    result.push_back(sample.size());
+    result.push_back(sample.newick().size());
+    for (const auto& pq : sample) {
+      result.push_back(pq.sequence_id());
+      result.push_back(pq.size());
+      result.push_back(pq.header().size());
+    }
+    return result;
+  }
+
+  static void shape(type& sample, const flat_header_type& header)
+  {
+    const size_t num_pqueries = header.at(1);
+    if (header.size() != 3 + 3 * num_pqueries) {
+      throw std::runtime_error{"Malformed flat Sample header"};
+    }
+
+    type result(std::string(header[2], '\0'));
+    result.status(static_cast<token_status>(header[0]));
+    for (size_t i = 0; i < num_pqueries; ++i) {
+      const auto entry = &header[3 + 3 * i];
+      result.emplace_back(entry[0], std::string(entry[2], '\0'));
+      result.back().resize(entry[1]);
+    }
+    sample = std::move(result);
+  }
+
+  static flat_blocks_type blocks(type& sample)
+  {
+    flat_blocks_type result;
+    for (auto& pq : sample) {
+      add_block(result, pq.data().data(), pq.size());
+      auto& header = pq.header();
+      add_block(result, &header[0], header.size());
+    }
+    auto& newick = sample.newick();
+    add_block(result, &newick[0], newick.size());
+    return result;
+  }
+};
+
+template <>
+struct Flat_Format<Work>
+{
+  using type = Work;
+
+  // layout: status, number of branches, then per branch: branch id, number of sequences
+  static flat_header_type describe(const type& work)
+  {
+    flat_header_type result{static_cast<size_t>(work.status()), 0};
+    for (auto it = work.bin_cbegin(); it != work.bin_cend(); ++it) {
+      result.push_back(it->first);
+      result.push_back(it->second.size());
+      ++result[1];
+    }
+    return result;
+  }
+
+  static void shape(type& work, const flat_header_type& header)
+  {
+    const size_t num_branches = header.at(1);
+    if (header.size() != 2 + 2 * num_branches) {
+      throw std::runtime_error{"Malformed flat Work header"};
+    }
+
+    work.clear();
+    work.status(static_cast<token_status>(header[0]));
+    for (size_t i = 0; i < num_branches; ++i) {
+      work[header[2 + 2 * i]].resize(header[3 + 2 * i]);
+    }
+  }
+
+  static flat_blocks_type blocks(type& work)
+  {
+    flat_blocks_type result;
+    for (auto it = work.bin_begin(); it != work.bin_end(); ++it) {
+      add_block(result, it->second.data(), it->second.size());
+    }
+    return result;
+  }
+};
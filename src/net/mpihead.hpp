@@ -2,7 +2,15 @@
 
 #ifdef __MPI
 #include <mpi.h>
-#define MPI_INIT(argc, argv) MPI_Init(argc, argv)
+// the level of thread support the MPI library provides, as set by MPI_INIT
+inline int& epa_mpi_thread_level()
+{
+  static int level = MPI_THREAD_SINGLE;
+  return level;
+}
+// full thread support lets rank 0 serve work requests while also computing
+// (see Work_Distributor); we make do with whatever the library provides
+#define MPI_INIT(argc, argv) MPI_Init_thread(argc, argv, MPI_THREAD_MULTIPLE, &epa_mpi_thread_level())
 #define MPI_FINALIZE() MPI_Finalize()
 #define MPI_COMM_RANK(comm, rank) MPI_Comm_rank(comm, rank)
 #define MPI_COMM_SIZE(comm, rank) MPI_Comm_size(comm, rank)
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <cstddef>
+
+/**
+ * Blocking FIFO of limited capacity, connecting two concurrently running
+ * pipeline stages. A full queue blocks the producer, an empty one the consumer,
+ * which keeps the number of chunks in flight (and thus the memory footprint)
+ * bounded.
+ */
+template <class T>
+class Bounded_Queue
+{
+public:
+  explicit Bounded_Queue(const size_t capacity = 1)
+    : capacity_(capacity ? capacity : 1)
+  { }
+
+  Bounded_Queue()   = delete;
+  ~Bounded_Queue()  = default;
+
+  Bounded_Queue(Bounded_Queue const& other) = delete;
+  Bounded_Queue& operator= (Bounded_Queue const& other) = delete;
+
+  /**
+   * Append an element, waiting for space if the queue is full.
+   * Returns false (and drops the element) if the queue was closed.
+   */
+  bool push(T&& value)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]{ return closed_ or queue_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    queue_.push_back(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /**
+   * Take the oldest element, waiting for one if the queue is empty.
+   * Returns false once the queue was closed and no elements are left.
+   */
+  bool pop(T& value)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]{ return closed_ or not queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    value = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /**
+   * Wake up everyone waiting on the queue. Subsequent pushes fail, pops only
+   * drain what is left.
+   */
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+  size_t capacity() const { return capacity_; }
+
+private:
+  const size_t capacity_;
+  bool closed_ = false;
+  std::deque<T> queue_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
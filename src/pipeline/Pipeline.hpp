@@ -6,14 +6,20 @@
 #include <type_traits>
 #include <tuple>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <chrono>
 
 #include "pipeline/Stage.hpp"
 #include "pipeline/Token.hpp"
+#include "pipeline/Bounded_Queue.hpp"
 #include "util/Timer.hpp"
 #include "net/Intercom.hpp"
 #include "pipeline/schedule.hpp"
 #include "util/function_traits.hpp"
 #include "util/template_magic.hpp"
+#include "util/logging.hpp"
 
 /**
  * Building a Stage Tuple out of a bunch of lambda functions/functors
@@ -34,13 +40,38 @@ struct stage_types
 };
 
 /**
- * Basic Pipeline Class. Runs all stages in serial.
+ * Building a tuple of queues connecting each stage to its successor
+ */
+template < class I, class StageTuple>
+struct queue_types_base;
+
+template < std::size_t... I, class StageTuple >
+struct queue_types_base<std::index_sequence<I...>, StageTuple>
+{
+  using types = typename std::tuple<
+    std::unique_ptr< Bounded_Queue< typename std::tuple_element<I, StageTuple>::type::out_type > >...
+  >;
+};
+
+template < class StageTuple >
+struct queue_types
+  : queue_types_base<std::make_index_sequence< std::tuple_size<StageTuple>::value - 1u >, StageTuple>
+{
+};
+
+/**
+ * Basic Pipeline Class. Runs all stages in serial (process), or every stage on
+ * its own thread, connected by bounded queues (process_concurrent).
  */
 template <class... lambdas>
 class Pipeline
 {
   using stack_type      = typename stage_types< lambdas... >::types;
   using token_set_type  = typename token_types< stack_type >::types;
+  using queue_set_type  = typename queue_types< stack_type >::types;
+  using busy_timer_type = Timer<std::chrono::microseconds>;
+
+  static constexpr size_t num_stages_ = std::tuple_size<stack_type>::value;
 
 public:
   using hook_type       = std::function<void()>;
@@ -53,13 +84,13 @@ public:
     , per_loop_hook_(per_loop_hook)
     , init_hook_(init_hook)
     , final_hook_(final_hook)
-    , icom_(std::tuple_size<stack_type>::value)
-  { 
-     init_pipeline_();
-  }
+  { }
 
   ~Pipeline() = default;
 
+  Pipeline(Pipeline&& other) = default;
+  Pipeline& operator= (Pipeline&& other) = default;
+
   template <class Function>
   auto push(const Function& f) const
   {
@@ -75,8 +106,14 @@ public:
     return Pipeline<lambdas..., Function>(stage_tuple, per_loop_hook_, init_hook_, final_hook_);
   }
 
+  /**
+   * Runs the stages in lockstep, one chunk at a time. Under MPI, the stages are
+   * distributed across the ranks according to the Intercom schedule.
+   */
   void process()
   {
+    init_pipeline_();
+
     token_set_type tokens;
     // "last" token that is still used on the particular MPI-Rank (or thread or...)
     Token const * last_token = nullptr;
@@ -85,7 +122,7 @@ public:
                                               , decltype(stages_)>::id();
     LOG_DBG1 << "dedicated_write: " << dedicated_write;
 
-    if (icom_.stage_active(dedicated_write)) {
+    if (icom_().stage_active(dedicated_write)) {
       init_hook_();
     }
 
@@ -111,7 +148,7 @@ public:
             LOG_DBG1 << "in_token size: " << in_token.size();
             out_token = s.process(in_token); // do the actual work
           } else {
-            LOG_DBG1 << std::to_string(icom_.rank()) << " received end token. Terminating.";
+            LOG_DBG1 << std::to_string(icom_().rank()) << " received end token. Terminating.";
             out_token.is_last(true);
           }
 
@@ -135,7 +172,7 @@ public:
       if (rebalance_on_(chunk_num)) {
         // do the kansas city shuffle...
         // calculate new schedule
-        icom_.rebalance(elapsed_time_);
+        icom_().rebalance(elapsed_time_);
 
         init_pipeline_();
 
@@ -150,15 +187,187 @@ public:
       ++chunk_num;
     } while (last_token->valid()); //returns valid if data token or default initialized
 
-    if (icom_.stage_active(dedicated_write)) {
+    if (icom_().stage_active(dedicated_write)) {
       final_hook_();
     }
 
-    icom_.barrier();
+    icom_().barrier();
+  }
+
+  /**
+   * Shared memory mode: every stage runs on its own thread, handing its tokens
+   * to the next stage through a queue holding at most queue_capacity tokens.
+   * This way, stage i can work on chunk N while stage i-1 already works on
+   * chunk N+1. Per-stage utilisation is logged at the end.
+   *
+   * Stages may spawn their own OpenMP teams; the number of threads of each team
+   * is set per stage (OpenMP ICVs are per thread).
+   *
+   * Does not communicate via MPI: every rank runs its own, complete pipeline.
+   * The last stage runs on the calling thread, so that it may make MPI calls
+   * (such as collective writes) as long as that is the only thread to do so.
+   */
+  void process_concurrent(const size_t queue_capacity = 1)
+  {
+    queue_set_type queues;
+    for_each(queues, [queue_capacity](auto& q) {
+      using queue_type = typename std::remove_reference_t<decltype(q)>::element_type;
+      q = std::make_unique<queue_type>(queue_capacity);
+    });
+
+    std::vector<busy_timer_type> busy(num_stages_);
+    std::vector<std::thread> threads;
+    threads.reserve(num_stages_);
+    Stage_Error error;
+
+    init_hook_();
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    launch_(std::make_index_sequence<num_stages_ - 1u>{}, queues, busy, error, threads);
+    run_stage_<num_stages_ - 1u>(queues, busy.back(), error);
+
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    if (error.exception) {
+      std::rethrow_exception(error.exception);
+    }
+
+    final_hook_();
+
+    const double wall = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    for (size_t i = 0; i < num_stages_; ++i) {
+      const double utilisation = wall > 0.0 ? 100.0 * busy[i].sum() / wall : 0.0;
+      LOG_INFO << "Pipeline stage " << i << ": busy " << busy[i].sum() / 1e6
+               << "s of " << wall / 1e6 << "s (" << utilisation << "%)";
+    }
   }
 
 private:
 
+  /**
+   * First exception thrown by any of the stage threads
+   */
+  struct Stage_Error
+  {
+    std::mutex mutex;
+    std::exception_ptr exception;
+  };
+
+  template <size_t... I>
+  void launch_( std::index_sequence<I...>,
+                queue_set_type& queues,
+                std::vector<busy_timer_type>& busy,
+                Stage_Error& error,
+                std::vector<std::thread>& threads)
+  {
+    (void) std::initializer_list<int>{
+      (threads.emplace_back(&Pipeline::run_stage_<I>, this, std::ref(queues), std::ref(busy[I]), std::ref(error)), 0)...
+    };
+  }
+
+  template <size_t I>
+  void run_stage_(queue_set_type& queues, busy_timer_type& busy, Stage_Error& error)
+  {
+    using stage_type  = std::tuple_element_t<I, stack_type>;
+    using in_type     = typename stage_type::in_type;
+    using out_type    = typename stage_type::out_type;
+
+    const auto& stage = std::get<I>(stages_);
+
+    try {
+      while (true) {
+        in_type in_token;
+        if (not fetch_<I>(std::integral_constant<bool, I == 0>{}, queues, in_token)) {
+          break;
+        }
+
+        out_type out_token;
+        if (in_token.valid()) {
+          busy.start();
+          out_token = stage.process(in_token);
+          busy.stop();
+        } else {
+          out_token.is_last(true);
+        }
+
+        if (I != 0) {
+          // carry over the token status
+          out_token.status(in_token.status());
+        }
+
+        const bool last = not out_token.valid();
+
+        if (not deliver_<I>(std::integral_constant<bool, I == num_stages_ - 1u>{}, queues, std::move(out_token))) {
+          break;
+        }
+
+        if (last) {
+          break;
+        }
+      }
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(error.mutex);
+        if (not error.exception) {
+          error.exception = std::current_exception();
+        }
+      }
+      // unblock everyone else
+      for_each(queues, [](auto& q) {
+        q->close();
+      });
+    }
+  }
+
+  /**
+   * The first stage has no predecessor: its input is a default token, produced
+   * once per loop.
+   */
+  template <size_t I, class T>
+  bool fetch_(std::true_type, queue_set_type&, T&)
+  {
+    per_loop_hook_();
+    return true;
+  }
+
+  template <size_t I, class T>
+  bool fetch_(std::false_type, queue_set_type& queues, T& token)
+  {
+    return std::get<I - 1u>(queues)->pop(token);
+  }
+
+  /**
+   * The last stage has no successor, its output is discarded.
+   */
+  template <size_t I, class T>
+  bool deliver_(std::true_type, queue_set_type&, T&&)
+  {
+    return true;
+  }
+
+  template <size_t I, class T>
+  bool deliver_(std::false_type, queue_set_type& queues, T&& token)
+  {
+    return std::get<I>(queues)->push(std::move(token));
+  }
+
+  /**
+   * The MPI schedule is only needed by the distributed pipeline, and only built
+   * when it is first used, as it requires at least as many ranks as stages.
+   */
+  Intercom& icom_()
+  {
+    if (not icom_ptr_) {
+      icom_ptr_ = std::make_unique<Intercom>(num_stages_);
+    }
+    return *icom_ptr_;
+  }
+
   void init_pipeline_()
   {
     // reassign the local per-stage execution status
@@ -182,7 +391,7 @@ private:
   void assign_exec_status_()
   {
     for_each(stages_, [&](auto& s) {
-      s.exec(icom_.stage_active(s.id()));
+      s.exec(icom_().stage_active(s.id()));
     });
   }
 
@@ -219,9 +428,9 @@ private:
           put = std::bind(
             epa_mpi_split_send<put_arg_t>, 
             _1, 
-            std::ref(icom_.schedule(dst)), 
+            std::ref(icom_().schedule(dst)), 
             MPI_COMM_WORLD,
-            std::ref(icom_.previous_requests()),
+            std::ref(icom_().previous_requests()),
             std::ref(elapsed_time_)
           );
         }
@@ -230,7 +439,7 @@ private:
           accept = std::bind(
             epa_mpi_receive_merge<accept_arg_t>, 
             _1, 
-            std::ref(icom_.schedule(src)),
+            std::ref(icom_().schedule(src)),
             MPI_COMM_WORLD,
             // std::ref(icom_.previous_requests()),
             std::ref(elapsed_time_)
@@ -248,8 +457,8 @@ private:
   hook_type per_loop_hook_;
   hook_type init_hook_;
   hook_type final_hook_;
-  Intercom icom_;
-  Timer<> elapsed_time_;
+  std::unique_ptr<Intercom> icom_ptr_;
+  stage_timer elapsed_time_;
 
   size_t next_rebalance_chunk_ = 3;
   size_t rebalance_delta_ = next_rebalance_chunk_;
@@ -7,9 +7,16 @@
 #include <algorithm>
 #include <iterator>
 #include <vector>
+#include <limits>
 
 void to_difficulty(std::vector<double>& perstage_avg)
 {
+  // stages that took no measurable time at all would otherwise blow up the ratios
+  constexpr double min_time = 1e-9;
+  for (auto& x : perstage_avg) {
+    x = std::max(x, min_time);
+  }
+
   auto min = *std::min_element(perstage_avg.begin(), perstage_avg.end());
   for_each(perstage_avg.begin(), perstage_avg.end(), 
     [min](double& x){x /= min;}
@@ -18,46 +25,135 @@ void to_difficulty(std::vector<double>& perstage_avg)
 
 std::vector<unsigned int> solve(unsigned int stages, 
                                 unsigned int nodes, 
-                                const std::vector<double>& difficulty_per_stage)
+                                const std::vector<double>& difficulty_per_stage,
+                                const std::vector<unsigned int>& fixed_nodes)
 {
   assert(difficulty_per_stage.size() == stages);
+  assert(fixed_nodes.empty() or fixed_nodes.size() == stages);
   if (nodes < stages) {
     throw std::runtime_error{"Must have more or equal number of nodes than stages"};
   }
 
-  std::vector<unsigned int> nodes_per_stage(stages);
-
-  // TODO for the record the following is ugly and I hate it
-  auto constrained_begin = std::begin(difficulty_per_stage);
-  // std::advance(constrained_begin, 1);
-  auto constrained_end = std::end(difficulty_per_stage);
-  // std::advance(constrained_end, -1);
-  
-  auto x1 = std::accumulate(constrained_begin, constrained_end, 0.0);
-  x1 = static_cast<double>(nodes) / x1;
+  std::vector<unsigned int> nodes_per_stage(stages, 0);
 
+  // the pinned stages take what they need first
+  unsigned int free_nodes = nodes;
+  std::vector<size_t> free_stages;
   for (size_t i = 0; i < stages; ++i) {
-    if (i == 0 or i == stages - 1) {
-      nodes_per_stage[i] = 1;
+    const auto fixed = fixed_nodes.empty() ? 0u : fixed_nodes[i];
+    if (fixed) {
+      if (fixed > free_nodes) {
+        throw std::runtime_error{"More nodes pinned to stages than available"};
+      }
+      nodes_per_stage[i] = fixed;
+      free_nodes -= fixed;
     } else {
-      nodes_per_stage[i] = ceil(difficulty_per_stage[i] * x1);
+      free_stages.push_back(i);
     }
   }
 
-  int off_by = 0;
+  if (free_stages.empty()) {
+    if (free_nodes) {
+      throw std::runtime_error{"All stages are pinned, but not all nodes are used"};
+    }
+    return nodes_per_stage;
+  }
+
+  if (free_nodes < free_stages.size()) {
+    throw std::runtime_error{"Not enough nodes left to give every stage at least one"};
+  }
+
+  double total = 0.0;
+  for (const auto i : free_stages) {
+    total += std::max(difficulty_per_stage[i], 0.0);
+  }
+
+  // the quota every stage would get if nodes were divisible
+  std::vector<double> quota(stages, 0.0);
+  for (const auto i : free_stages) {
+    quota[i] = (total > 0.0)
+             ? free_nodes * std::max(difficulty_per_stage[i], 0.0) / total
+             : static_cast<double>(free_nodes) / free_stages.size();
+  }
+
+  unsigned int assigned = 0;
+  for (const auto i : free_stages) {
+    nodes_per_stage[i] = std::max(1u, static_cast<unsigned int>(std::floor(quota[i])));
+    assigned += nodes_per_stage[i];
+  }
 
-  while ( (off_by = std::accumulate(nodes_per_stage.begin(), nodes_per_stage.end(), 0) - nodes) ) {
-    auto max_stage = std::max_element(nodes_per_stage.begin(), nodes_per_stage.end());
-    if (off_by < 0) {
-      *max_stage += 1;
+  // largest remainder: hand out what is left to the stages furthest below their
+  // quota, or take back from those furthest above it. Ties go to the lower
+  // stage index, so every rank comes to the same result.
+  while (assigned != free_nodes) {
+    const bool add = assigned < free_nodes;
+    size_t best = stages;
+    double best_diff = 0.0;
+    for (const auto i : free_stages) {
+      if (not add and nodes_per_stage[i] <= 1) {
+        continue;
+      }
+      const double diff = add
+                        ? quota[i] - nodes_per_stage[i]
+                        : nodes_per_stage[i] - quota[i];
+      if (best == stages or diff > best_diff) {
+        best = i;
+        best_diff = diff;
+      }
+    }
+    assert(best < stages);
+    if (add) {
+      ++nodes_per_stage[best];
+      ++assigned;
     } else {
-      *max_stage -= 1;
+      --nodes_per_stage[best];
+      --assigned;
     }
   }
 
   return nodes_per_stage;
 }
 
+void smooth_difficulty( std::vector<double>& smoothed,
+                        const std::vector<double>& measured,
+                        const double alpha)
+{
+  if (smoothed.size() != measured.size()) {
+    smoothed = measured;
+    return;
+  }
+  for (size_t i = 0; i < smoothed.size(); ++i) {
+    smoothed[i] = alpha * measured[i] + (1.0 - alpha) * smoothed[i];
+  }
+}
+
+double bottleneck(const std::vector<unsigned int>& nodes_per_stage,
+                  const std::vector<double>& difficulty_per_stage)
+{
+  assert(nodes_per_stage.size() == difficulty_per_stage.size());
+  double result = 0.0;
+  for (size_t i = 0; i < nodes_per_stage.size(); ++i) {
+    const double time = nodes_per_stage[i]
+                      ? difficulty_per_stage[i] / nodes_per_stage[i]
+                      : std::numeric_limits<double>::infinity();
+    result = std::max(result, time);
+  }
+  return result;
+}
+
+bool worth_reassigning( const std::vector<unsigned int>& current,
+                        const std::vector<unsigned int>& proposed,
+                        const std::vector<double>& difficulty_per_stage,
+                        const double threshold)
+{
+  if (current == proposed) {
+    return false;
+  }
+  const auto current_time = bottleneck(current, difficulty_per_stage);
+  const auto proposed_time = bottleneck(proposed, difficulty_per_stage);
+  return proposed_time < (1.0 - threshold) * current_time;
+}
+
 void assign(const int local_rank,
             std::vector<unsigned int>& nodes_per_stage, 
             schedule_type& rank_assignm,
@@ -6,9 +6,42 @@
 using schedule_type = std::vector<std::vector<int>>;
 
 void to_difficulty(std::vector<double>& perstage_avg);
+
+/**
+ * Distribute nodes across stages in proportion to their difficulty (largest
+ * remainder method), such that every stage gets at least one node.
+ *
+ * Stages with a nonzero entry in fixed_nodes get exactly that many nodes
+ * instead, regardless of their difficulty.
+ */
 std::vector<unsigned int> solve(unsigned int stages, 
                                 unsigned int nodes, 
-                                const std::vector<double>& difficulty_per_stage);
+                                const std::vector<double>& difficulty_per_stage,
+                                const std::vector<unsigned int>& fixed_nodes = {});
+
+/**
+ * Exponential moving average of the measured difficulties, so single noisy
+ * measurements don't throw the schedule around. alpha is the weight of the new
+ * measurement. An empty smoothed vector is initialized with the measurement.
+ */
+void smooth_difficulty( std::vector<double>& smoothed,
+                        const std::vector<double>& measured,
+                        const double alpha);
+
+/**
+ * Expected time per chunk of the slowest stage under the given assignment.
+ */
+double bottleneck(const std::vector<unsigned int>& nodes_per_stage,
+                  const std::vector<double>& difficulty_per_stage);
+
+/**
+ * Hysteresis: only move nodes around if that is expected to speed up the
+ * bottleneck stage by more than the given fraction.
+ */
+bool worth_reassigning( const std::vector<unsigned int>& current,
+                        const std::vector<unsigned int>& proposed,
+                        const std::vector<double>& difficulty_per_stage,
+                        const double threshold);
 void assign(const int local_rank,
             std::vector<unsigned int>& nodes_per_stage, 
             schedule_type& rank_assignm,
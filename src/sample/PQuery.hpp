@@ -61,6 +61,7 @@ public:
   inline seqid_type sequence_id() const { return sequence_id_; }
   inline void sequence_id(const seqid_type seq_id) { sequence_id_ = seq_id; }
   const std::string& header() const { return header_; }
+  std::string& header() { return header_; }
   size_t size() const { return placements_.size(); }
 
   // manipulators
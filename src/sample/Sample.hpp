@@ -54,12 +54,20 @@ public:
   Sample(const std::string newick) 
     : newick_(newick) 
   { }
+
+  Sample(Sample const& other) = default;
+  Sample(Sample && other) = default;
+
+  Sample& operator=(Sample const&) = default;
+  Sample& operator=(Sample &&) = default;
+
   ~Sample() = default;
 
   // member access
   value_type& back() { return pquerys_.back(); }
   unsigned int size() const { return pquerys_.size(); }
   const std::string& newick() const { return newick_; }
+  std::string& newick() { return newick_; }
   void clear() { pquerys_.clear(); }
   void push_back(value_type&& pq) { pquerys_.push_back(pq); }
   void push_back(value_type& pq) { pquerys_.push_back(pq); }
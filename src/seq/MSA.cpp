@@ -20,6 +20,19 @@ void MSA::append(const std::string& header, const std::string& sequence)
   }
 }
 
+void MSA::append(std::string&& header, std::string&& sequence)
+{
+  if(num_sites_ && sequence.length() != num_sites_) {
+    throw std::runtime_error{std::string("Tried to insert sequence to MSA of unequal length: ") + header};
+  }
+
+  if (!num_sites_) {
+    num_sites_ = sequence.length();
+  }
+
+  sequence_list_.emplace_back(std::move(header), std::move(sequence));
+}
+
 void std::swap(MSA& a, MSA& b)
 {
   MSA::swap(a, b);
@@ -16,8 +16,15 @@ public:
   MSA() : num_sites_(0) {};
   ~MSA() = default;
 
+  MSA(MSA const& other) = default;
+  MSA(MSA && other) = default;
+
+  MSA& operator=(MSA const&) = default;
+  MSA& operator=(MSA &&) = default;
+
   void move_sequences(iterator begin, iterator end);
   void append(const std::string& header, const std::string& sequence);
+  void append(std::string&& header, std::string&& sequence);
   void erase(iterator begin, iterator end) {sequence_list_.erase(begin, end);}
   void clear() {sequence_list_.clear();}
 
@@ -4,6 +4,7 @@
 
 #include "util/logging.hpp"
 #include "net/epa_mpi_util.hpp"
+#include "io/Fasta_Index.hpp"
 
 static void read_chunk( MSA_Stream::file_type& iter,
                         const MSA_Info& info,
@@ -41,17 +42,23 @@ static void read_chunk( MSA_Stream::file_type& iter,
   num_read += prefetch_buffer.size();
 }
 
+static genesis::sequence::FastaReader reader_settings()
+{
+  genesis::sequence::FastaReader settings;
+  // ensure sequences are uniformly upper case
+  settings.site_casing( genesis::sequence::FastaReader::SiteCasing::kToUpper );
+  return settings;
+}
+
 MSA_Stream::MSA_Stream( const std::string& msa_file,
                         const MSA_Info& info,
                         const bool premasking,
                         const bool split)
   : info_(info)
+  , file_name_(msa_file)
   , premasking_(premasking)
 {
-  genesis::sequence::FastaReader reader_settings;
-  // ensure sequences are uniformly upper case
-  reader_settings.site_casing( genesis::sequence::FastaReader::SiteCasing::kToUpper );
-  iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_file( msa_file ), reader_settings );
+  iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_file( msa_file ), reader_settings() );
 
   if (!iter_) {
     throw std::runtime_error{std::string("Cannot open file: ") + msa_file};
@@ -64,6 +71,9 @@ MSA_Stream::MSA_Stream( const std::string& msa_file,
     // get info about to which sequence to skip to and how much this rank should read
     std::tie(local_seq_offset_, max_read_) = local_seq_package( info.sequences() );
 
+    // collective: rank 0 builds the byte offset index if it doesn't exist yet
+    index_ = Fasta_Index::shared( msa_file );
+
     skip_to_sequence( local_seq_offset_ );
   }
   #else
@@ -107,6 +117,51 @@ size_t MSA_Stream::read_next( MSA_Stream::container_type& result,
   return result.size();
 }
 
+size_t MSA_Stream::read_range( MSA_Stream::container_type& result,
+                               const size_t begin,
+                               const size_t number)
+{
+#ifdef __PREFETCH
+  if (prefetcher_.valid()) {
+    prefetcher_.wait();
+  }
+#endif
+
+  result.clear();
+  if (begin >= num_sequences()) {
+    return 0;
+  }
+
+  if (range_pos_ == std::numeric_limits<size_t>::max()) {
+    range_pos_ = local_seq_offset_ + num_read_;
+    // jumping around the file is only cheap with a byte offset index
+    if (index_.size() != num_sequences()) {
+      index_ = Fasta_Index::load_or_build( file_name_ );
+    }
+  }
+
+  if (begin != range_pos_) {
+    if ( index_.size() == num_sequences() ) {
+      open_at_( index_.offset(begin) );
+    } else {
+      // no index (gzipped input): parse our way there
+      if (begin < range_pos_) {
+        iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_file( file_name_ ), reader_settings() );
+        stream_.reset();
+        range_pos_ = 0;
+      }
+      std::advance(iter_, begin - range_pos_);
+    }
+    range_pos_ = begin;
+  }
+
+  size_t num_read = 0;
+  read_chunk(iter_, info_, premasking_, number, result, number, num_read);
+  range_pos_ += num_read;
+
+  return result.size();
+}
+
 MSA_Stream::~MSA_Stream()
 {
 #ifdef __PREFETCH
@@ -140,8 +195,35 @@ void MSA_Stream::skip_to_sequence(const size_t n)
     throw std::runtime_error{"Trying to skip behind!"};
   }
 
+  // seek directly to the record if we have a usable byte offset index
+  if ( index_.size() == num_sequences() ) {
+    if ( n > 0 ) {
+      open_at_( index_.offset(n) );
+    }
+    return;
+  }
+
+  LOG_DBG << "No usable FASTA index, skipping to sequence " << n << " by parsing.";
+
   size_t offset = n - num_read_;
 
   std::advance(iter_, offset);
 
 }
+
+void MSA_Stream::open_at_(const uint64_t byte_offset)
+{
+  auto stream = std::make_unique<std::ifstream>( file_name_, std::ios::binary );
+  if ( not *stream ) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name_};
+  }
+  stream->seekg( byte_offset, std::ios::beg );
+
+  // replace the iterator first, so the old stream is no longer referenced when we drop it
+  iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_stream( *stream ), reader_settings() );
+  stream_ = std::move( stream );
+
+  if (!iter_) {
+    throw std::runtime_error{std::string("Failed to seek in file: ") + file_name_};
+  }
+}
@@ -5,6 +5,7 @@
 #include <stdexcept>
 #include <memory>
 #include <limits>
+#include <fstream>
 
 #ifdef __PREFETCH
 #include <future>
@@ -13,6 +14,7 @@
 #include "seq/MSA.hpp"
 #include "seq/MSA_Info.hpp"
 #include "io/msa_reader_interface.hpp"
+#include "io/Fasta_Index.hpp"
 
 #include "genesis/sequence/formats/fasta_input_iterator.hpp"
 
@@ -36,14 +38,20 @@ public:
   MSA_Stream& operator= (MSA_Stream && other) = default;
 
   size_t read_next(container_type& result, const size_t number) override;
+  size_t read_range(container_type& result, const size_t begin, const size_t number) override;
   size_t num_sequences() const override { return info_.sequences(); }
   size_t local_seq_offset() const override { return local_seq_offset_; }
 
 private:
   void skip_to_sequence(const size_t);
+  void open_at_(const uint64_t byte_offset);
 
 private:
   MSA_Info info_;
+  std::string file_name_;
+  Fasta_Index index_;
+  // owns the stream that iter_ reads from, if we opened the file at an offset
+  std::unique_ptr<std::ifstream> stream_;
   file_type iter_;
   // container_type active_chunk_;
   container_type prefetch_chunk_;
@@ -54,5 +62,7 @@ private:
   size_t num_read_ = 0;
   size_t max_read_ = std::numeric_limits<size_t>::max();
   size_t local_seq_offset_ = 0;
+  // sequence the iterator points to, once random access is used
+  size_t range_pos_ = std::numeric_limits<size_t>::max();
   bool first_ = true;
 };
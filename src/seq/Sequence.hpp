@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 
 class Sequence
 {
@@ -9,9 +10,9 @@ public:
   Sequence()  = default;
   ~Sequence() = default;
   Sequence(std::string header, std::string sequence) 
-    : sequence_(sequence) 
+    : sequence_(std::move(sequence))
   {
-    header_.push_back(header);
+    header_.push_back(std::move(header));
   }
   Sequence(const Sequence& s) = default;
   Sequence(Sequence&& s)      = default;
@@ -0,0 +1,40 @@
+#include "seq/Site_Patterns.hpp"
+
+#include <string>
+#include <unordered_map>
+
+Site_Patterns::Site_Patterns(const MSA& msa)
+  : site_to_pattern_(msa.num_sites())
+{
+  std::unordered_map<std::string, unsigned int> patterns;
+  std::string column(msa.size(), '-');
+
+  for (size_t site = 0; site < msa.num_sites(); ++site) {
+    for (size_t i = 0; i < msa.size(); ++i) {
+      column[i] = msa[i].sequence()[site];
+    }
+
+    const auto next_id = static_cast<unsigned int>(weights_.size());
+    const auto entry = patterns.emplace(column, next_id);
+    if (entry.second) {
+      weights_.push_back(0);
+      representatives_.push_back(site);
+    }
+    const auto pattern = entry.first->second;
+    site_to_pattern_[site] = pattern;
+    ++weights_[pattern];
+  }
+}
+
+MSA Site_Patterns::compress(const MSA& msa) const
+{
+  MSA result(num_patterns());
+  for (const auto& s : msa) {
+    std::string sequence(num_patterns(), '-');
+    for (size_t pattern = 0; pattern < num_patterns(); ++pattern) {
+      sequence[pattern] = s.sequence()[ representatives_[pattern] ];
+    }
+    result.append(s.header(), sequence);
+  }
+  return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "seq/MSA.hpp"
+
+/**
+ * Maps the sites of an alignment to its site patterns: sets of columns that are
+ * identical across all of its sequences. Each pattern is represented by the
+ * first column that has it, and weighted by the number of columns that do.
+ *
+ * Meant for the reference alignment, such that its CLVs only have to be stored
+ * and computed once per pattern. The queries still differ between the columns
+ * of a pattern, so anything involving them needs the map back to the sites.
+ */
+class Site_Patterns
+{
+public:
+  Site_Patterns() = default;
+  explicit Site_Patterns(const MSA& msa);
+  ~Site_Patterns() = default;
+
+  /**
+   * The alignment with only the first column of each pattern.
+   */
+  MSA compress(const MSA& msa) const;
+
+  size_t num_sites() const { return site_to_pattern_.size(); }
+  size_t num_patterns() const { return weights_.size(); }
+
+  unsigned int operator[](const size_t site) const { return site_to_pattern_[site]; }
+  const std::vector<unsigned int>& map() const { return site_to_pattern_; }
+  const std::vector<unsigned int>& weights() const { return weights_; }
+
+  explicit operator bool() const { return not site_to_pattern_.empty(); }
+
+private:
+  std::vector<unsigned int> site_to_pattern_;
+  // number of sites per pattern
+  std::vector<unsigned int> weights_;
+  // first site of each pattern
+  std::vector<size_t> representatives_;
+};
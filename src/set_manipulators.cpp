@@ -45,11 +45,6 @@ void merge(Work& dest, const Work& src)
   }
 }
 
-void merge(Timer<>& dest, const Timer<>& src)
-{
-  dest.insert(dest.end(), src.begin(), src.end());
-}
-
 void compute_and_set_lwr(Sample<Placement>& sample)
 {
   #ifdef __OMP
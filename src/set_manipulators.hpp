@@ -15,7 +15,12 @@ using pq_citer_t  = PQuery<Placement>::const_iterator;
 using pq_iter_t   = PQuery<Placement>::iterator;
 
 void merge(Work& dest, const Work& src);
-void merge(Timer<>& dest, const Timer<>& src);
+
+template <class duration>
+void merge(Timer<duration>& dest, const Timer<duration>& src)
+{
+  dest.insert(dest.end(), src.begin(), src.end());
+}
 
 void sort_by_lwr(PQuery<Placement>& pq);
 void sort_by_logl(PQuery<Placement>& pq);
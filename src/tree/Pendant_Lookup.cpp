@@ -0,0 +1,136 @@
+#include "tree/Pendant_Lookup.hpp"
+
+#include <stdexcept>
+
+#include "core/raxml/Model.hpp"
+
+constexpr size_t NUM_CHARS = 256;
+
+bool Pendant_Lookup::supported(pll_partition_t const * const partition)
+{
+  // per-site CLVs with one set of eigenvectors, and a sumtable that is not
+  // rescaled per rate category
+  return (partition->rate_matrices == 1)
+     and not (partition->attributes & PLL_ATTRIB_SITE_REPEATS)
+     and not (partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+     and not (partition->attributes & PLL_ATTRIB_AB_FLAG);
+}
+
+Pendant_Lookup::Pendant_Lookup( pll_partition_t const * const partition,
+                                const unsigned int clv_index)
+  : span_(partition->rate_cats * partition->states_padded)
+  , states_(partition->states)
+  , states_padded_(partition->states_padded)
+{
+  if (not supported(partition)) {
+    throw std::runtime_error{"Pendant lookup is not supported for this partition"};
+  }
+  if (clv_index < partition->tips) {
+    throw std::runtime_error{"Pendant lookup needs an inner CLV"};
+  }
+
+  const size_t sites  = partition->sites;
+  const size_t states = partition->states;
+  const size_t rate_cats = partition->rate_cats;
+  const double * freqs = partition->frequencies[0];
+  const double * eigenvecs = partition->eigenvecs[0];
+  const double * inv_eigenvecs = partition->inv_eigenvecs[0];
+  const double * clv = partition->clv[clv_index];
+
+  left_.assign(states * states_padded_, 0.0);
+  for (size_t k = 0; k < states; ++k) {
+    for (size_t j = 0; j < states; ++j) {
+      left_[k * states_padded_ + j] = freqs[k] * eigenvecs[k * states_padded_ + j];
+    }
+  }
+
+  clv_terms_.assign(sites * span_, 0.0);
+  for (size_t n = 0; n < sites; ++n) {
+    for (size_t r = 0; r < rate_cats; ++r) {
+      const auto site_clv = clv + n * span_ + r * states_padded_;
+      auto terms = &clv_terms_[n * span_ + r * states_padded_];
+      for (size_t j = 0; j < states; ++j) {
+        double lefterm = 0.0;
+        for (size_t k = 0; k < states; ++k) {
+          lefterm += site_clv[k] * left_[k * states_padded_ + j];
+        }
+        terms[j] = lefterm;
+      }
+    }
+  }
+
+  // characters that map to no state are rejected when setting the tip states
+  const auto map = get_char_map(partition);
+  char_terms_.assign(NUM_CHARS * states_padded_, 0.0);
+  for (size_t c = 0; c < NUM_CHARS; ++c) {
+    const auto state = map[c];
+    auto terms = &char_terms_[c * states_padded_];
+    for (size_t j = 0; j < states; ++j) {
+      double righterm = 0.0;
+      for (size_t k = 0; k < states; ++k) {
+        if ((state >> k) & 1) {
+          righterm += inv_eigenvecs[j * states_padded_ + k];
+        }
+      }
+      terms[j] = righterm;
+    }
+  }
+
+  sumtable_.reset(pll_aligned_alloc(sites * span_ * sizeof(double), partition->alignment));
+  if (not sumtable_) {
+    throw std::runtime_error{"Cannot allocate memory for the pendant sumtable"};
+  }
+}
+
+void Pendant_Lookup::query(const std::string& sequence, const Range& range)
+{
+  begin_ = range.begin;
+  query_terms_.resize(range.span);
+  for (size_t n = 0; n < range.span; ++n) {
+    const auto c = static_cast<unsigned char>(sequence[range.begin + n]);
+    query_terms_[n] = &char_terms_[c * states_padded_];
+  }
+}
+
+double * Pendant_Lookup::sumtable()
+{
+  auto sumtable = static_cast<double*>(sumtable_.get());
+
+  for (size_t n = 0; n < query_terms_.size(); ++n) {
+    const auto chars = query_terms_[n];
+    const auto terms = &clv_terms_[(begin_ + n) * span_];
+    auto sum = sumtable + n * span_;
+    for (size_t r = 0; r < span_; r += states_padded_) {
+      for (size_t j = 0; j < states_padded_; ++j) {
+        sum[r + j] = terms[r + j] * chars[j];
+      }
+    }
+  }
+
+  return sumtable;
+}
+
+double * Pendant_Lookup::sumtable(double const * const clv)
+{
+  auto sumtable = static_cast<double*>(sumtable_.get());
+
+  for (size_t n = 0; n < query_terms_.size(); ++n) {
+    const auto chars = query_terms_[n];
+    for (size_t r = 0; r < span_; r += states_padded_) {
+      const auto site_clv = clv + n * span_ + r;
+      auto sum = sumtable + n * span_ + r;
+      for (size_t j = 0; j < states_; ++j) {
+        double lefterm = 0.0;
+        for (size_t k = 0; k < states_; ++k) {
+          lefterm += site_clv[k] * left_[k * states_padded_ + j];
+        }
+        sum[j] = lefterm * chars[j];
+      }
+      for (size_t j = states_; j < states_padded_; ++j) {
+        sum[j] = 0.0;
+      }
+    }
+  }
+
+  return sumtable;
+}
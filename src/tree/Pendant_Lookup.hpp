@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "core/pll/pllhead.hpp"
+#include "tree/tiny_util.hpp"
+#include "util/Range.hpp"
+
+/**
+ * Per-site terms of the pendant branch of a tiny tree, for a fixed CLV at its
+ * inner node.
+ *
+ * The sumtable of a branch is the product of a term of the CLV on either side,
+ * each projected onto the eigenvectors of the model. For the pendant branch, the
+ * inner side is the same for every query, and the tip side only depends on the
+ * character at each site. Both are computed once, such that the sumtable for a
+ * query (and with it the likelihood derivatives in the pendant length) is a
+ * single product per site and state, without touching the CLVs.
+ *
+ * Once the query slides along the branch, the inner CLV changes, but its tip
+ * does not: the sumtable then only needs the inner side to be projected.
+ */
+class Pendant_Lookup
+{
+public:
+  Pendant_Lookup() = default;
+  Pendant_Lookup(pll_partition_t const * const partition, const unsigned int clv_index);
+  ~Pendant_Lookup() = default;
+
+  Pendant_Lookup(Pendant_Lookup const& other) = delete;
+  Pendant_Lookup(Pendant_Lookup&& other) = default;
+
+  Pendant_Lookup& operator= (Pendant_Lookup const& other) = delete;
+  Pendant_Lookup& operator= (Pendant_Lookup && other) = default;
+
+  operator bool() const { return not clv_terms_.empty(); }
+
+  // wether the sumtable of the partition is laid out such that the lookup applies
+  static bool supported(pll_partition_t const * const partition);
+
+  /**
+   * Sets the query whose pendant sumtables are computed next, over the given
+   * range of its sequence.
+   */
+  void query(const std::string& sequence, const Range& range);
+
+  /**
+   * Fills the pendant sumtable of the query for the inner CLV of the lookup
+   * and returns it. Its sites start at the beginning of the range of the query,
+   * as in a partition focused on that range. The buffer is reused by the next
+   * call.
+   */
+  double * sumtable();
+
+  /**
+   * Same, for another inner CLV, given focused on the range of the query.
+   */
+  double * sumtable(double const * const clv);
+
+private:
+  // rate categories times padded states, the size of one site
+  size_t span_ = 0;
+  size_t states_ = 0;
+  size_t states_padded_ = 0;
+  // the frequencies times the left eigenvectors, per state
+  std::vector<double> left_;
+  // per site and rate: the inner CLV projected onto the left eigenvectors
+  std::vector<double> clv_terms_;
+  // per character: its tip CLV projected onto the right eigenvectors
+  std::vector<double> char_terms_;
+  // the query: where its sites start, and the character terms of each site
+  size_t begin_ = 0;
+  std::vector<double const *> query_terms_;
+  aligned_buffer sumtable_ = aligned_buffer(nullptr, pll_aligned_free);
+};
@@ -9,6 +9,7 @@
 
 #include "tree/tiny_util.hpp"
 #include "core/pll/pll_util.hpp"
+#include "core/pll/kernels.hpp"
 #include "core/pll/optimize.hpp"
 #include "core/raxml/Model.hpp"
 #include "tree/Tree_Numbers.hpp"
@@ -43,14 +44,14 @@ static void precompute_sites_static(char nt,
     };
   }
 
-  pll_compute_edge_loglikelihood( partition,
-                                  new_tip->clv_index,
-                                  PLL_SCALE_BUFFER_NONE,
-                                  inner->clv_index,
-                                  inner->scaler_index,
-                                  inner->pmatrix_index,
-                                  &param_indices[0],
-                                  &result[0]);
+  kernel_edge_loglikelihood(partition,
+                            new_tip->clv_index,
+                            PLL_SCALE_BUFFER_NONE,
+                            inner->clv_index,
+                            inner->scaler_index,
+                            inner->pmatrix_index,
+                            &param_indices[0],
+                            &result[0]);
 }
 
 
@@ -66,6 +67,7 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
   , premasking_(options.premasking)
   , sliding_blo_(options.sliding_blo)
   , branch_id_(branch_id)
+  , num_sites_(reference_tree.num_sites())
   , lookup_(lookup_store)
 {
   assert(edge_node);
@@ -97,7 +99,9 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
                                                     tree_.get(),
                                                     old_proximal,
                                                     old_distal,
-                                                    tip_tip_case),
+                                                    tip_tip_case,
+                                                    // the lookup tables are per pattern
+                                                    opt_branches ? &expanded_ : nullptr),
                                 tiny_partition_destroy);
 
   // operation for computing the clv toward the new tip (for initialization and logl in non-blo case)
@@ -128,12 +132,18 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
                             3);
 
   // use update_partials to compute the clv pointing toward the new tip
-  pll_update_partials(partition_.get(), &op, 1);
+  kernel_update_partials(partition_.get(), &op, 1);
+
+  // every placement starts the pendant optimization from this CLV, see place
+  if (opt_branches and sliding_blo_ and Pendant_Lookup::supported(partition_.get())) {
+    pendant_ = Pendant_Lookup(partition_.get(), inner->clv_index);
+  }
 
   if (not opt_branches) {
     const std::lock_guard<std::mutex> lock(lookup_store->get_mutex(branch_id));
 
-    if (not lookup_store->has_branch(branch_id)) {
+    // with shared lookups, only one rank per machine computes them
+    if (lookup_store->claim_branch(branch_id)) {
       const auto size = lookup_store->char_map_size();
 
       // precompute all possible site likelihoods
@@ -164,11 +174,11 @@ Placement Tiny_Tree::place(const Sequence &s)
   double logl = 0.0;
   std::vector<unsigned int> param_indices(partition_->rate_cats, 0);
 
-  if ( s.sequence().size() != partition_->sites ) {
+  if ( s.sequence().size() != num_sites_ ) {
     throw std::runtime_error{"Query sequence length not same as reference alignment!"};
   }
 
-  Range range(0, partition_->sites);
+  Range range(0, num_sites_);
 
   if (premasking_) {
     range = get_valid_range(s.sequence());
@@ -182,22 +192,41 @@ Placement Tiny_Tree::place(const Sequence &s)
 
     auto virtual_root = inner;
 
-    // init the new tip with s.sequence(), branch length
-    auto err_check = pll_set_tip_states(partition_.get(),
-                                        new_tip->clv_index,
-                                        get_char_map(partition_.get()),
-                                        s.sequence().c_str());
+    // the pendant sumtables straight from the lookup, as the CLVs are reset after each placement
+    Pendant_Lookup * pendant = nullptr;
+    if (pendant_) {
+      pendant_.query(s.sequence(), range);
+      pendant = &pendant_;
+    }
+
+    // init the new tip with s.sequence(), from the given site on
+    auto set_new_tip = [&](const size_t begin) {
+      auto err_check = pll_set_tip_states(partition_.get(),
+                                          new_tip->clv_index,
+                                          get_char_map(partition_.get()),
+                                          s.sequence().c_str() + begin);
 
-    if (err_check == PLL_FAILURE) {
-      throw std::runtime_error{"Set tip states during placement failed!"};
+      if (err_check == PLL_FAILURE) {
+        throw std::runtime_error{"Set tip states during placement failed!"};
+      }
+    };
+
+    // site repeats of the new tip are computed over all sites
+    const bool repeats = partition_->attributes & PLL_ATTRIB_SITE_REPEATS;
+    if (repeats) {
+      set_new_tip(0);
     }
 
-    if (premasking_){
-      logl = call_focused(optimize_branch_triplet, range, partition_.get(), virtual_root, sliding_blo_);
-    } else {
-      logl = optimize_branch_triplet(partition_.get(), virtual_root, sliding_blo_);
+    // everything from here on only concerns the sites of the (premasked) range:
+    // those outside of it are never read, and so never have to be reset either
+    Partition_Focus focus(partition_.get(), range);
+
+    if (not repeats) {
+      set_new_tip(range.begin);
     }
 
+    logl = optimize_branch_triplet(partition_.get(), virtual_root, sliding_blo_, pendant);
+
     assert(inner->length >= 0);
     assert(inner->next->length >= 0);
     assert(inner->next->next->length >= 0);
@@ -226,7 +255,7 @@ Placement Tiny_Tree::place(const Sequence &s)
     op.child2_scaler_index = child2->scaler_index;
     op.child2_matrix_index = child2->pmatrix_index;
 
-    pll_update_partials(partition_.get(), &op, 1);
+    kernel_update_partials(partition_.get(), &op, 1);
 
   } else {
     logl = lookup_->sum_precomputed_sitelk(branch_id_, s.sequence(), range);
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "core/pll/pllhead.hpp"
 #include "seq/Sequence.hpp"
@@ -11,6 +12,8 @@
 #include "tree/Tree.hpp"
 #include "core/pll/pll_util.hpp"
 #include "core/Lookup_Store.hpp"
+#include "tree/tiny_util.hpp"
+#include "tree/Pendant_Lookup.hpp"
 
 /* Encapsulates a smallest possible unrooted tree (3 tip nodes, 1 inner node)
   for use in edge insertion:
@@ -51,15 +54,22 @@ public:
   Placement place(const Sequence& s);
 
 private:
+  // reference CLVs expanded from site patterns, used by the partition
+  std::vector<aligned_buffer> expanded_;
+
   // pll structures
   std::unique_ptr<pll_partition_t, partition_deleter> partition_;
   std::unique_ptr<pll_utree_t, utree_deleter> tree_;
 
+  // pendant sumtable terms for the thorough sliding optimization
+  Pendant_Lookup pendant_;
+
   bool opt_branches_;
   double original_branch_length_;
   bool premasking_ = true;
   bool sliding_blo_;
   unsigned int branch_id_;
+  size_t num_sites_;
 
   std::shared_ptr<Lookup_Store> lookup_;
 
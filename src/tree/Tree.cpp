@@ -3,6 +3,9 @@
 #include <stdexcept>
 #include <iostream>
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
 
 #include "core/pll/epa_pll_util.hpp"
 #include "io/file_io.hpp"
@@ -11,6 +14,7 @@
 #include "set_manipulators.hpp"
 #include "util/logging.hpp"
 #include "util/stringify.hpp"
+#include "util/Timer.hpp"
 
 Tree::Tree( const std::string &tree_file,
             const MSA &msa,
@@ -35,6 +39,16 @@ Tree::Tree( const std::string &tree_file,
       ref_msa_.size() << " vs. " << nums_.tip_nodes;
   }
 
+  if (options_.compress_patterns) {
+    if (options_.repeats) {
+      throw std::runtime_error{"Site pattern compression cannot be combined with site repeats"};
+    }
+    patterns_ = Site_Patterns(ref_msa_);
+    ref_msa_ = patterns_.compress(ref_msa_);
+    LOG_INFO << "Compressed the " << patterns_.num_sites() << " reference sites into "
+             << patterns_.num_patterns() << " site patterns";
+  }
+
   partition_ = partition_ptr( make_partition( model_,
                                               nums_,
                                               ref_msa_.num_sites(),
@@ -43,24 +57,94 @@ Tree::Tree( const std::string &tree_file,
 
   locks_ = Mutex_List(partition_->tips + partition_->clv_buffers);
 
-  link_tree_msa(tree_.get(),
-                partition_.get(),
-                model_,
-                ref_msa_,
-                nums_.tip_nodes);
+  if (patterns_) {
+    pll_set_pattern_weights(partition_.get(), patterns_.weights().data());
+  }
+
+  if (options_.shared_memory) {
+    share_buffers_();
+  }
+
+  // with shared buffers, only the owner writes them and everyone else waits
+  const bool writer = not shared_ or shared_->owner();
+
+  if (writer) {
+    link_tree_msa(tree_.get(),
+                  partition_.get(),
+                  model_,
+                  ref_msa_,
+                  nums_.tip_nodes);
+  }
+  if (shared_) {
+    shared_->barrier();
+  }
+  if (not writer) {
+    link_tree_msa(tree_.get(),
+                  partition_.get(),
+                  model_,
+                  ref_msa_,
+                  nums_.tip_nodes,
+                  false);
+  }
 
   set_unique_clv_indices(get_root(tree_.get()), nums_.tip_nodes);
 
+  if (options_.opt_model or options_.opt_branches) {
+    if (shared_) {
+      throw std::runtime_error{"Optimizing the reference cannot be combined with shared memory"};
+    }
+    Timer<std::chrono::milliseconds> optimize_time;
+    optimize_time.start();
+    optimize( model_,
+              tree_.get(),
+              partition_.get(),
+              nums_,
+              options_.opt_branches,
+              options_.opt_model,
+              options_.num_threads);
+    optimize_time.stop();
+    LOG_INFO << "Optimized the reference in " << optimize_time.seconds() << "s";
+  }
+
   LOG_DBG << model_;
   LOG_DBG << "Tree length: " << sum_branch_lengths(tree_.get());
 
-  precompute_clvs(tree_.get(), partition_.get(), nums_);
+  // everyone needs the pmatrices, only the writer the CLVs
+  Timer<std::chrono::milliseconds> precompute_time;
+  precompute_time.start();
+  precompute_clvs(tree_.get(), partition_.get(), nums_, writer, options_.num_threads);
+  precompute_time.stop();
+  LOG_INFO << "Precomputed the reference CLVs in " << precompute_time.seconds() << "s";
+  if (shared_) {
+    shared_->barrier();
+  }
+
+  if (patterns_) {
+    expand_site_arrays_();
+  }
 
   LOG_DBG << "Reference tree log-likelihood: "
           << std::to_string(this->ref_tree_logl());
 
 }
 
+/**
+  Per-site arrays for partitions that span all sites of a compressed reference:
+  weights of one, and which sites are invariant, taken from their pattern.
+*/
+void Tree::expand_site_arrays_()
+{
+  const auto num_sites = patterns_.num_sites();
+  site_weights_.assign(num_sites, 1u);
+
+  if (partition_->invariant) {
+    site_invariant_.resize(num_sites);
+    for (size_t site = 0; site < num_sites; ++site) {
+      site_invariant_[site] = partition_->invariant[ patterns_[site] ];
+    }
+  }
+}
+
 /**
   Constructs the structures from binary file.
 */
@@ -77,6 +161,11 @@ Tree::Tree( const std::string& bin_file,
   tree_ = utree_ptr(binary_.load_utree(partition_->tips), utree_destroy);
   locks_ = Mutex_List(partition_->tips + partition_->clv_buffers);
 
+  if (options_.shared_memory) {
+    share_buffers_();
+    load_shared_();
+  }
+
   raxml::assign(model_, partition_.get());
   LOG_DBG << model_;
   LOG_DBG << "Tree length: " << sum_branch_lengths(tree_.get());
@@ -84,6 +173,164 @@ Tree::Tree( const std::string& bin_file,
         << std::to_string(this->ref_tree_logl());
 }
 
+Tree::~Tree()
+{
+  release_shared_();
+}
+
+Tree& Tree::operator= (Tree && other)
+{
+  if (this == &other) {
+    return *this;
+  }
+
+  // detach the shared buffers before the old partition is destroyed, and
+  // unmap them only after
+  release_shared_();
+
+  partition_      = std::move(other.partition_);
+  tree_           = std::move(other.tree_);
+  nums_           = std::move(other.nums_);
+  ref_msa_        = std::move(other.ref_msa_);
+  model_          = std::move(other.model_);
+  options_        = std::move(other.options_);
+  binary_         = std::move(other.binary_);
+  mapper_         = std::move(other.mapper_);
+  patterns_       = std::move(other.patterns_);
+  site_weights_   = std::move(other.site_weights_);
+  site_invariant_ = std::move(other.site_invariant_);
+  locks_          = std::move(other.locks_);
+  shared_         = std::move(other.shared_);
+
+  return *this;
+}
+
+void Tree::release_shared_()
+{
+  // the shared buffers are not ours to free
+  if (shared_ and partition_) {
+    const auto num_clvs = partition_->tips + partition_->clv_buffers;
+    for (size_t i = 0; i < num_clvs; ++i) {
+      partition_->clv[i] = nullptr;
+    }
+    if (partition_->attributes & PLL_ATTRIB_PATTERN_TIP) {
+      for (size_t i = 0; i < partition_->tips; ++i) {
+        partition_->tipchars[i] = nullptr;
+      }
+    }
+    for (size_t i = 0; i < partition_->scale_buffers; ++i) {
+      partition_->scale_buffer[i] = nullptr;
+    }
+  }
+}
+
+static size_t align_size(const size_t size, const size_t alignment)
+{
+  return alignment ? ((size + alignment - 1) / alignment) * alignment : size;
+}
+
+/**
+  Replaces the CLV, tipchar and scaler buffers of the partition with ones in
+  memory shared by all ranks on this machine, such that the reference only
+  takes up memory once per machine. Only the owner of the segment may write to
+  the buffers.
+*/
+void Tree::share_buffers_()
+{
+  auto partition = partition_.get();
+
+  if (partition->attributes & PLL_ATTRIB_SITE_REPEATS) {
+    // repeats resize the CLVs as they are computed, there is no fixed layout
+    LOG_WARN << "Sharing the reference across ranks is not supported with site repeats, "
+             << "every rank keeps its own copy.";
+    return;
+  }
+
+  const bool use_tipchars = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+  const size_t alignment = std::max<size_t>(partition->alignment, sizeof(double));
+  const size_t num_clvs = partition->tips + partition->clv_buffers;
+  const size_t sites_alloc = partition->sites + partition->asc_additional_sites;
+  const size_t scaler_size = (partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+                            ? sites_alloc * partition->rate_cats : sites_alloc;
+
+  // lay out all buffers in one segment
+  std::vector<size_t> offsets;
+  size_t total = 0;
+  for (size_t i = 0; i < num_clvs; ++i) {
+    offsets.push_back(total);
+    total += (use_tipchars and i < partition->tips)
+            ? align_size(sites_alloc, alignment)
+            : align_size(pll_get_clv_size(partition, i) * sizeof(double), alignment);
+  }
+  for (size_t i = 0; i < partition->scale_buffers; ++i) {
+    offsets.push_back(total);
+    total += align_size(scaler_size * sizeof(unsigned int), alignment);
+  }
+
+  shared_ = std::make_unique<Shared_Segment>(total);
+  auto base = static_cast<char*>(shared_->data());
+
+  for (size_t i = 0; i < num_clvs; ++i) {
+    if (use_tipchars and i < partition->tips) {
+      pll_aligned_free(partition->tipchars[i]);
+      partition->tipchars[i] = reinterpret_cast<unsigned char*>(base + offsets[i]);
+    } else {
+      pll_aligned_free(partition->clv[i]);
+      partition->clv[i] = reinterpret_cast<double*>(base + offsets[i]);
+    }
+  }
+  for (size_t i = 0; i < partition->scale_buffers; ++i) {
+    free(partition->scale_buffer[i]);
+    partition->scale_buffer[i] = reinterpret_cast<unsigned int*>(base + offsets[num_clvs + i]);
+  }
+
+  LOG_DBG << "Sharing " << total / (1024 * 1024) << " MB of reference buffers between "
+          << shared_->node_size() << " ranks";
+}
+
+/**
+  Fills the shared buffers from the binary file, all at once instead of on demand.
+*/
+void Tree::load_shared_()
+{
+  if (not shared_) {
+    return;
+  }
+
+  auto partition = partition_.get();
+
+  if (shared_->owner()) {
+    const bool use_tipchars = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+    const size_t sites_alloc = partition->sites + partition->asc_additional_sites;
+    const size_t scaler_size = (partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+                              ? sites_alloc * partition->rate_cats : sites_alloc;
+
+    for (size_t i = 0; i < partition->tips + partition->clv_buffers; ++i) {
+      if (use_tipchars and i < partition->tips) {
+        // these get loaded into newly allocated memory, so copy them over
+        auto dest = partition->tipchars[i];
+        partition->tipchars[i] = nullptr;
+        binary_.load_tipchars(partition, i);
+        std::memcpy(dest, partition->tipchars[i], sites_alloc);
+        free(partition->tipchars[i]);
+        partition->tipchars[i] = dest;
+      } else {
+        binary_.load_clv(partition, i);
+      }
+    }
+    for (size_t i = 0; i < partition->scale_buffers; ++i) {
+      auto dest = partition->scale_buffer[i];
+      partition->scale_buffer[i] = nullptr;
+      binary_.load_scaler(partition, i);
+      std::memcpy(dest, partition->scale_buffer[i], scaler_size * sizeof(unsigned int));
+      free(partition->scale_buffer[i]);
+      partition->scale_buffer[i] = dest;
+    }
+  }
+
+  shared_->barrier();
+}
+
 /**
   Returns a pointer either to the CLV or tipchar buffer, depending on the index.
   If they are not currently in memory, fetches them from file.
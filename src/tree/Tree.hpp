@@ -5,10 +5,12 @@
 #include <memory>
 
 #include "seq/MSA.hpp"
+#include "seq/Site_Patterns.hpp"
 #include "core/raxml/Model.hpp"
 #include "tree/Tree_Numbers.hpp"
 #include "util/Options.hpp"
 #include "io/Binary.hpp"
+#include "net/Shared_Segment.hpp"
 #include "core/pll/pllhead.hpp"
 #include "core/pll/pll_util.hpp"
 #include "core/pll/rtree_mapper.hpp"
@@ -30,13 +32,13 @@ public:
         raxml::Model &model,
         const Options& options);
   Tree()  = default;
-  ~Tree() = default;
+  ~Tree();
 
   Tree(Tree const& other) = delete;
   Tree(Tree&& other)      = default;
 
   Tree& operator= (Tree const& other) = delete;
-  Tree& operator= (Tree && other)     = default;
+  Tree& operator= (Tree && other);
 
   // member access
   Tree_Numbers& nums() { return nums_; }
@@ -45,12 +47,25 @@ public:
   auto partition() { return partition_.get(); }
   auto tree() { return tree_.get(); }
   rtree_mapper& mapper() { return mapper_; }
+  const Site_Patterns& patterns() const { return patterns_; }
+
+  // sites of the alignment, as opposed to the partition, which may hold patterns
+  size_t num_sites() const { return patterns_ ? patterns_.num_sites() : partition_->sites; }
+
+  // unit weights for all sites, and the invariant sites, in case of compressed patterns
+  unsigned int * site_weights() { return site_weights_.data(); }
+  int * site_invariant() { return site_invariant_.empty() ? nullptr : site_invariant_.data(); }
 
   void * get_clv(const pll_unode_t*);
 
   double ref_tree_logl();
 
 private:
+  void share_buffers_();
+  void load_shared_();
+  void release_shared_();
+  void expand_site_arrays_();
+
   // pll structures
 
   partition_ptr partition_{nullptr, pll_partition_destroy};
@@ -65,8 +80,14 @@ private:
   Options options_;
   Binary binary_;
   rtree_mapper mapper_;
+  Site_Patterns patterns_;
+  std::vector<unsigned int> site_weights_;
+  std::vector<int> site_invariant_;
 
   // thread safety
   Mutex_List locks_;
 
+  // CLVs, tipchars and scalers shared with the other ranks on this machine
+  std::unique_ptr<Shared_Segment> shared_;
+
 };
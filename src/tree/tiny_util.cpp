@@ -1,6 +1,7 @@
 #include "tree/tiny_util.hpp"
 
-#include <type_traits>
+#include <algorithm>
+#include <stdexcept>
 
 #include "core/pll/pll_util.hpp"
 
@@ -10,46 +11,82 @@ constexpr unsigned int inner_clv_index            = 3;
 constexpr unsigned int new_tip_clv_index          = 1;
 constexpr unsigned int distal_clv_index_if_tip    = 2;
 constexpr unsigned int distal_clv_index_if_inner  = 5;
-
-template <class T,
-          typename = typename std::enable_if<std::is_pointer<T>::value>::type>
-static void alloc_and_copy(T& dest, const T src, const size_t size)
+constexpr unsigned int proximal_scaler_index      = 0;
+constexpr unsigned int inner_scaler_index         = 1;
+constexpr unsigned int distal_scaler_index        = 2;
+
+/**
+  Copies the per-site entries of a buffer of the compressed reference partition
+  to every site of the pattern they stand for.
+*/
+template <class T>
+static void expand_sites( T * const dest,
+                          T const * const src,
+                          const size_t span,
+                          Site_Patterns const& patterns)
 {
-  using base_t = std::remove_pointer_t<decltype(src)>;
-
-  if (dest != nullptr) {
-    free(dest);
+  for (size_t site = 0; site < patterns.num_sites(); ++site) {
+    std::copy_n(src + patterns[site] * span, span, dest + site * span);
   }
+}
 
-  dest = static_cast<T>(calloc(size, sizeof(base_t)));
+template <class T>
+static T * make_expanded(T const * const src,
+                         const size_t span,
+                         pll_partition_t const * const dest_part,
+                         Site_Patterns const& patterns,
+                         std::vector<aligned_buffer>& expanded)
+{
+  const auto sites_alloc = dest_part->sites + dest_part->asc_additional_sites;
+  auto dest = static_cast<T*>(pll_aligned_alloc(sites_alloc * span * sizeof(T),
+                                                dest_part->alignment));
+  if (not dest) {
+    throw std::runtime_error{"Cannot allocate memory for the expanded reference CLVs"};
+  }
+  expanded.emplace_back(dest, pll_aligned_free);
 
-  memcpy( dest,
-          src,
-          size * sizeof(base_t));
+  expand_sites(dest, src, span, patterns);
+  return dest;
 }
 
-static void deep_copy_scaler( pll_partition_t* dest_part,
-                              pll_unode_t* dest_node,
-                              pll_partition_t const * const src_part,
-                              pll_unode_t const * const src_node)
+/**
+  Points the scaler of a CLV-tip of the tiny partition to the one of the reference,
+  or to an expanded copy of it. Only the inner node of a tiny tree is ever updated,
+  so the buffers of the reference are never written to.
+*/
+static void share_scaler( pll_partition_t* dest_part,
+                          const unsigned int dest_scaler_index,
+                          pll_partition_t const * const src_part,
+                          pll_unode_t const * const src_node,
+                          Site_Patterns const * const patterns,
+                          std::vector<aligned_buffer> * expanded)
 {
+  free(dest_part->scale_buffer[dest_scaler_index]);
+  dest_part->scale_buffer[dest_scaler_index] = nullptr;
+
   if (src_node->scaler_index != PLL_SCALE_BUFFER_NONE
     and src_part->scale_buffer[src_node->scaler_index] != nullptr) {
 
-    const auto sites_alloc = src_part->asc_additional_sites + src_part->sites;
-    const auto scaler_size  = (src_part->attributes & PLL_ATTRIB_RATE_SCALERS)
-                            ? sites_alloc * src_part->rate_cats : sites_alloc;
+    const auto scaler = src_part->scale_buffer[src_node->scaler_index];
 
-    alloc_and_copy( dest_part->scale_buffer[dest_node->scaler_index],
-                    src_part->scale_buffer[src_node->scaler_index],
-                    scaler_size);
+    if (patterns) {
+      const size_t span = (src_part->attributes & PLL_ATTRIB_RATE_SCALERS)
+                        ? src_part->rate_cats : 1u;
+      dest_part->scale_buffer[dest_scaler_index]
+        = make_expanded(scaler, span, dest_part, *patterns, *expanded);
+    } else {
+      dest_part->scale_buffer[dest_scaler_index] = scaler;
+    }
   }
 }
 
-static void deep_copy_repeats(pll_partition_t* dest_part,
-                              pll_unode_t* dest_node,
-                              pll_partition_t const * const src_part,
-                              pll_unode_t const * const src_node)
+/**
+  Same for the site repeat maps of a CLV-tip.
+*/
+static void share_repeats(pll_partition_t* dest_part,
+                          pll_unode_t* dest_node,
+                          pll_partition_t const * const src_part,
+                          pll_unode_t const * const src_node)
 {
   // copy size info
   if (src_node->scaler_index != PLL_SCALE_BUFFER_NONE) {
@@ -62,27 +99,20 @@ static void deep_copy_repeats(pll_partition_t* dest_part,
   dest_part->repeats->pernode_allocated_clvs[dest_node->clv_index]
     = src_part->repeats->pernode_allocated_clvs[src_node->clv_index];
 
-  if (src_part->repeats->pernode_ids[src_node->clv_index]) {
-    const auto size =
-    pll_get_sites_number( const_cast<pll_partition_t*>(src_part),
-                          src_node->clv_index);
-
-    alloc_and_copy( dest_part->repeats->pernode_site_id[dest_node->clv_index],
-                    src_part->repeats->pernode_site_id[src_node->clv_index],
-                    src_part->sites);
-    alloc_and_copy( dest_part->repeats->pernode_id_site[dest_node->clv_index],
-                    src_part->repeats->pernode_id_site[src_node->clv_index],
-                    size);
-  }
-
+  free(dest_part->repeats->pernode_site_id[dest_node->clv_index]);
+  free(dest_part->repeats->pernode_id_site[dest_node->clv_index]);
+  dest_part->repeats->pernode_site_id[dest_node->clv_index]
+    = src_part->repeats->pernode_site_id[src_node->clv_index];
+  dest_part->repeats->pernode_id_site[dest_node->clv_index]
+    = src_part->repeats->pernode_id_site[src_node->clv_index];
 }
 
-
 pll_partition_t * make_tiny_partition(Tree& reference_tree,
                                       const pll_utree_t * tree,
                                       pll_unode_t const * const old_proximal,
                                       pll_unode_t const * const old_distal,
-                                      const bool tip_tip_case)
+                                      const bool tip_tip_case,
+                                      std::vector<aligned_buffer> * expanded)
 {
   /**
     As we work with PLL_PATTERN_TIP functionality, special care has to be taken in regards to the node and partition
@@ -97,6 +127,10 @@ pll_partition_t * make_tiny_partition(Tree& reference_tree,
 
   bool use_tipchars = old_partition->attributes & PLL_ATTRIB_PATTERN_TIP;
 
+  const auto& patterns = reference_tree.patterns();
+  const bool expand = patterns and expanded;
+  const unsigned int sites = expand ? patterns.num_sites() : old_partition->sites;
+
   // tip_inner case: both reference nodes are inner nodes
   // tip tip case: one for the "proximal" clv tip
   const unsigned int num_clv_tips = tip_tip_case ? 1 : 2;
@@ -107,7 +141,7 @@ pll_partition_t * make_tiny_partition(Tree& reference_tree,
   pll_partition_t * tiny = pll_partition_create(
     3, // tips
     1 + num_clv_tips, // extra clv's
-    old_partition->states, old_partition->sites,
+    old_partition->states, sites,
     old_partition->rate_matrices,
     3, // number of prob. matrices (one per possible unique branch length)
     old_partition->rate_cats,
@@ -163,19 +197,26 @@ pll_partition_t * make_tiny_partition(Tree& reference_tree,
   if (tiny->invariant) {
     free(tiny->invariant);
   }
-  tiny->invariant = old_partition->invariant;
+  tiny->invariant = expand ? reference_tree.site_invariant() : old_partition->invariant;
 
   free(tiny->eigen_decomp_valid);
   tiny->eigen_decomp_valid = old_partition->eigen_decomp_valid;
   if (tiny->pattern_weights) {
     free(tiny->pattern_weights);
   }
-  tiny->pattern_weights = old_partition->pattern_weights;
+  // the weights of the patterns are the number of sites they stand for, which
+  // must not count towards the per-site likelihoods of a tiny tree
+  tiny->pattern_weights = patterns ? reference_tree.site_weights() : old_partition->pattern_weights;
+
+  // shallow copy major buffers, or expanded copies of them
+  const size_t clv_span = tiny->states_padded * tiny->rate_cats;
+  auto reference_clv = [&](pll_unode_t const * const node) {
+    const auto clv = static_cast<double*>(reference_tree.get_clv(node));
+    return expand ? make_expanded(clv, clv_span, tiny, patterns, *expanded) : clv;
+  };
 
-  // shallow copy major buffers
   pll_aligned_free(tiny->clv[proximal->clv_index]);
-  tiny->clv[proximal->clv_index] =
-    static_cast<double*>(reference_tree.get_clv(old_proximal));
+  tiny->clv[proximal->clv_index] = reference_clv(old_proximal);
 
 
   if(tip_tip_case and use_tipchars) {
@@ -185,36 +226,43 @@ pll_partition_t * make_tiny_partition(Tree& reference_tree,
       throw std::runtime_error{"Error setting tip state"};
     }
     pll_aligned_free(tiny->tipchars[distal->clv_index]);
-    tiny->tipchars[distal->clv_index] = static_cast<unsigned char*>(reference_tree.get_clv(old_distal));
+    const auto tipchars = static_cast<unsigned char*>(reference_tree.get_clv(old_distal));
+    tiny->tipchars[distal->clv_index] = expand
+                                      ? make_expanded(tipchars, 1u, tiny, patterns, *expanded)
+                                      : tipchars;
   } else {
     pll_aligned_free(tiny->clv[distal->clv_index]);
-    tiny->clv[distal->clv_index] = static_cast<double*>(reference_tree.get_clv(old_distal));
+    tiny->clv[distal->clv_index] = reference_clv(old_distal);
   }
 
 
-  // deep copy scalers
-  deep_copy_scaler( tiny,
-                    proximal,
-                    old_partition,
-                    old_proximal);
+  // share the scalers
+  share_scaler( tiny,
+                proximal_scaler_index,
+                old_partition,
+                old_proximal,
+                expand ? &patterns : nullptr,
+                expanded);
 
-  deep_copy_scaler( tiny,
-                    distal,
-                    old_partition,
-                    old_distal);
+  share_scaler( tiny,
+                distal_scaler_index,
+                old_partition,
+                old_distal,
+                expand ? &patterns : nullptr,
+                expanded);
 
-  // copy the repeats structures
+  // share the repeats structures
   if (old_partition->repeats) {
     // then do the per-clv stuff, but only for the two relevant clv
-    deep_copy_repeats(tiny,
-                      proximal,
-                      old_partition,
-                      old_proximal);
+    share_repeats(tiny,
+                  proximal,
+                  old_partition,
+                  old_proximal);
 
-    deep_copy_repeats(tiny,
-                      distal,
-                      old_partition,
-                      old_distal);
+    share_repeats(tiny,
+                  distal,
+                  old_partition,
+                  old_distal);
 
     pll_resize_repeats_lookup(tiny, tiny->sites * tiny->states);
   }
@@ -238,9 +286,20 @@ void tiny_partition_destroy(pll_partition_t * partition)
     partition->pattern_weights    = nullptr;
 
     partition->clv[proximal_clv_index] = nullptr;
+    partition->scale_buffer[proximal_scaler_index] = nullptr;
+    partition->scale_buffer[distal_scaler_index]   = nullptr;
 
     const bool distal_is_tip    = partition->clv_buffers == 3 ? false : true;
     const bool pattern_tip_mode = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+    const auto distal_clv_index = distal_is_tip ? distal_clv_index_if_tip
+                                                : distal_clv_index_if_inner;
+
+    if (partition->repeats) {
+      for (auto clv_index : {proximal_clv_index, distal_clv_index}) {
+        partition->repeats->pernode_site_id[clv_index] = nullptr;
+        partition->repeats->pernode_id_site[clv_index] = nullptr;
+      }
+    }
 
     if (distal_is_tip) {
       if (pattern_tip_mode) {
@@ -260,10 +319,6 @@ pll_utree_t * make_tiny_tree_structure( const pll_unode_t * old_proximal,
                                         const pll_unode_t * old_distal,
                                         const bool tip_tip_case)
 {
-  const unsigned int inner_scaler_index = 1;
-  const unsigned int proximal_scaler_index = 0;
-  const unsigned int distal_scaler_index = 2;
-
   /**
     As we work with PLL_PATTERN_TIP functionality, special care has to be taken in regards to the tree and partition
     structure: PLL assumes that any node with clv index < number of tips is in fact a real tip, that is
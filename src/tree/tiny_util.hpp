@@ -1,5 +1,8 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "core/pll/pllhead.hpp"
 #include "tree/Tree.hpp"
 
@@ -7,8 +10,20 @@ void tiny_partition_destroy(pll_partition_t * partition);
 pll_utree_t * make_tiny_tree_structure( const pll_unode_t * old_proximal, 
                                         const pll_unode_t * old_distal,
                                         const bool tip_tip_case);
+using aligned_buffer = std::unique_ptr<void, void(*)(void*)>;
+
+/**
+  The CLVs, scalers and site repeat maps of the proximal and distal nodes are
+  those of the reference tree, not copies: a tiny tree only ever writes to its
+  inner node.
+  If the reference tree is compressed into site patterns, the tiny partition
+  holds one site per pattern as well, unless <expanded> is given: then it spans
+  all sites, with the CLVs of the reference expanded into the given buffers,
+  which have to outlive the partition.
+*/
 pll_partition_t * make_tiny_partition(Tree& reference_tree, 
                                       const pll_utree_t * tree, 
                                       const pll_unode_t * old_proximal, 
                                       const pll_unode_t * old_distal, 
-                                      const bool tip_tip_case);
+                                      const bool tip_tip_case,
+                                      std::vector<aligned_buffer> * expanded = nullptr);
@@ -29,11 +29,25 @@ public:
   bool dump_binary_mode         = false;
   bool load_binary_mode         = false;
   unsigned int chunk_size       = 5000;
+  bool adaptive_chunk_size      = false;
+  unsigned int min_chunk_size   = 100;
+  unsigned int max_chunk_size   = 100000;
+  // MiB, 0 for a share of the physical memory
+  unsigned int chunk_memory     = 0;
   unsigned int num_threads      = 0;
   bool repeats                  = false;
   bool premasking               = true;
+  bool compress_patterns        = false;
   bool baseball                 = false;
   std::string tmp_dir;
+  std::string cache_dir;
   unsigned int precision        = 10;
+  unsigned int bfast_buffer     = 256;
+  bool pipeline                 = false;
+  bool dynamic_distribution     = true;
+  bool numa_bind                = false;
+  bool shared_memory            = false;
+  unsigned int checkpoint_interval = 0;
+  bool resume                   = false;
   NumericalScaling scaling      = NumericalScaling::kAuto;
 };
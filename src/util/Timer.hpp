@@ -10,6 +10,7 @@ template <class duration = std::chrono::seconds>
 class Timer {
 public:
   // Typedefs
+  using duration_type   = duration;
   using clock           = std::chrono::high_resolution_clock;
   using iterator        = typename std::vector<duration>::iterator;
   using const_iterator  = typename std::vector<duration>::const_iterator;
@@ -99,6 +100,12 @@ public:
     return this->sum()/ts_.size();
   }
 
+  // the sum, in seconds regardless of the resolution
+  double seconds() const
+  {
+    return std::chrono::duration<double>(this->sum_duration()).count();
+  }
+
   void clear() {ts_.clear();}
 
   // Serialization
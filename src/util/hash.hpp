@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * 64-bit FNV-1a. Not cryptographic, but cheap, stable across platforms and
+ * runs, and good enough to tell whether two inputs are the same.
+ *
+ * Successive calls can be chained by passing the previous result as seed.
+ */
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME        = 1099511628211ull;
+
+inline uint64_t fnv1a_bytes(const void* data,
+                            const size_t bytes,
+                            uint64_t hash = FNV_OFFSET_BASIS)
+{
+  const auto ptr = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < bytes; ++i) {
+    hash ^= ptr[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+inline uint64_t fnv1a(const std::string& str, const uint64_t hash = FNV_OFFSET_BASIS)
+{
+  return fnv1a_bytes(str.data(), str.size(), hash);
+}
+
+template <class T>
+inline uint64_t fnv1a_value(const T& value, const uint64_t hash = FNV_OFFSET_BASIS)
+{
+  static_assert(std::is_arithmetic<T>::value or std::is_enum<T>::value,
+                "Only plain values can be hashed by their bytes");
+  return fnv1a_bytes(&value, sizeof(T), hash);
+}
@@ -29,5 +29,12 @@ constexpr unsigned char AA_MAP[] =
   { 'A', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'K', 'L', 'M', 'N', 'P', 'Q', 'R', 'S', 
     'T', 'V', 'W', 'Y', '-', 'X', 'B', 'Z'};
 
+// characters representable by the 5bit (protein) encoding, position is the code.
+// Code 0 is the gap, so that zero padding decodes to gaps.
+constexpr unsigned char FIVEBIT_MAP[] =
+  { '-', 'A', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'K', 'L', 'M', 'N', 'P', 'Q', 'R',
+    'S', 'T', 'V', 'W', 'Y', 'X', 'B', 'Z', 'J', 'U', 'O', '*', '?', '.'};
+
 constexpr size_t NT_MAP_SIZE = array_size(NT_MAP);
 constexpr size_t AA_MAP_SIZE = array_size(AA_MAP);
+constexpr size_t FIVEBIT_MAP_SIZE = array_size(FIVEBIT_MAP);
@@ -0,0 +1,283 @@
+#include "util/topology.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include "net/mpihead.hpp"
+#include "util/logging.hpp"
+
+std::vector<int> parse_cpulist(const std::string& list)
+{
+  std::vector<int> result;
+  std::stringstream stream(list);
+  std::string range;
+
+  while (std::getline(stream, range, ',')) {
+    range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+    if (range.empty()) {
+      continue;
+    }
+    try {
+      const auto dash = range.find('-');
+      const int first = std::stoi(range.substr(0, dash));
+      const int last  = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+      if (first < 0 or last < first) {
+        throw std::invalid_argument{range};
+      }
+      for (int cpu = first; cpu <= last; ++cpu) {
+        result.push_back(cpu);
+      }
+    } catch (std::logic_error&) {
+      throw std::runtime_error{std::string("Invalid cpu list: ") + list};
+    }
+  }
+
+  return result;
+}
+
+std::string format_cpulist(std::vector<int> cpus)
+{
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+  std::string result;
+  for (size_t i = 0; i < cpus.size(); ) {
+    size_t j = i;
+    while (j + 1 < cpus.size() and cpus[j + 1] == cpus[j] + 1) {
+      ++j;
+    }
+    result += (result.empty() ? "" : ",") + std::to_string(cpus[i]);
+    if (j > i) {
+      result += "-" + std::to_string(cpus[j]);
+    }
+    i = j + 1;
+  }
+  return result;
+}
+
+static std::vector<int> usable_cpus()
+{
+  std::vector<int> result;
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &mask)) {
+        result.push_back(cpu);
+      }
+    }
+  }
+#endif
+  if (result.empty()) {
+    const int num = std::max(1u, std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < num; ++cpu) {
+      result.push_back(cpu);
+    }
+  }
+  return result;
+}
+
+std::vector<std::vector<int>> numa_domains(const std::string& sysfs_dir)
+{
+  std::vector<std::pair<int, std::vector<int>>> nodes;
+
+#ifdef __linux__
+  if (auto dir = opendir(sysfs_dir.c_str())) {
+    while (auto entry = readdir(dir)) {
+      const std::string name(entry->d_name);
+      if (name.compare(0, 4, "node") != 0
+          or name.size() == 4
+          or not std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+        continue;
+      }
+      std::ifstream file(sysfs_dir + "/" + name + "/cpulist");
+      std::string list;
+      if (std::getline(file, list)) {
+        auto cpus = parse_cpulist(list);
+        // memory-only nodes have no cpus to bind to
+        if (not cpus.empty()) {
+          nodes.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+        }
+      }
+    }
+    closedir(dir);
+  }
+#else
+  (void) sysfs_dir;
+#endif
+
+  std::sort(nodes.begin(), nodes.end());
+
+  // only keep what we may actually run on (cgroups, taskset, batch systems)
+  const auto allowed = usable_cpus();
+  std::vector<std::vector<int>> result;
+  for (auto& node : nodes) {
+    std::vector<int> cpus;
+    std::set_intersection(node.second.begin(), node.second.end(),
+                          allowed.begin(), allowed.end(),
+                          std::back_inserter(cpus));
+    if (not cpus.empty()) {
+      result.push_back(std::move(cpus));
+    }
+  }
+
+  if (result.empty()) {
+    result.push_back(allowed);
+  }
+
+  return result;
+}
+
+static bool set_affinity(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (const auto cpu : cpus) {
+    CPU_SET(cpu, &mask);
+  }
+  // pid 0: only the calling thread, threads created afterwards inherit it
+  return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+  (void) cpus;
+  return false;
+#endif
+}
+
+Binding bind_to_numa_domain(Options& options)
+{
+  Binding binding;
+
+#ifdef __MPI
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &binding.node_rank);
+  MPI_Comm_size(node_comm, &binding.node_size);
+  MPI_Comm_free(&node_comm);
+#endif
+
+  const auto domains = numa_domains();
+  const size_t node_rank = binding.node_rank;
+  const size_t node_size = binding.node_size;
+
+  binding.num_domains = domains.size();
+  binding.domain = node_rank % domains.size();
+
+  const auto& domain_cpus = domains[binding.domain];
+
+  // ranks sharing a domain each get an equal slice of its cpus
+  const size_t sharing = node_size / domains.size()
+                       + (binding.domain < static_cast<int>(node_size % domains.size()));
+  const size_t slot = node_rank / domains.size();
+  if (sharing > 1 and domain_cpus.size() >= sharing) {
+    const size_t begin = slot * domain_cpus.size() / sharing;
+    const size_t end   = (slot + 1) * domain_cpus.size() / sharing;
+    binding.cpus.assign(domain_cpus.begin() + begin, domain_cpus.begin() + end);
+  } else {
+    binding.cpus = domain_cpus;
+  }
+
+  if (not set_affinity(binding.cpus)) {
+    LOG_WARN << "Could not bind to NUMA domain " << binding.domain << ", continuing unbound";
+    binding.domain = -1;
+    binding.cpus = usable_cpus();
+    return binding;
+  }
+
+  if (node_rank == 0 and node_size != domains.size()) {
+    LOG_WARN << "There are " << node_size << " MPI ranks on this machine but "
+             << domains.size() << " NUMA domains. One rank per domain works best.";
+  }
+
+  if (not options.num_threads) {
+    options.num_threads = binding.cpus.size();
+  }
+
+  return binding;
+}
+
+void pin_threads(const Binding& binding, const Options& options)
+{
+  if (binding.domain < 0 or binding.cpus.empty()) {
+    return;
+  }
+#ifdef __OMP
+  const int num_threads = options.num_threads ? options.num_threads : omp_get_max_threads();
+  #pragma omp parallel num_threads(num_threads)
+  {
+    const size_t tid = omp_get_thread_num();
+    if (tid > 0) {
+      set_affinity({binding.cpus[tid % binding.cpus.size()]});
+    }
+  }
+#else
+  (void) options;
+#endif
+}
+
+void log_topology(const Binding& binding, const Options& options)
+{
+  int rank = 0;
+  int num_ranks = 1;
+  MPI_COMM_RANK(MPI_COMM_WORLD, &rank);
+  MPI_COMM_SIZE(MPI_COMM_WORLD, &num_ranks);
+
+  std::string host("localhost");
+#ifdef __linux__
+  char buffer[256] = {0};
+  if (gethostname(buffer, sizeof(buffer) - 1) == 0) {
+    host = buffer;
+  }
+#endif
+
+  std::stringstream line;
+  line << "Rank " << rank << " (" << binding.node_rank + 1 << " of "
+       << binding.node_size << " on " << host << "): ";
+  if (binding.domain < 0) {
+    line << "unbound";
+  } else {
+    line << "NUMA domain " << binding.domain + 1 << " of " << binding.num_domains;
+  }
+  line << ", cpus " << format_cpulist(binding.cpus)
+       << ", " << options.num_threads << " threads";
+
+#ifdef __MPI
+  // only rank 0 logs, so collect everyones line there
+  const auto own = line.str();
+  int length = own.size();
+  std::vector<int> lengths(num_ranks);
+  MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  std::vector<int> displs(num_ranks, 0);
+  for (int i = 1; i < num_ranks; ++i) {
+    displs[i] = displs[i - 1] + lengths[i - 1];
+  }
+  std::string all(rank == 0 ? displs.back() + lengths.back() : 0, '\0');
+  MPI_Gatherv(own.data(), length, MPI_CHAR,
+              &all[0], lengths.data(), displs.data(), MPI_CHAR,
+              0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    for (int i = 0; i < num_ranks; ++i) {
+      LOG_INFO << all.substr(displs[i], lengths[i]);
+    }
+  }
+#else
+  (void) num_ranks;
+  LOG_INFO << line.str();
+#endif
+}
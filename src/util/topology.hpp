@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "util/Options.hpp"
+
+/**
+ * Where on the machine the current rank (and its threads) are running.
+ */
+struct Binding
+{
+  // NUMA domain this rank is bound to, -1 if not bound
+  int domain = -1;
+  size_t num_domains = 1;
+  // rank among / number of the ranks sharing this machine
+  int node_rank = 0;
+  int node_size = 1;
+  std::vector<int> cpus;
+};
+
+/**
+ * Parses a linux cpulist string, such as "0-3,8,10-11".
+ */
+std::vector<int> parse_cpulist(const std::string& list);
+
+/**
+ * Reverse of parse_cpulist, collapsing consecutive ids into ranges.
+ */
+std::string format_cpulist(std::vector<int> cpus);
+
+/**
+ * Returns the cpus of every NUMA domain with cpus attached, as listed in sysfs.
+ * Falls back to a single domain holding all usable cpus if there is no such
+ * information.
+ */
+std::vector<std::vector<int>> numa_domains(const std::string& sysfs_dir = "/sys/devices/system/node");
+
+/**
+ * Binds this process to one NUMA domain: the ranks sharing a machine are
+ * spread round robin over its domains, and ranks sharing a domain split its
+ * cpus. Has to be called before any large allocations (such as the reference
+ * Tree) are made, so that their memory is first touched on the local domain.
+ *
+ * If no thread count was specified, sets it to the number of cpus bound to.
+ * Collective under MPI.
+ */
+Binding bind_to_numa_domain(Options& options);
+
+/**
+ * Pins every OpenMP worker thread to its own cpu of the binding. The master
+ * thread keeps the whole set, so that threads started by it later on (such as
+ * the pipeline stages) are not all squeezed onto one core.
+ */
+void pin_threads(const Binding& binding, const Options& options);
+
+/**
+ * Logs one line per rank describing where it runs. Collective under MPI.
+ */
+void log_topology(const Binding& binding, const Options& options);
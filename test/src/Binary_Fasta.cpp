@@ -6,6 +6,11 @@
 
 #include "genesis/utils/core/options.hpp"
 
+#include <fstream>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
 static void compare_msas(const MSA& lhs, const MSA& rhs)
 {
   ASSERT_EQ(lhs.size(), rhs.size());
@@ -66,3 +71,150 @@ TEST(Binary_Fasta, reader)
 
   }
 }
+
+TEST(Binary_Fasta, mapped_reader)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  MSA_Info info(env->combined_file);
+
+  for (const bool premasking : {false, true}) {
+    auto msa = build_MSA_from_file(orig_file, info, premasking);
+
+    Binary_Fasta::save(build_MSA_from_file(orig_file, info), binfile_name);
+
+    Binary_Fasta_Mapped_Reader reader(binfile_name, info, premasking);
+
+    ASSERT_EQ(msa.size(), reader.num_sequences());
+
+    auto view = reader.entry(0);
+    EXPECT_EQ(msa[0].header(), std::string(view.header, view.header_size));
+    EXPECT_EQ(info.sites(), view.sites);
+
+    MSA read_msa;
+    size_t i = 0;
+    const size_t chunksize = 3;
+    size_t num_sequences = 0;
+    while ( (num_sequences = reader.read_next(read_msa, chunksize)) ) {
+
+      ASSERT_EQ(num_sequences, read_msa.size()) << "bad size at i=" << i;
+
+      for (size_t k = 0; k < num_sequences; ++k) {
+        EXPECT_STREQ(msa[i+k].header().c_str(), read_msa[k].header().c_str());
+        EXPECT_STREQ(msa[i+k].sequence().c_str(), read_msa[k].sequence().c_str());
+      }
+
+      i+=num_sequences;
+    }
+    EXPECT_EQ(msa.size(), i);
+  }
+}
+
+TEST(Binary_Fasta, read_range)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  MSA_Info info(env->combined_file);
+  auto msa = build_MSA_from_file(orig_file, info, true);
+
+  Binary_Fasta::save(build_MSA_from_file(orig_file, info), binfile_name);
+
+  Binary_Fasta_Mapped_Reader mapped_reader(binfile_name, info, true);
+  Binary_Fasta_Reader stream_reader(binfile_name, info, true);
+
+  for (msa_reader* reader : std::vector<msa_reader*>{&mapped_reader, &stream_reader}) {
+    MSA read_msa;
+    const size_t chunksize = 5;
+    for (size_t begin = (msa.size() / chunksize) * chunksize; ; begin -= chunksize) {
+      const auto num_sequences = reader->read_range(read_msa, begin, chunksize);
+      ASSERT_EQ(std::min(chunksize, msa.size() - begin), num_sequences);
+      for (size_t k = 0; k < num_sequences; ++k) {
+        EXPECT_EQ(msa[begin + k].header(), read_msa[k].header());
+        EXPECT_EQ(msa[begin + k].sequence(), read_msa[k].sequence());
+      }
+      if (begin == 0) {
+        break;
+      }
+    }
+    EXPECT_EQ(0u, reader->read_range(read_msa, msa.size(), chunksize));
+  }
+}
+
+TEST(Binary_Fasta, 5bit_store_and_load)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->data_dir + "AA_aln.fasta");
+  const std::string binfile_name(env->out_dir + "AA_aln.fasta.bin");
+
+  MSA_Info info(orig_file);
+  auto msa = build_MSA_from_file(orig_file, info);
+
+  Binary_Fasta::save(msa, binfile_name);
+
+  auto read_msa = Binary_Fasta::load(binfile_name, false);
+  compare_msas(msa, read_msa);
+
+  Binary_Fasta_Mapped_Reader reader(binfile_name, info);
+  MSA mapped_msa;
+  reader.read_next(mapped_msa, msa.size());
+  compare_msas(msa, mapped_msa);
+}
+
+TEST(Binary_Fasta, 5bit_fasta_to_bfast)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->data_dir + "AA_aln.fasta");
+
+  auto bfast_file = Binary_Fasta::fasta_to_bfast(orig_file, env->out_dir);
+
+  auto msa = build_MSA_from_file(orig_file, MSA_Info(orig_file));
+  auto read_msa = Binary_Fasta::load(bfast_file, false);
+  compare_msas(msa, read_msa);
+}
+
+TEST(Binary_Fasta, fasta_to_bfast_streaming)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  // a file larger than the conversion buffer, so it is processed in several blocks
+  const std::string large_file(env->out_dir + "large.fasta");
+  {
+    auto msa = build_MSA_from_file(env->combined_file, MSA_Info(env->combined_file));
+    std::ofstream out(large_file);
+    for (size_t r = 0; r < 400; ++r) {
+      for (const auto& s : msa) {
+        out << ">" << s.header() << "_" << r << "\n" << s.sequence() << "\n";
+      }
+    }
+  }
+
+  Options options;
+  options.bfast_buffer = 1;
+
+  auto bfast_file = Binary_Fasta::fasta_to_bfast(large_file, env->out_dir, options);
+
+  MSA_Info info(large_file);
+  auto bfast_info = Binary_Fasta::get_info(bfast_file);
+
+  EXPECT_EQ(info.sequences(), bfast_info.sequences());
+  EXPECT_EQ(info.sites(), bfast_info.sites());
+  EXPECT_EQ(info.gap_mask(), bfast_info.gap_mask());
+
+  auto msa = build_MSA_from_file(large_file, info);
+  compare_msas(msa, Binary_Fasta::load(bfast_file, false));
+
+  // random access through the offset table
+  Binary_Fasta_Mapped_Reader reader(bfast_file, info);
+  auto view = reader.entry(msa.size() - 1);
+  EXPECT_EQ(msa[msa.size() - 1].header(), std::string(view.header, view.header_size));
+
+  std::remove(large_file.c_str());
+}
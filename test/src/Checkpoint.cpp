@@ -0,0 +1,133 @@
+#include "Epatest.hpp"
+
+#include "io/Checkpoint.hpp"
+#include "io/jplace_writer.hpp"
+#include "util/hash.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+using namespace std;
+
+TEST(Checkpoint, save_and_load)
+{
+  const string file_name(Checkpoint::file_name(env->out_dir));
+
+  Checkpoint checkpoint(fnv1a("reference"), fnv1a("settings"), env->query_file, 100, 1);
+  checkpoint.progress(7, 12345, 6);
+  checkpoint.save(file_name);
+
+  auto loaded = Checkpoint::load(file_name);
+  EXPECT_EQ(7u, loaded.chunks_done());
+  EXPECT_EQ(12345u, loaded.bytes_written());
+  EXPECT_EQ(6u, loaded.blocks_written());
+  EXPECT_NO_THROW(checkpoint.check_resumable(loaded));
+
+  // not a checkpoint file
+  EXPECT_ANY_THROW(Checkpoint::load(env->query_file));
+
+  remove(file_name.c_str());
+}
+
+TEST(Checkpoint, check_resumable)
+{
+  const Checkpoint checkpoint(fnv1a("reference"), fnv1a("settings"), env->query_file, 100, 1);
+
+  EXPECT_NO_THROW(checkpoint.check_resumable(
+    Checkpoint(fnv1a("reference"), fnv1a("settings"), env->query_file, 100, 1)));
+  EXPECT_ANY_THROW(checkpoint.check_resumable(
+    Checkpoint(fnv1a("other reference"), fnv1a("settings"), env->query_file, 100, 1)));
+  EXPECT_ANY_THROW(checkpoint.check_resumable(
+    Checkpoint(fnv1a("reference"), fnv1a("other settings"), env->query_file, 100, 1)));
+  EXPECT_ANY_THROW(checkpoint.check_resumable(
+    Checkpoint(fnv1a("reference"), fnv1a("settings"), env->tree_file, 100, 1)));
+  EXPECT_ANY_THROW(checkpoint.check_resumable(
+    Checkpoint(fnv1a("reference"), fnv1a("settings"), env->query_file, 50, 1)));
+  EXPECT_ANY_THROW(checkpoint.check_resumable(
+    Checkpoint(fnv1a("reference"), fnv1a("settings"), env->query_file, 100, 4)));
+}
+
+TEST(Checkpoint, fnv1a)
+{
+  // reference values of 64-bit FNV-1a
+  EXPECT_EQ(0xcbf29ce484222325ull, fnv1a(""));
+  EXPECT_EQ(0xaf63dc4c8601ec8cull, fnv1a("a"));
+  EXPECT_EQ(0x85944171f73967e8ull, fnv1a("foobar"));
+  EXPECT_EQ(fnv1a("foobar"), fnv1a("bar", fnv1a("foo")));
+}
+
+#ifndef __MPI
+
+static Sample<> make_chunk(const size_t chunk_id)
+{
+  Sample<> chunk;
+  // including an empty one
+  if (chunk_id == 1) {
+    return chunk;
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    chunk.add_pquery(chunk_id * 10 + i, "query_" + to_string(chunk_id * 10 + i));
+    chunk.back().emplace_back(i, -10.0 * i, 0.1, 0.2);
+  }
+  return chunk;
+}
+
+static string read_file(const string& file_name)
+{
+  ifstream in(file_name);
+  stringstream buffer;
+  buffer << in.rdbuf();
+  return buffer.str();
+}
+
+TEST(Checkpoint, resume_jplace)
+{
+  const string tree("((a:1,b:1):1,c:1);");
+  const size_t num_chunks = 5;
+
+  // uninterrupted
+  {
+    jplace_writer jplace(env->out_dir, "full.jplace", tree, "invocation", rtree_mapper());
+    for (size_t i = 0; i < num_chunks; ++i) {
+      auto chunk = make_chunk(i);
+      jplace.write(chunk);
+    }
+  }
+
+  // checkpoint after two chunks, then write another before being interrupted
+  jplace_writer::Position position;
+  {
+    jplace_writer jplace(env->out_dir, "resumed.jplace", tree, "invocation", rtree_mapper());
+    for (size_t i = 0; i < 3; ++i) {
+      auto chunk = make_chunk(i);
+      jplace.write(chunk);
+      if (i == 1) {
+        position = jplace.sync();
+      }
+    }
+  }
+
+  // continue from the checkpoint
+  {
+    jplace_writer jplace(env->out_dir, "resumed.jplace", tree, "invocation", rtree_mapper(), position);
+    for (size_t i = 2; i < num_chunks; ++i) {
+      auto chunk = make_chunk(i);
+      jplace.write(chunk);
+    }
+  }
+
+  const auto expected = read_file(env->out_dir + "full.jplace");
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(expected, read_file(env->out_dir + "resumed.jplace"));
+
+  // nothing to continue from
+  EXPECT_ANY_THROW(jplace_writer(env->out_dir, "missing.jplace", tree, "invocation",
+                                 rtree_mapper(), position));
+
+  remove((env->out_dir + "full.jplace").c_str());
+  remove((env->out_dir + "resumed.jplace").c_str());
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include "Epatest.hpp"
+
+#include "core/Chunk_Sizer.hpp"
+#include "sample/Placement.hpp"
+
+using namespace std;
+
+TEST(Chunk_Sizer, bounds)
+{
+  const size_t huge = size_t(1) << 40;
+
+  Chunk_Sizer sizer(100, 1000, huge, 10, 200, 5000);
+  EXPECT_EQ(200u, sizer.next());
+
+  Chunk_Sizer small(100, 1000, huge, 10, 200, 1);
+  EXPECT_EQ(10u, small.next());
+
+  EXPECT_ANY_THROW(Chunk_Sizer(100, 1000, huge, 0, 200, 50));
+  EXPECT_ANY_THROW(Chunk_Sizer(100, 1000, huge, 300, 200, 50));
+}
+
+TEST(Chunk_Sizer, memory_budget)
+{
+  const size_t num_branches = 1000;
+  const size_t num_sites = 500;
+  // exactly 100 sequences, assuming every branch is a candidate
+  const size_t per_sequence = num_sites
+                            + num_branches * (sizeof(Placement) + sizeof(size_t))
+                            + num_branches * sizeof(Placement);
+  Chunk_Sizer sizer(num_branches, num_sites, 100 * per_sequence, 1, 100000, 5000);
+  EXPECT_EQ(100u, sizer.next());
+  EXPECT_LE(sizer.chunk_bytes(sizer.next()), 100 * per_sequence);
+
+  // learning that the heuristic picks few candidates frees up memory for more
+  // sequences, which is used as long as that helps throughput
+  sizer.report(100, 1.0, 100 * 5);
+  EXPECT_GT(sizer.next(), 100u);
+  EXPECT_LE(sizer.chunk_bytes(sizer.next()), 100 * per_sequence);
+
+  // without prescoring, there is no dense Sample to hold
+  Chunk_Sizer no_prescoring(num_branches, num_sites, 100 * per_sequence, 1, 100000, 5000, false);
+  EXPECT_GT(no_prescoring.next(), 100u);
+}
+
+TEST(Chunk_Sizer, throughput)
+{
+  const size_t huge = size_t(1) << 40;
+  Chunk_Sizer sizer(10, 100, huge, 1, 100000, 100);
+
+  // grows while it pays off
+  sizer.report(100, 1.0, 100);
+  EXPECT_EQ(200u, sizer.next());
+  sizer.report(200, 1.0, 200);
+  EXPECT_EQ(400u, sizer.next());
+  EXPECT_FALSE(sizer.settled());
+
+  // a short last chunk is no measurement
+  sizer.report(7, 1.0, 7);
+  EXPECT_EQ(400u, sizer.next());
+
+  // no real gain: back to the best size, and stay there
+  sizer.report(400, 1.99, 400);
+  EXPECT_EQ(200u, sizer.next());
+  EXPECT_TRUE(sizer.settled());
+
+  sizer.report(200, 0.1, 200);
+  EXPECT_EQ(200u, sizer.next());
+}
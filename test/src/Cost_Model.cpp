@@ -0,0 +1,138 @@
+#include "Epatest.hpp"
+
+#include "core/Cost_Model.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+static double load(const vector<Bundle>& bundles)
+{
+  return accumulate(begin(bundles), end(bundles), 0.0,
+    [](double sum, const Bundle& bundle) { return sum + bundle.cost; });
+}
+
+// every (branch, sequence) pair exactly once
+static void expect_complete(const vector<vector<Bundle>>& per_thread,
+                            const size_t num_branches,
+                            const size_t num_sequences)
+{
+  vector<size_t> seen(num_branches * num_sequences, 0);
+  for (const auto& bundles : per_thread) {
+    for (const auto& bundle : bundles) {
+      EXPECT_EQ(bundle.sequences.size(), bundle.costs.size());
+      for (const auto seq_id : bundle.sequences) {
+        ++seen[bundle.branch_id * num_sequences + seq_id];
+      }
+    }
+  }
+  for (const auto count : seen) {
+    EXPECT_EQ(1u, count);
+  }
+}
+
+TEST(Cost_Model, calibrate)
+{
+  Cost_Model model;
+
+  Cost_Sample sample;
+  sample.build(true, 2.0);
+  sample.build(true, 4.0);
+  sample.place(true, 100, 1.0);
+
+  Cost_Sample other;
+  other.place(true, 100, 3.0);
+  sample += other;
+
+  const auto inner_build = model.build_cost(false);
+  const auto inner_place = model.place_cost(false, 1000);
+
+  model.calibrate(sample);
+  for (size_t i = 0; i < 50; ++i) {
+    model.calibrate(sample);
+  }
+
+  EXPECT_NEAR(3.0, model.build_cost(true), 1e-9);
+  EXPECT_NEAR(0.02 * 10, model.place_cost(true, 10), 1e-9);
+
+  // nothing measured for inner branches
+  EXPECT_DOUBLE_EQ(inner_build, model.build_cost(false));
+  EXPECT_DOUBLE_EQ(inner_place, model.place_cost(false, 1000));
+}
+
+TEST(Cost_Model, balance_many_branches)
+{
+  const size_t num_branches = 100;
+  const size_t num_sequences = 10;
+  const size_t num_threads = 4;
+
+  vector<Bundle> bundles;
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    bundles.emplace_back(branch_id, 1.0);
+    for (size_t seq_id = 0; seq_id < num_sequences; ++seq_id) {
+      bundles.back().add(seq_id, 0.1 * (branch_id % 7 + 1));
+    }
+  }
+  const auto total = load(bundles);
+
+  const auto per_thread = balance_bundles(bundles, num_threads);
+  ASSERT_EQ(num_threads, per_thread.size());
+  expect_complete(per_thread, num_branches, num_sequences);
+
+  // no branch has to be built twice
+  size_t num_bundles = 0;
+  for (const auto& thread : per_thread) {
+    num_bundles += thread.size();
+    EXPECT_NEAR(total / num_threads, load(thread), 0.05 * total / num_threads);
+  }
+  EXPECT_EQ(num_branches, num_bundles);
+}
+
+TEST(Cost_Model, balance_dominating_branch)
+{
+  const size_t num_branches = 5;
+  const size_t num_sequences = 100;
+  const size_t num_threads = 4;
+
+  // branch 0 has all the queries, the others one each
+  vector<Bundle> bundles;
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    bundles.emplace_back(branch_id, 0.5);
+    for (size_t seq_id = 0; seq_id < (branch_id ? 1 : num_sequences); ++seq_id) {
+      bundles.back().add(seq_id, 1.0);
+    }
+  }
+
+  const auto per_thread = balance_bundles(bundles, num_threads);
+
+  vector<size_t> seen(num_branches * num_sequences, 0);
+  size_t threads_on_big = 0;
+  for (const auto& thread : per_thread) {
+    threads_on_big += any_of(begin(thread), end(thread),
+      [](const Bundle& bundle) { return bundle.branch_id == 0; });
+    for (const auto& bundle : thread) {
+      for (const auto seq_id : bundle.sequences) {
+        ++seen[bundle.branch_id * num_sequences + seq_id];
+      }
+    }
+    // the split pieces each pay for their own setup
+    EXPECT_LT(load(thread), 30.0);
+  }
+  EXPECT_EQ(num_threads, threads_on_big);
+  EXPECT_EQ(num_sequences + num_branches - 1,
+            static_cast<size_t>(count(begin(seen), end(seen), 1u)));
+}
+
+TEST(Cost_Model, balance_corner_cases)
+{
+  EXPECT_EQ(3u, balance_bundles({}, 3).size());
+
+  vector<Bundle> single{Bundle(7, 1.0)};
+  single.back().add(0, 1.0);
+  const auto per_thread = balance_bundles(single, 0);
+  ASSERT_EQ(1u, per_thread.size());
+  ASSERT_EQ(1u, per_thread[0].size());
+  EXPECT_EQ(7u, per_thread[0][0].branch_id);
+}
@@ -0,0 +1,81 @@
+#include "Epatest.hpp"
+
+#include "io/Fasta_Index.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+
+#include "genesis/sequence/formats/fasta_input_iterator.hpp"
+
+#include <fstream>
+#include <string>
+#include <cstdio>
+
+using namespace std;
+
+TEST(Fasta_Index, build)
+{
+  MSA_Info info(env->combined_file);
+  auto msa = build_MSA_from_file(env->combined_file, info);
+
+  Fasta_Index index(env->combined_file);
+
+  ASSERT_EQ(info.sequences(), index.size());
+  EXPECT_TRUE(index.matches(env->combined_file));
+
+  ifstream in(env->combined_file, ios::binary);
+  for (size_t i = 0; i < index.size(); ++i) {
+    in.seekg(index.offset(i));
+    string line;
+    getline(in, line);
+    ASSERT_FALSE(line.empty());
+    EXPECT_EQ('>', line[0]);
+    EXPECT_EQ(msa[i].header(), line.substr(1));
+  }
+
+  EXPECT_ANY_THROW(index.offset(index.size()));
+}
+
+TEST(Fasta_Index, save_and_load)
+{
+  const string index_file(env->out_dir + "combined.fasta.epai");
+
+  Fasta_Index index(env->combined_file);
+  index.save(index_file);
+
+  auto loaded = Fasta_Index::load(index_file);
+
+  ASSERT_EQ(index.size(), loaded.size());
+  EXPECT_EQ(index.offsets(), loaded.offsets());
+  EXPECT_TRUE(loaded.matches(env->combined_file));
+  EXPECT_FALSE(loaded.matches(env->query_file));
+
+  // not an index file
+  EXPECT_ANY_THROW(Fasta_Index::load(env->combined_file));
+
+  remove(index_file.c_str());
+}
+
+TEST(Fasta_Index, seek_and_parse)
+{
+  MSA_Info info(env->combined_file);
+  auto msa = build_MSA_from_file(env->combined_file, info);
+
+  Fasta_Index index(env->combined_file);
+
+  const size_t skip = index.size() / 2;
+
+  ifstream in(env->combined_file, ios::binary);
+  in.seekg(index.offset(skip));
+
+  auto it = genesis::sequence::FastaInputIterator( genesis::utils::from_stream(in) );
+
+  size_t i = skip;
+  while (it) {
+    ASSERT_LT(i, msa.size());
+    EXPECT_EQ(msa[i].header(), it->label());
+    ++it;
+    ++i;
+  }
+  EXPECT_EQ(msa.size(), i);
+}
@@ -0,0 +1,66 @@
+#include "Epatest.hpp"
+
+#ifdef __MPI
+
+#include "net/Intercom.hpp"
+#include "pipeline/schedule.hpp"
+#include "util/Timer.hpp"
+
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+/**
+ * Run with several ranks on one machine, e.g.
+ *    mpirun -n 8 ./test/bin/epa_test Intercom.*
+ * Every rank pretends to work on its stage for a time inversely proportional
+ * to the number of ranks in that stage, and the schedule has to converge to
+ * the one matching the (fixed) work per stage.
+ */
+TEST(Intercom, rebalance_converges)
+{
+  int world_size = 1;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+  const vector<double> work{1.0, 30.0, 60.0, 10.0};
+  const size_t num_stages = work.size();
+
+  if (static_cast<size_t>(world_size) < num_stages) {
+    // nothing to balance
+    return;
+  }
+
+  Intercom icom(num_stages);
+  icom.damping(0.5, 0.1);
+
+  const auto ideal = solve(num_stages, world_size, work, {1, 0, 0, 0});
+
+  size_t changes = 0;
+  auto nps = icom.nodes_per_stage();
+  for (size_t round = 0; round < 10; ++round) {
+    size_t stage = 0;
+    while (not icom.stage_active(stage)) {
+      ++stage;
+    }
+
+    using duration = stage_timer::duration_type;
+    const auto ms = work[stage] * 100.0 / nps[stage];
+    stage_timer timer(duration(static_cast<duration::rep>(ms)));
+
+    icom.rebalance(timer);
+
+    const auto new_nps = icom.nodes_per_stage();
+    changes += (new_nps != nps) and (round > 2);
+    nps = new_nps;
+  }
+
+  for (size_t i = 0; i < num_stages; ++i) {
+    EXPECT_LE(abs(static_cast<int>(nps[i]) - static_cast<int>(ideal[i])), 1)
+      << "stage " << i;
+  }
+  EXPECT_EQ(0u, changes);
+}
+
+#endif
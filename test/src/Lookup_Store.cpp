@@ -0,0 +1,39 @@
+#include "Epatest.hpp"
+
+#include <string>
+#include <vector>
+
+#include "core/Lookup_Store.hpp"
+
+using namespace std;
+
+TEST(Lookup_Store, sum_precomputed_sitelk)
+{
+  const size_t num_branches = 3;
+  const size_t num_sites = 21;
+
+  Lookup_Store lookups(num_branches, 4);
+  const auto size = lookups.char_map_size();
+
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    vector<vector<double>> precomps(size, vector<double>(num_sites));
+    for (size_t ch = 0; ch < size; ++ch) {
+      for (size_t site = 0; site < num_sites; ++site) {
+        precomps[ch][site] = -(branch_id * 100.0 + ch * 10.0 + site) / 8.0;
+      }
+    }
+    lookups.init_branch(branch_id, precomps);
+  }
+
+  // gaps in all their variants, leading, trailing and in between
+  const string seq("---ACGT-.?ttNacGRY---");
+  for (const auto range : {Range(0, num_sites), Range(3, 12), Range(5, 1), Range(0, 3)}) {
+    for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+      double expected = 0.0;
+      for (size_t site = range.begin; site < range.begin + range.span; ++site) {
+        expected += -(branch_id * 100.0 + lookups.char_position(seq[site]) * 10.0 + site) / 8.0;
+      }
+      EXPECT_DOUBLE_EQ(expected, lookups.sum_precomputed_sitelk(branch_id, seq, range));
+    }
+  }
+}
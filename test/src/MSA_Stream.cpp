@@ -6,6 +6,8 @@
 #include "io/file_io.hpp"
 
 #include <string>
+#include <algorithm>
+#include <cstdio>
 
 using namespace std;
 
@@ -45,4 +47,29 @@ TEST(MSA_Stream, reading_masked)
     EXPECT_EQ(complete_msa[i], read_msa[i % chunk_size]);
   }
   MSA_Stream dummy;
-}
\ No newline at end of file
+}
+
+TEST(MSA_Stream, read_range)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, true);
+  const size_t chunk_size = 4;
+  const size_t num_chunks = (complete_msa.size() + chunk_size - 1) / chunk_size;
+  MSA read_msa;
+  MSA_Stream streamed_msa(env->combined_file, info, true);
+
+  // out of order, like chunks handed out to MPI ranks
+  for (size_t c = num_chunks; c-- > 0; ) {
+    const size_t begin = c * chunk_size;
+    const auto num = streamed_msa.read_range(read_msa, begin, chunk_size);
+    ASSERT_EQ(std::min(chunk_size, complete_msa.size() - begin), num);
+    for (size_t k = 0; k < num; ++k) {
+      EXPECT_EQ(complete_msa[begin + k], read_msa[k]);
+    }
+  }
+
+  EXPECT_EQ(0u, streamed_msa.read_range(read_msa, complete_msa.size(), chunk_size));
+  EXPECT_EQ(0u, read_msa.size());
+
+  remove(Fasta_Index::index_file_name(env->combined_file).c_str());
+}
@@ -0,0 +1,48 @@
+#include "Epatest.hpp"
+
+#include <vector>
+#include <cmath>
+
+#include "core/pll/Partition_Slices.hpp"
+#include "core/pll/pll_util.hpp"
+#include "io/file_io.hpp"
+#include "tree/Tree.hpp"
+#include "util/Options.hpp"
+#include "core/raxml/Model.hpp"
+
+using namespace std;
+
+static void slices_(const Options options)
+{
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  raxml::Model model;
+  Tree tree(env->tree_file, msa, model, options);
+
+  const auto root = get_root(tree.tree());
+  const auto expected = tree.ref_tree_logl();
+
+  Partition_Slices whole(tree.partition(), 1);
+  whole.update_sumtable(root);
+  double whole_df, whole_ddf;
+  whole.derivatives(root, root->length, &whole_df, &whole_ddf);
+
+  for (unsigned int num_slices : {1u, 2u, 3u, 7u}) {
+    Partition_Slices slices(tree.partition(), num_slices);
+    if (not options.repeats) {
+      EXPECT_EQ(num_slices, slices.size());
+    }
+
+    EXPECT_NEAR(expected, slices.edge_loglikelihood(root), 1e-8 * fabs(expected));
+
+    slices.update_sumtable(root);
+    double df, ddf;
+    slices.derivatives(root, root->length, &df, &ddf);
+    EXPECT_NEAR(whole_df, df, 1e-6 * fabs(whole_df) + 1e-8);
+    EXPECT_NEAR(whole_ddf, ddf, 1e-6 * fabs(whole_ddf) + 1e-8);
+  }
+}
+
+TEST(Partition_Slices, sums_to_partition)
+{
+  all_combinations(slices_);
+}
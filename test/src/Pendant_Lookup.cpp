@@ -0,0 +1,92 @@
+#include "Epatest.hpp"
+
+#include <vector>
+#include <cmath>
+
+#include "core/pll/pll_util.hpp"
+#include "io/file_io.hpp"
+#include "tree/Pendant_Lookup.hpp"
+#include "tree/Tree.hpp"
+#include "util/Options.hpp"
+#include "core/raxml/Model.hpp"
+
+using namespace std;
+
+static void sumtable_(const Options options)
+{
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  auto queries = build_MSA_from_file(env->query_file, MSA_Info(env->query_file), options.premasking);
+  raxml::Model model;
+  Tree tree(env->tree_file, msa, model, options);
+  auto partition = tree.partition();
+
+  if (not Pendant_Lookup::supported(partition)) {
+    return;
+  }
+
+  vector<pll_unode_t*> branches(tree.nums().branches);
+  utree_query_branches(tree.tree(), &branches[0]);
+  vector<unsigned int> param_indices(partition->rate_cats, 0);
+
+  const size_t span = partition->rate_cats * partition->states_padded;
+  vector<double> expected(partition->sites * span);
+  vector<double> expected_other(partition->sites * span);
+
+  for (auto node : branches) {
+    // the inner CLV toward a tip, whose tip states are replaced by the query
+    auto inner = node->next ? node : node->back;
+    auto tip = inner->back;
+    if (tip->next) {
+      continue;
+    }
+
+    Pendant_Lookup lookup(partition, inner->clv_index);
+    ASSERT_TRUE(lookup);
+    // stands in for the inner CLV after the query slid along the branch
+    auto other = inner->next;
+
+    for (auto const& query : queries) {
+      ASSERT_EQ(PLL_SUCCESS, pll_set_tip_states(partition,
+                                                tip->clv_index,
+                                                get_char_map(partition),
+                                                query.sequence().c_str()));
+      pll_update_sumtable(partition,
+                          inner->clv_index,
+                          tip->clv_index,
+                          inner->scaler_index,
+                          tip->scaler_index,
+                          &param_indices[0],
+                          &expected[0]);
+      pll_update_sumtable(partition,
+                          other->clv_index,
+                          tip->clv_index,
+                          other->scaler_index,
+                          tip->scaler_index,
+                          &param_indices[0],
+                          &expected_other[0]);
+
+      Range range(0, partition->sites);
+      if (options.premasking) {
+        range = get_valid_range(query.sequence());
+      }
+
+      lookup.query(query.sequence(), range);
+      auto sumtable = lookup.sumtable();
+      for (size_t i = 0; i < range.span * span; ++i) {
+        const auto e = expected[range.begin * span + i];
+        EXPECT_NEAR(e, sumtable[i], 1e-9 * fabs(e) + 1e-12);
+      }
+
+      sumtable = lookup.sumtable(partition->clv[other->clv_index] + range.begin * span);
+      for (size_t i = 0; i < range.span * span; ++i) {
+        const auto e = expected_other[range.begin * span + i];
+        EXPECT_NEAR(e, sumtable[i], 1e-9 * fabs(e) + 1e-12);
+      }
+    }
+  }
+}
+
+TEST(Pendant_Lookup, sumtable)
+{
+  all_combinations(sumtable_);
+}
@@ -0,0 +1,121 @@
+#include "Epatest.hpp"
+
+#include "pipeline/Bounded_Queue.hpp"
+#include "pipeline/Pipeline.hpp"
+#include "pipeline/Token.hpp"
+
+#include <vector>
+#include <thread>
+#include <stdexcept>
+
+using namespace std;
+
+class Number_Token : public Token
+{
+public:
+  Number_Token() = default;
+  Number_Token(const int n) : n_(n) { }
+  ~Number_Token() = default;
+
+  size_t size() { return 1; }
+  void clear() { n_ = 0; }
+
+  int n_ = 0;
+};
+
+TEST(Bounded_Queue, fifo)
+{
+  Bounded_Queue<int> q(3);
+
+  EXPECT_EQ(3u, q.capacity());
+
+  thread producer([&q]() {
+    for (int i = 0; i < 100; ++i) {
+      q.push(std::move(i));
+    }
+    q.close();
+  });
+
+  int expected = 0;
+  int value;
+  while (q.pop(value)) {
+    EXPECT_EQ(expected, value);
+    EXPECT_LE(q.size(), q.capacity());
+    ++expected;
+  }
+  producer.join();
+
+  EXPECT_EQ(100, expected);
+  EXPECT_FALSE(q.push(1));
+}
+
+TEST(Pipeline, process_concurrent)
+{
+  const int num_chunks = 50;
+  int produced = 0;
+  vector<int> results;
+  bool init = false;
+  bool done = false;
+  // the last stage runs on the calling thread
+  bool on_caller = true;
+  const auto caller = this_thread::get_id();
+
+  auto read = [&](VoidToken&) {
+    Number_Token t(produced);
+    if (++produced > num_chunks) {
+      t.is_last(true);
+    }
+    return t;
+  };
+
+  auto square = [](Number_Token& t) {
+    return Number_Token(t.n_ * t.n_);
+  };
+
+  auto negate = [](Number_Token& t) {
+    return Number_Token(-t.n_);
+  };
+
+  auto write = [&](Number_Token& t) {
+    results.push_back(t.n_);
+    on_caller = on_caller and (this_thread::get_id() == caller);
+    return VoidToken();
+  };
+
+  auto pipe = make_pipeline(read, []{}, [&]{ init = true; }, [&]{ done = true; })
+    .push(square)
+    .push(negate)
+    .push(write);
+
+  pipe.process_concurrent(2);
+
+  EXPECT_TRUE(init);
+  EXPECT_TRUE(done);
+  EXPECT_TRUE(on_caller);
+  ASSERT_EQ(static_cast<size_t>(num_chunks), results.size());
+  for (int i = 0; i < num_chunks; ++i) {
+    EXPECT_EQ(-i * i, results[i]);
+  }
+}
+
+TEST(Pipeline, process_concurrent_error)
+{
+  int produced = 0;
+
+  auto read = [&](VoidToken&) {
+    // never ends by itself
+    return Number_Token(produced++);
+  };
+
+  auto fail = [](Number_Token& t) {
+    if (t.n_ == 10) {
+      throw runtime_error{"stage failure"};
+    }
+    return VoidToken();
+  };
+
+  auto pipe = make_pipeline(read, []{}, []{}, []{})
+    .push(fail);
+
+  EXPECT_THROW(pipe.process_concurrent(), runtime_error);
+}
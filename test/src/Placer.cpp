@@ -0,0 +1,77 @@
+#include "Epatest.hpp"
+
+#include <map>
+#include <string>
+
+#include "core/place.hpp"
+#include "io/file_io.hpp"
+#include "tree/Tree.hpp"
+#include "seq/MSA.hpp"
+#include "sample/Sample.hpp"
+#include "util/Options.hpp"
+
+using namespace std;
+
+using placement_map = map<size_t, map<size_t, double>>;
+
+static placement_map to_map(const Sample<Placement>& sample)
+{
+  placement_map result;
+  for (auto const& pq : sample) {
+    for (auto const& p : pq) {
+      result[pq.sequence_id()][p.branch_id()] = p.likelihood();
+    }
+  }
+  return result;
+}
+
+static void place_(const Options options)
+{
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  auto queries = build_MSA_from_file(env->query_file, MSA_Info(env->query_file), options.premasking);
+
+  Tree tree(env->tree_file, msa, env->model, options);
+  Placer placer(tree, options);
+
+  const size_t offset = 42;
+  auto first = placer.place(queries, offset);
+  // the state carried over from the first batch must not change the result
+  auto second = placer.place(queries, offset);
+
+  ASSERT_EQ(queries.size(), first.size());
+  EXPECT_GT(placer.last_work_size(), 0u);
+
+  for (auto const& pq : first) {
+    EXPECT_GE(pq.sequence_id(), offset);
+    EXPECT_LT(pq.sequence_id(), offset + queries.size());
+    EXPECT_EQ(queries[pq.sequence_id() - offset].header(), pq.header());
+    ASSERT_GT(pq.size(), 0u);
+
+    double lwr_sum = 0.0;
+    for (auto const& p : pq) {
+      lwr_sum += p.lwr();
+    }
+    EXPECT_LE(lwr_sum, 1.0 + 1e-9);
+    EXPECT_GT(lwr_sum, 0.0);
+  }
+
+  const auto first_map = to_map(first);
+  const auto second_map = to_map(second);
+  ASSERT_EQ(first_map.size(), second_map.size());
+  for (auto const& pq : first_map) {
+    auto const& other = second_map.at(pq.first);
+    ASSERT_EQ(pq.second.size(), other.size());
+    for (auto const& p : pq.second) {
+      EXPECT_DOUBLE_EQ(p.second, other.at(p.first));
+    }
+  }
+
+  // empty batches are fine, too
+  MSA empty;
+  EXPECT_EQ(0u, placer.place(empty).size());
+}
+
+TEST(Placer, place)
+{
+  all_combinations(place_);
+}
@@ -0,0 +1,58 @@
+#include "Epatest.hpp"
+
+#include <cstdio>
+
+#include "io/Reference_Cache.hpp"
+#include "io/msa_reader.hpp"
+#include "tree/Tree.hpp"
+#include "util/Options.hpp"
+#include "core/raxml/Model.hpp"
+
+using namespace std;
+
+TEST(Reference_Cache, key)
+{
+  Options options;
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+
+  Reference_Cache cache(env->out_dir, env->tree_file, msa, "GTR+G", options);
+  Reference_Cache same(env->out_dir, env->tree_file, msa, "GTR+G", options);
+  EXPECT_EQ(cache.key(), same.key());
+  EXPECT_EQ(cache.file_name(), same.file_name());
+  EXPECT_EQ(0u, cache.file_name().find(env->out_dir));
+
+  Reference_Cache other_model(env->out_dir, env->tree_file, msa, "GTR+G+FC", options);
+  EXPECT_NE(cache.key(), other_model.key());
+
+  Reference_Cache other_tree(env->out_dir, env->tree_file_rooted, msa, "GTR+G", options);
+  EXPECT_NE(cache.key(), other_tree.key());
+
+  options.repeats = not options.repeats;
+  Reference_Cache other_options(env->out_dir, env->tree_file, msa, "GTR+G", options);
+  EXPECT_NE(cache.key(), other_options.key());
+}
+
+static void store_and_load_(const Options options)
+{
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  raxml::Model model;
+
+  Reference_Cache cache(env->out_dir, env->tree_file_rooted, msa, "GTR+G", options);
+  std::remove(cache.file_name().c_str());
+  ASSERT_FALSE(cache.contains());
+
+  Tree built(env->tree_file_rooted, msa, model, options);
+  cache.store(built);
+  ASSERT_TRUE(cache.contains());
+
+  auto loaded = cache.load(model, options);
+  EXPECT_DOUBLE_EQ(built.ref_tree_logl(), loaded.ref_tree_logl());
+  EXPECT_EQ(built.mapper().map(), loaded.mapper().map());
+
+  std::remove(cache.file_name().c_str());
+}
+
+TEST(Reference_Cache, store_and_load)
+{
+  all_combinations(store_and_load_);
+}
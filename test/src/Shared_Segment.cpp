@@ -0,0 +1,108 @@
+#include "Epatest.hpp"
+
+#include "net/Shared_Segment.hpp"
+#include "net/mpihead.hpp"
+#include "core/Lookup_Store.hpp"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * Meaningful with several ranks on one machine, e.g.
+ *    mpirun -n 4 ./test/bin/epa_test Shared_Segment.*
+ */
+TEST(Shared_Segment, owner_writes_everyone_reads)
+{
+  const size_t num = 1000;
+  Shared_Segment segment(num * sizeof(double));
+  ASSERT_GE(segment.size(), num * sizeof(double));
+
+  auto data = static_cast<double*>(segment.data());
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(data) % 64);
+
+  if (segment.owner()) {
+    for (size_t i = 0; i < num; ++i) {
+      data[i] = i * 0.5;
+    }
+  }
+  segment.barrier();
+
+  for (size_t i = 0; i < num; ++i) {
+    ASSERT_DOUBLE_EQ(i * 0.5, data[i]);
+  }
+  segment.barrier();
+}
+
+TEST(Shared_Segment, lookup_store)
+{
+  const size_t num_branches = 7;
+  const size_t num_sites = 10;
+
+  Lookup_Store lookups(num_branches, 4);
+  lookups.share_across_node(num_sites);
+  const auto size = lookups.char_map_size();
+
+  // every rank initializes every branch, but the tables only exist once
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    vector<vector<double>> precomps(size, vector<double>(num_sites));
+    for (size_t ch = 0; ch < size; ++ch) {
+      for (size_t site = 0; site < num_sites; ++site) {
+        precomps[ch][site] = branch_id * 100.0 + ch * 10.0 + site;
+      }
+    }
+    if (not lookups.has_branch(branch_id)) {
+      lookups.init_branch(branch_id, precomps);
+    }
+    ASSERT_TRUE(lookups.has_branch(branch_id));
+  }
+
+  const string seq("ACGTACGTAC");
+  const Range range(0, num_sites);
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    double expected = 0.0;
+    for (size_t site = 0; site < num_sites; ++site) {
+      expected += branch_id * 100.0 + lookups.char_position(seq[site]) * 10.0 + site;
+    }
+    EXPECT_DOUBLE_EQ(expected, lookups.sum_precomputed_sitelk(branch_id, seq, range));
+  }
+
+  MPI_BARRIER(MPI_COMM_WORLD);
+}
+
+TEST(Shared_Segment, lookup_store_claims)
+{
+  const size_t num_branches = 7;
+  const size_t num_sites = 10;
+
+  Lookup_Store lookups(num_branches, 4);
+  lookups.share_across_node(num_sites);
+  const auto size = lookups.char_map_size();
+
+  // only the rank that claims a branch computes its table
+  int claims = 0;
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    if (lookups.claim_branch(branch_id)) {
+      ++claims;
+      vector<vector<double>> precomps(size, vector<double>(num_sites, branch_id * 1.0));
+      lookups.init_branch(branch_id, precomps);
+    }
+    ASSERT_TRUE(lookups.has_branch(branch_id));
+    EXPECT_FALSE(lookups.claim_branch(branch_id));
+  }
+
+  #ifdef __MPI
+  // once per machine
+  Shared_Segment segment(1);
+  MPI_Allreduce(MPI_IN_PLACE, &claims, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  int num_ranks = 1;
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+  EXPECT_EQ(static_cast<int>(num_branches) * num_ranks / segment.node_size(), claims);
+  #else
+  EXPECT_EQ(static_cast<int>(num_branches), claims);
+  #endif
+
+  MPI_BARRIER(MPI_COMM_WORLD);
+}
@@ -0,0 +1,41 @@
+#include "Epatest.hpp"
+
+#include "seq/Site_Patterns.hpp"
+#include "seq/MSA.hpp"
+
+using namespace std;
+
+TEST(Site_Patterns, compress)
+{
+  MSA msa;
+  msa.append("a", "ACAGTA-");
+  msa.append("b", "AGAGTA-");
+  msa.append("c", "TCTCTT-");
+
+  Site_Patterns patterns(msa);
+
+  EXPECT_EQ(7u, patterns.num_sites());
+  EXPECT_EQ(5u, patterns.num_patterns());
+
+  vector<unsigned int> expected_map({0, 1, 0, 2, 3, 0, 4});
+  EXPECT_EQ(expected_map, patterns.map());
+  vector<unsigned int> expected_weights({3, 1, 1, 1, 1});
+  EXPECT_EQ(expected_weights, patterns.weights());
+
+  auto compressed = patterns.compress(msa);
+  ASSERT_EQ(msa.size(), compressed.size());
+  EXPECT_EQ(5u, compressed.num_sites());
+  EXPECT_EQ("a", compressed[0].header());
+  EXPECT_EQ("ACGT-", compressed[0].sequence());
+  EXPECT_EQ("AGGT-", compressed[1].sequence());
+  EXPECT_EQ("TCCT-", compressed[2].sequence());
+
+  // every site is its own pattern
+  MSA distinct;
+  distinct.append("a", "ACGT");
+  distinct.append("b", "ACGT");
+  Site_Patterns none(distinct);
+  EXPECT_EQ(4u, none.num_patterns());
+  EXPECT_FALSE(Site_Patterns());
+  EXPECT_TRUE(none);
+}
@@ -36,4 +36,14 @@ TEST(Timer, construct_from_avg)
 
   ASSERT_DOUBLE_EQ(tt.average(), t.average());
 
-}
\ No newline at end of file
+}
+
+TEST(Timer, seconds)
+{
+  Timer<std::chrono::milliseconds> t(std::chrono::milliseconds(1500));
+  const Timer<std::chrono::milliseconds> other(std::chrono::milliseconds(1500));
+  t.insert(t.end(), other.begin(), other.end());
+
+  ASSERT_DOUBLE_EQ(t.sum(), 3000.0);
+  ASSERT_DOUBLE_EQ(t.seconds(), 3.0);
+}
@@ -13,9 +13,12 @@
 #include "set_manipulators.hpp"
 #include "core/raxml/Model.hpp"
 #include "core/Lookup_Store.hpp"
+#include "util/Timer.hpp"
 
 #include <tuple>
 #include <limits>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -190,3 +193,173 @@ TEST(Tiny_Tree, place_from_binary)
   // o.repeats = true;
   // place_from_binary(o);
 }
+
+static void site_patterns_(Options options)
+{
+  if (options.repeats) {
+    return;
+  }
+
+  // buildup
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  auto queries = build_MSA_from_file(env->query_file, MSA_Info(env->query_file), options.premasking);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+  options.compress_patterns = true;
+  auto compressed_tree = Tree(env->tree_file, msa, env->model, options);
+
+  ASSERT_TRUE(compressed_tree.patterns());
+  EXPECT_EQ(ref_tree.num_sites(), compressed_tree.num_sites());
+  EXPECT_LE(compressed_tree.partition()->sites, ref_tree.partition()->sites);
+  EXPECT_NEAR(ref_tree.ref_tree_logl(), compressed_tree.ref_tree_logl(), 1e-6);
+
+  // tests
+  for (const bool opt_branches : {false, true}) {
+    shared_ptr<Lookup_Store> lookup(new Lookup_Store(ref_tree.nums().branches,
+                                                     ref_tree.partition()->states));
+    shared_ptr<Lookup_Store> compressed_lookup(new Lookup_Store(compressed_tree.nums().branches,
+                                                                compressed_tree.partition()->states));
+    compressed_lookup->use_site_patterns(compressed_tree.patterns().map());
+
+    Tiny_Tree tt(get_root(ref_tree.tree()), 0, ref_tree, opt_branches, options, lookup);
+    Tiny_Tree compressed_tt(get_root(compressed_tree.tree()), 0, compressed_tree, opt_branches,
+                            options, compressed_lookup);
+
+    for (auto const &x : queries) {
+      auto place = tt.place(x);
+      auto compressed_place = compressed_tt.place(x);
+      EXPECT_NEAR(place.likelihood(), compressed_place.likelihood(), 1e-6);
+      EXPECT_NEAR(place.pendant_length(), compressed_place.pendant_length(), 1e-6);
+      EXPECT_NEAR(place.distal_length(), compressed_place.distal_length(), 1e-6);
+    }
+  }
+}
+
+TEST(Tiny_Tree, site_patterns)
+{
+  all_combinations(site_patterns_);
+}
+
+static void shared_reference_(const Options options)
+{
+  // buildup
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  auto queries = build_MSA_from_file(env->query_file, MSA_Info(env->query_file), options.premasking);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+  auto partition = ref_tree.partition();
+
+  shared_ptr<Lookup_Store> lookup(new Lookup_Store(ref_tree.nums().branches, partition->states));
+
+  auto root = get_root(ref_tree.tree());
+  const size_t clv_size = partition->sites * partition->rate_cats * partition->states_padded;
+
+  // the tiny trees only point to the reference buffers around their branch
+  vector<vector<double>> clvs;
+  vector<vector<unsigned int>> scalers;
+  for (auto node : {root, root->back}) {
+    if (not node->next or partition->attributes & PLL_ATTRIB_SITE_REPEATS) {
+      continue;
+    }
+    const auto clv = static_cast<double*>(ref_tree.get_clv(node));
+    clvs.emplace_back(clv, clv + clv_size);
+    if (node->scaler_index != PLL_SCALE_BUFFER_NONE) {
+      const auto scaler = partition->scale_buffer[node->scaler_index];
+      scalers.emplace_back(scaler, scaler + partition->sites);
+    }
+  }
+
+  // tests
+  {
+    Tiny_Tree tt(root, 0, ref_tree, true, options, lookup);
+    for (auto const &x : queries) {
+      tt.place(x);
+    }
+  }
+
+  size_t clv_id = 0;
+  size_t scaler_id = 0;
+  for (auto node : {root, root->back}) {
+    if (not node->next or partition->attributes & PLL_ATTRIB_SITE_REPEATS) {
+      continue;
+    }
+    const auto clv = static_cast<double*>(ref_tree.get_clv(node));
+    EXPECT_TRUE(std::equal(clvs[clv_id].begin(), clvs[clv_id].end(), clv));
+    ++clv_id;
+    if (node->scaler_index != PLL_SCALE_BUFFER_NONE) {
+      const auto scaler = partition->scale_buffer[node->scaler_index];
+      EXPECT_TRUE(std::equal(scalers[scaler_id].begin(), scalers[scaler_id].end(), scaler));
+      ++scaler_id;
+    }
+  }
+}
+
+TEST(Tiny_Tree, shared_reference)
+{
+  all_combinations(shared_reference_);
+}
+
+// repeats every sequence until it is <width> sites long
+static MSA tile(const MSA& msa, const size_t width)
+{
+  MSA wide(width);
+  for (auto const& s : msa) {
+    string seq;
+    while (seq.length() < width) {
+      seq += s.sequence();
+    }
+    seq.resize(width);
+    wide.append(s.header(), seq);
+  }
+  return wide;
+}
+
+// time per query and branch for short reads on a wide alignment, run explicitly via
+// --gtest_also_run_disabled_tests --gtest_filter=Tiny_Tree.DISABLED_focused_benchmark
+TEST(Tiny_Tree, DISABLED_focused_benchmark)
+{
+  const size_t width = 50000;
+  const size_t num_branches = 10;
+
+  Options options;
+  auto msa = tile(build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), false), width);
+  auto queries = tile(build_MSA_from_file(env->query_file, MSA_Info(env->query_file), false), width);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+  shared_ptr<Lookup_Store> lookup(new Lookup_Store(ref_tree.nums().branches, ref_tree.partition()->states));
+
+  vector<pll_unode_t*> branches(ref_tree.nums().branches);
+  utree_query_branches(ref_tree.tree(), &branches[0]);
+  branches.resize(std::min(num_branches, branches.size()));
+
+  for (const size_t length : {100u, 300u, 1500u}) {
+    // reads from the middle of the alignment
+    const size_t begin = (width - length) / 2;
+    MSA reads(width);
+    for (auto const& q : queries) {
+      string seq(width, '-');
+      seq.replace(begin, length, q.sequence(), begin, length);
+      if (seq.find_first_not_of('-') != string::npos) {
+        reads.append(q.header(), seq);
+      }
+    }
+    ASSERT_GT(reads.size(), 0u);
+
+    for (const bool opt_branches : {false, true}) {
+      Timer<std::chrono::microseconds> timer;
+      for (size_t branch_id = 0; branch_id < branches.size(); ++branch_id) {
+        Tiny_Tree tt(branches[branch_id], branch_id, ref_tree, opt_branches, options, lookup);
+        timer.start();
+        for (auto const& x : reads) {
+          tt.place(x);
+        }
+        timer.stop();
+      }
+      printf( "%s, %zu bp reads on %zu sites: %.2f us per query and branch\n",
+              opt_branches ? "thorough  " : "prescoring",
+              length,
+              width,
+              timer.sum() / (reads.size() * branches.size()));
+    }
+  }
+}
@@ -0,0 +1,128 @@
+#include "Epatest.hpp"
+
+#ifdef __MPI
+
+#include "net/Work_Distributor.hpp"
+#include "net/epa_mpi_util.hpp"
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+TEST(Work_Distributor, every_chunk_once)
+{
+  const size_t num_sequences = 1003;
+  const size_t chunk_size = 10;
+  const size_t header_bytes = 42;
+
+  Work_Distributor distributor(num_sequences, chunk_size, header_bytes);
+  ASSERT_EQ(101u, distributor.num_chunks());
+  EXPECT_EQ(3u, distributor.chunk_length(100));
+  EXPECT_EQ(0u, distributor.chunk_length(101));
+
+  // every chunk "produces" as many bytes as its id + 1 (nothing for every
+  // seventh), which lets us check that the outputs are laid out in chunk order
+  const auto bytes = [](const size_t chunk_id) {
+    return chunk_id % 7 == 3 ? 0u : chunk_id + 1;
+  };
+  vector<int> seen(distributor.num_chunks(), 0);
+  vector<Work_Distributor::Slot> slots;
+  size_t prev_bytes = 0;
+
+  while (true) {
+    auto ticket = distributor.next(prev_bytes);
+    slots.insert(slots.end(), ticket.slots.begin(), ticket.slots.end());
+    if (not ticket.has_chunk) {
+      break;
+    }
+    ASSERT_LT(ticket.chunk_id, distributor.num_chunks());
+    seen[ticket.chunk_id] += 1;
+    prev_bytes = bytes(ticket.chunk_id);
+  }
+
+  const auto total = distributor.finish(slots);
+
+  const size_t n = distributor.num_chunks();
+  vector<size_t> expected(n + 1, header_bytes);
+  for (size_t i = 0; i < n; ++i) {
+    expected[i + 1] = expected[i] + bytes(i);
+  }
+  EXPECT_EQ(expected[n], total);
+
+  MPI_Allreduce(MPI_IN_PLACE, seen.data(), seen.size(), MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  for (const auto s : seen) {
+    EXPECT_EQ(1, s);
+  }
+
+  // every non-empty output of this rank gets exactly one slot, at its place in chunk order
+  vector<int> written(n, 0);
+  unsigned long local_firsts = 0;
+  for (auto const& slot : slots) {
+    ASSERT_LT(slot.chunk_id, n);
+    EXPECT_NE(0u, bytes(slot.chunk_id));
+    EXPECT_EQ(expected[slot.chunk_id], slot.offset);
+    EXPECT_EQ(slot.chunk_id == 0, slot.first_block);
+    written[slot.chunk_id] += 1;
+    local_firsts += slot.first_block;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, written.data(), written.size(), MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(bytes(i) ? 1 : 0, written[i]);
+  }
+
+  unsigned long all_firsts = 0;
+  MPI_Allreduce(&local_firsts, &all_firsts, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(1u, all_firsts);
+}
+
+TEST(Work_Distributor, stall_for_slots)
+{
+  const size_t num_sequences = 500;
+  const size_t chunk_size = 5;
+  const size_t max_pending = 2;
+
+  Work_Distributor distributor(num_sequences, chunk_size, 0);
+
+  // like place_distributed: stop taking chunks while too many outputs wait
+  // for their slot
+  vector<int> seen(distributor.num_chunks(), 0);
+  vector<Work_Distributor::Slot> slots;
+  bool has_chunk = false;
+  size_t pending = 0;
+
+  while (true) {
+    pending += has_chunk;
+    auto wants_chunk = pending < max_pending;
+    auto ticket = distributor.next(1, wants_chunk);
+    pending -= ticket.slots.size();
+    slots.insert(slots.end(), ticket.slots.begin(), ticket.slots.end());
+
+    while (not wants_chunk) {
+      wants_chunk = pending < max_pending;
+      ticket = distributor.next(0, wants_chunk);
+      pending -= ticket.slots.size();
+      slots.insert(slots.end(), ticket.slots.begin(), ticket.slots.end());
+    }
+
+    has_chunk = ticket.has_chunk;
+    if (not has_chunk) {
+      break;
+    }
+    seen[ticket.chunk_id] += 1;
+  }
+
+  const auto total = distributor.finish(slots);
+  EXPECT_EQ(distributor.num_chunks(), total);
+
+  MPI_Allreduce(MPI_IN_PLACE, seen.data(), seen.size(), MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  for (const auto s : seen) {
+    EXPECT_EQ(1, s);
+  }
+
+  for (auto const& slot : slots) {
+    EXPECT_EQ(slot.chunk_id, slot.offset);
+  }
+}
+
+#endif
@@ -18,3 +18,44 @@ TEST(encoding, 4bit)
   // printf("%s\n", input.c_str());
   // printf("%s\n", unpacked.c_str());
 }
+
+TEST(encoding, 4bit_decode_in_place)
+{
+  FourBit converter;
+  const std::string input("AATGCTTCGTAA---NNNATTCBDAVMKWYR");
+
+  auto packed = converter.to_fourbit(input);
+
+  std::string decoded(input.size(), '$');
+  converter.decode(packed.data(), input.size(), &decoded[0]);
+  EXPECT_EQ(input, decoded);
+
+  // decode only some sites, as done when applying a gap mask
+  const std::vector<size_t> sites({0, 3, 4, 12, 13, 30});
+  std::string subset(sites.size(), '$');
+  converter.decode_sites(packed.data(), sites, &subset[0]);
+  EXPECT_EQ(std::string("AGC--R"), subset);
+}
+
+TEST(encoding, 5bit)
+{
+  FiveBit converter;
+  // 31 characters: not a multiple of the 8 character block size
+  const std::string input("ACDEFGHIKLMNPQRSTVWY-XBZJUO*?.a");
+
+  auto packed = converter.to_fivebit(input);
+  EXPECT_EQ(converter.packed_size(input.size()), packed.size());
+  EXPECT_EQ(20u, packed.size());
+
+  auto unpacked = converter.from_fivebit(packed, input.size());
+  EXPECT_STRCASEEQ(input.c_str(), unpacked.c_str());
+
+  const std::vector<size_t> sites({0, 7, 8, 15, 20, 30});
+  std::string subset(sites.size(), '$');
+  converter.decode_sites(packed.data(), input.size(), sites, &subset[0]);
+  EXPECT_EQ(std::string("AIKS-A"), subset);
+
+  EXPECT_TRUE(converter.valid('w'));
+  EXPECT_FALSE(converter.valid('1'));
+  EXPECT_ANY_THROW(converter.to_fivebit("AC1D"));
+}
@@ -0,0 +1,225 @@
+#include "Epatest.hpp"
+
+#ifdef __MPI
+
+#include "net/epa_mpi_util.hpp"
+#include "sample/Sample.hpp"
+#include "core/Work.hpp"
+#include "util/Timer.hpp"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Run with at least two ranks, e.g.
+ *    mpirun -n 2 ./test/bin/epa_test epa_mpi_util.*
+ */
+
+static Sample<Placement> make_sample(const size_t num_pqueries, const size_t num_placements)
+{
+  Sample<Placement> sample("((a,b),c);");
+  for (size_t i = 0; i < num_pqueries; ++i) {
+    // every so often an empty pquery or header, to cover the corner cases
+    sample.add_pquery(i * 3, (i % 5) ? "query_" + to_string(i) : "");
+    for (size_t j = 0; j < (i % 7 ? num_placements : 0); ++j) {
+      sample.back().emplace_back(j, -10.0 * i - j, 0.1 * j, 0.01 * i);
+      sample.back().back().lwr(1.0 / (j + 1));
+    }
+  }
+  return sample;
+}
+
+static void expect_equal(Sample<Placement>& expected, Sample<Placement>& actual)
+{
+  ASSERT_EQ(expected.size(), actual.size());
+  EXPECT_EQ(expected.newick(), actual.newick());
+  EXPECT_EQ(expected.status(), actual.status());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    auto& lhs = expected[i];
+    auto& rhs = actual[i];
+    EXPECT_EQ(lhs.sequence_id(), rhs.sequence_id());
+    EXPECT_EQ(lhs.header(), rhs.header());
+    ASSERT_EQ(lhs.size(), rhs.size());
+    for (size_t j = 0; j < lhs.size(); ++j) {
+      EXPECT_EQ(lhs[j].branch_id(), rhs[j].branch_id());
+      EXPECT_DOUBLE_EQ(lhs[j].likelihood(), rhs[j].likelihood());
+      EXPECT_DOUBLE_EQ(lhs[j].lwr(), rhs[j].lwr());
+      EXPECT_DOUBLE_EQ(lhs[j].pendant_length(), rhs[j].pendant_length());
+      EXPECT_DOUBLE_EQ(lhs[j].distal_length(), rhs[j].distal_length());
+    }
+  }
+}
+
+static bool two_ranks(int& rank)
+{
+  int size = 1;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  return size >= 2;
+}
+
+TEST(epa_mpi_util, flat_sample)
+{
+  int rank = 0;
+  if (not two_ranks(rank)) {
+    return;
+  }
+
+  auto expected = make_sample(50, 7);
+  expected.is_last(true);
+  stage_timer timer;
+
+  if (rank == 0) {
+    auto sample = expected;
+    epa_mpi_send(sample, 1, MPI_COMM_WORLD);
+
+    // async, from a temporary
+    request_tuple req;
+    epa_mpi_isend(make_sample(50, 7), 1, MPI_COMM_WORLD, req, timer);
+    epa_mpi_wait(req);
+  } else if (rank == 1) {
+    Sample<Placement> blocking;
+    epa_mpi_receive(blocking, 0, MPI_COMM_WORLD, timer);
+    expect_equal(expected, blocking);
+
+    Sample<Placement> async;
+    epa_mpi_receive(async, MPI_ANY_SOURCE, MPI_COMM_WORLD, timer);
+    expected.status(token_status::DATA);
+    expect_equal(expected, async);
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+TEST(epa_mpi_util, flat_work)
+{
+  int rank = 0;
+  if (not two_ranks(rank)) {
+    return;
+  }
+
+  Work expected(std::make_pair(3, 9), std::make_pair(100, 150));
+  expected.add(42, 7);
+  stage_timer timer;
+
+  if (rank == 0) {
+    epa_mpi_send(expected, 1, MPI_COMM_WORLD);
+  } else if (rank == 1) {
+    Work work;
+    work.add(1, 1);
+    epa_mpi_receive(work, 0, MPI_COMM_WORLD, timer);
+
+    EXPECT_EQ(expected.size(), work.size());
+    for (auto it = expected.bin_begin(); it != expected.bin_end(); ++it) {
+      EXPECT_EQ(it->second, work.at(it->first));
+    }
+    EXPECT_ANY_THROW(work.at(1));
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+struct Archived
+{
+  int a = 0;
+  int b = 0;
+
+  template <class Archive>
+  void serialize( Archive & ar )
+  { ar( a, b ); }
+};
+
+TEST(epa_mpi_util, archive_after_flat)
+{
+  int rank = 0;
+  if (not two_ranks(rank)) {
+    return;
+  }
+
+  Work expected(std::make_pair(3, 9), std::make_pair(100, 150));
+  stage_timer timer;
+
+  if (rank == 0) {
+    // the flat message is pending when the other one is received
+    request_tuple req;
+    epa_mpi_isend(Work(expected), 1, MPI_COMM_WORLD, req, timer);
+    Archived archived;
+    archived.a = 4;
+    archived.b = 2;
+    epa_mpi_send(archived, 1, MPI_COMM_WORLD);
+    epa_mpi_wait(req);
+  } else if (rank == 1) {
+    Archived archived;
+    epa_mpi_receive(archived, 0, MPI_COMM_WORLD, timer);
+    EXPECT_EQ(4, archived.a);
+    EXPECT_EQ(2, archived.b);
+
+    Work work;
+    epa_mpi_receive(work, 0, MPI_COMM_WORLD, timer);
+    EXPECT_EQ(expected.size(), work.size());
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+template <class Send, class Receive>
+static double ping_pong(Sample<Placement>& sample,
+                        const int rank,
+                        const size_t rounds,
+                        Send send,
+                        Receive receive)
+{
+  stage_timer dummy;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rounds; ++i) {
+    if (rank == 0) {
+      send(sample, 1, MPI_COMM_WORLD);
+      receive(sample, 1, MPI_COMM_WORLD, dummy);
+    } else if (rank == 1) {
+      receive(sample, 0, MPI_COMM_WORLD, dummy);
+      send(sample, 0, MPI_COMM_WORLD);
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / rounds;
+}
+
+/**
+ * Compares the flat wire format against the cereal path, on a sample the size of
+ * a typical chunk coming out of the prescoring stage.
+ */
+TEST(epa_mpi_util, ping_pong_benchmark)
+{
+  int rank = 0;
+  if (not two_ranks(rank)) {
+    return;
+  }
+
+  const size_t rounds = 20;
+  const auto expected = make_sample(5000, 20);
+
+  auto flat_sample = expected;
+  const auto flat = ping_pong(flat_sample, rank, rounds,
+                              epa_mpi_send_flat<Sample<Placement>>,
+                              epa_mpi_receive_flat<Sample<Placement>>);
+
+  auto archive_sample = expected;
+  const auto archive = ping_pong(archive_sample, rank, rounds,
+                                 epa_mpi_send_archive<Sample<Placement>>,
+                                 epa_mpi_receive_archive<Sample<Placement>>);
+
+  if (rank < 2) {
+    auto copy = expected;
+    expect_equal(copy, flat_sample);
+    expect_equal(copy, archive_sample);
+  }
+
+  if (rank == 0) {
+    cout << "Ping-pong of a " << expected.size() << " pquery sample: flat "
+         << flat << " ms, cereal " << archive << " ms per round trip" << endl;
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+#endif
@@ -151,6 +151,44 @@ TEST(epa_pll_util, precompute_clvs)
   precompute_clvs_test(o);
 }
 
+TEST(epa_pll_util, precompute_clvs_parallel)
+{
+  // the first level of the precomputation is all cherries, which must not
+  // race for the tip-tip lookup table of pattern tip partitions
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), true);
+  raxml::Model model;
+  Options o;
+  o.repeats = false;
+
+  Tree_Numbers nums;
+  rtree_mapper dummy;
+  pll_utree_t * trees[2];
+  pll_partition_t * parts[2];
+  for (size_t i = 0; i < 2; ++i) {
+    trees[i] = build_tree_from_file( env->tree_file, nums, dummy );
+    parts[i] = make_partition( model, nums, msa.num_sites(), o );
+    set_unique_clv_indices(get_root(trees[i]), nums.tip_nodes);
+    link_tree_msa(trees[i], parts[i], model, msa, nums.tip_nodes);
+  }
+  ASSERT_TRUE(parts[0]->attributes & PLL_ATTRIB_PATTERN_TIP);
+
+  precompute_clvs(trees[0], parts[0], nums, true, 1);
+  precompute_clvs(trees[1], parts[1], nums, true, 4);
+
+  const size_t span = parts[0]->sites * parts[0]->rate_cats * parts[0]->states_padded;
+  for (size_t c = parts[0]->tips; c < parts[0]->tips + parts[0]->clv_buffers; ++c) {
+    for (size_t j = 0; j < span; ++j) {
+      ASSERT_EQ(parts[0]->clv[c][j], parts[1]->clv[c][j]) << "CLV " << c << ", entry " << j;
+    }
+  }
+
+  for (size_t i = 0; i < 2; ++i) {
+    utree_free_node_data(get_root(trees[i]));
+    pll_partition_destroy(parts[i]);
+    pll_utree_destroy(trees[i], nullptr);
+  }
+}
+
 TEST(epa_pll_util, split_combined_msa)
 {
   // buildup
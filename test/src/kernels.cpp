@@ -0,0 +1,134 @@
+#include "Epatest.hpp"
+
+#include <vector>
+#include <cmath>
+
+#include "core/pll/kernels.hpp"
+#include "core/pll/pll_util.hpp"
+#include "io/file_io.hpp"
+#include "tree/Tree.hpp"
+#include "util/Options.hpp"
+#include "core/raxml/Model.hpp"
+
+using namespace std;
+
+static void expect_close(const double expected, const double actual)
+{
+  EXPECT_NEAR(expected, actual, 1e-9 * fabs(expected) + 1e-12);
+}
+
+static void kernels_(const Options options)
+{
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  raxml::Model model;
+  Tree tree(env->tree_file, msa, model, options);
+  auto partition = tree.partition();
+
+  vector<pll_unode_t*> branches(tree.nums().branches);
+  utree_query_branches(tree.tree(), &branches[0]);
+  vector<unsigned int> param_indices(partition->rate_cats, 0);
+
+  const size_t sumtable_size = partition->sites * partition->rate_cats * partition->states_padded;
+  vector<double> expected_sumtable(sumtable_size);
+  vector<double> sumtable(sumtable_size);
+  vector<double> expected_persite(partition->sites);
+  vector<double> persite(partition->sites);
+
+  // tip branches included, to cover the tipchars
+  for (auto node : branches) {
+    auto expected = pll_compute_edge_loglikelihood( partition,
+                                                    node->clv_index,
+                                                    node->scaler_index,
+                                                    node->back->clv_index,
+                                                    node->back->scaler_index,
+                                                    node->pmatrix_index,
+                                                    &param_indices[0],
+                                                    &expected_persite[0]);
+    auto logl = kernel_edge_loglikelihood(partition,
+                                          node->clv_index,
+                                          node->scaler_index,
+                                          node->back->clv_index,
+                                          node->back->scaler_index,
+                                          node->pmatrix_index,
+                                          &param_indices[0],
+                                          &persite[0]);
+    expect_close(expected, logl);
+    for (size_t i = 0; i < persite.size(); ++i) {
+      expect_close(expected_persite[i], persite[i]);
+    }
+
+    pll_update_sumtable(partition,
+                        node->clv_index,
+                        node->back->clv_index,
+                        node->scaler_index,
+                        node->back->scaler_index,
+                        &param_indices[0],
+                        &expected_sumtable[0]);
+    kernel_update_sumtable( partition,
+                            node->clv_index,
+                            node->back->clv_index,
+                            node->scaler_index,
+                            node->back->scaler_index,
+                            &param_indices[0],
+                            &sumtable[0]);
+
+    for (auto length : {0.001, node->length, 0.5}) {
+      double expected_df, expected_ddf, df, ddf;
+      pll_compute_likelihood_derivatives( partition,
+                                          node->scaler_index,
+                                          node->back->scaler_index,
+                                          length,
+                                          &param_indices[0],
+                                          &expected_sumtable[0],
+                                          &expected_df,
+                                          &expected_ddf);
+      kernel_likelihood_derivatives(partition,
+                                    node->scaler_index,
+                                    node->back->scaler_index,
+                                    length,
+                                    &param_indices[0],
+                                    &sumtable[0],
+                                    &df,
+                                    &ddf);
+      EXPECT_NEAR(expected_df, df, 1e-7 * fabs(expected_df) + 1e-9);
+      EXPECT_NEAR(expected_ddf, ddf, 1e-7 * fabs(expected_ddf) + 1e-9);
+    }
+  }
+
+  // site repeats store the CLVs per repeat class
+  if (partition->attributes & PLL_ATTRIB_SITE_REPEATS) {
+    return;
+  }
+
+  // recomputing the (current) CLVs of every inner direction must not change them
+  const size_t clv_size = partition->sites * partition->rate_cats * partition->states_padded;
+  for (auto node : branches) {
+    for (auto side : {node, node->back}) {
+      if (not side->next) {
+        continue;
+      }
+      const vector<double> expected_clv(partition->clv[side->clv_index],
+                                        partition->clv[side->clv_index] + clv_size);
+
+      pll_operation_t op;
+      op.parent_clv_index    = side->clv_index;
+      op.parent_scaler_index = side->scaler_index;
+      op.child1_clv_index    = side->next->back->clv_index;
+      op.child1_scaler_index = side->next->back->scaler_index;
+      op.child1_matrix_index = side->next->back->pmatrix_index;
+      op.child2_clv_index    = side->next->next->back->clv_index;
+      op.child2_scaler_index = side->next->next->back->scaler_index;
+      op.child2_matrix_index = side->next->next->back->pmatrix_index;
+      kernel_update_partials(partition, &op, 1);
+
+      for (size_t i = 0; i < clv_size; ++i) {
+        expect_close(expected_clv[i], partition->clv[side->clv_index][i]);
+      }
+    }
+  }
+}
+
+TEST(kernels, match_libpll)
+{
+  all_combinations(kernels_);
+}
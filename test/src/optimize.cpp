@@ -1,8 +1,11 @@
 #include "Epatest.hpp"
 
 #include <vector>
+#include <cmath>
 
 #include "core/pll/optimize.hpp"
+#include "core/pll/pll_util.hpp"
+#include "core/pll/rtree_mapper.hpp"
 #include "core/pll/epa_pll_util.hpp"
 #include "io/file_io.hpp"
 #include "util/Options.hpp"
@@ -100,4 +103,71 @@
 //     // printf("%f\n", l);
 //   }
 
-// }
\ No newline at end of file
+// }
+
+struct Optimized
+{
+  double logl;
+  std::vector<double> lengths;
+  double alpha;
+};
+
+static Optimized optimize_reference_(const bool opt, const unsigned int num_threads)
+{
+  Options options;
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  Tree_Numbers nums;
+  raxml::Model model;
+
+  rtree_mapper dummy;
+  auto tree = build_tree_from_file(env->tree_file, nums, dummy);
+  auto part = make_partition(model, nums, msa.num_sites(), options);
+  set_unique_clv_indices(get_root(tree), nums.tip_nodes);
+  link_tree_msa(tree, part, model, msa, nums.tip_nodes);
+
+  optimize(model, tree, part, nums, opt, opt, num_threads);
+  precompute_clvs(tree, part, nums);
+
+  Optimized result;
+  const auto root = get_root(tree);
+  std::vector<unsigned int> param_indices(part->rate_cats, 0);
+  result.logl = pll_compute_edge_loglikelihood( part,
+                                                root->clv_index,
+                                                root->scaler_index,
+                                                root->back->clv_index,
+                                                root->back->scaler_index,
+                                                root->pmatrix_index,
+                                                &param_indices[0],
+                                                nullptr);
+
+  std::vector<pll_unode_t*> branches(nums.branches);
+  utree_query_branches(tree, &branches[0]);
+  for (auto node : branches) {
+    result.lengths.push_back(node->length);
+  }
+  result.alpha = model.alpha();
+
+  pll_partition_destroy(part);
+  pll_utree_destroy(tree, nullptr);
+
+  return result;
+}
+
+TEST(optimize, reference)
+{
+  auto initial  = optimize_reference_(false, 1);
+  auto single   = optimize_reference_(true, 1);
+  auto again    = optimize_reference_(true, 1);
+  auto threaded = optimize_reference_(true, 4);
+
+  EXPECT_GT(single.logl, initial.logl);
+
+  // same seed, same number of threads: same result
+  EXPECT_DOUBLE_EQ(single.logl, again.logl);
+  EXPECT_EQ(single.lengths, again.lengths);
+  EXPECT_DOUBLE_EQ(single.alpha, again.alpha);
+
+  // more threads only change the order of summation
+  EXPECT_NEAR(single.logl, threaded.logl, OPT_EPSILON);
+  EXPECT_GT(threaded.logl, initial.logl);
+}
@@ -4,6 +4,8 @@
 
 #include <vector>
 #include <numeric>
+#include <random>
+#include <cstdlib>
 
 using namespace std;
 
@@ -25,6 +27,98 @@ TEST(schedule, solve)
   EXPECT_EQ(accumulate(nps.begin(), nps.end(), 0), nodes);
 }
 
+TEST(schedule, solve_proportional)
+{
+  vector<unsigned int> expected{2, 4, 2};
+  EXPECT_EQ(expected, solve(3, 8, {1.0, 2.0, 1.0}));
+
+  // every stage gets at least one node, no matter how easy
+  auto nps = solve(4, 32, {1000.0, 1.0, 1000.0, 1.0});
+  vector<unsigned int> expected_min{15, 1, 15, 1};
+  EXPECT_EQ(expected_min, nps);
+
+  // largest remainder
+  vector<unsigned int> expected_rem{3, 2, 2};
+  EXPECT_EQ(expected_rem, solve(3, 7, {1.0, 1.0, 1.0}));
+  vector<unsigned int> expected_rem2{1, 2, 4};
+  EXPECT_EQ(expected_rem2, solve(3, 7, {0.3, 2.0, 4.2}));
+
+  EXPECT_ANY_THROW(solve(4, 3, {1.0, 1.0, 1.0, 1.0}));
+}
+
+TEST(schedule, solve_fixed)
+{
+  auto nps = solve(4, 10, {100.0, 1.0, 3.0, 1.0}, {1, 0, 0, 0});
+  vector<unsigned int> expected{1, 2, 5, 2};
+  ASSERT_EQ(expected.size(), nps.size());
+  EXPECT_EQ(1u, nps[0]);
+  EXPECT_EQ(10u, accumulate(nps.begin(), nps.end(), 0u));
+  EXPECT_GT(nps[2], nps[1]);
+  EXPECT_GT(nps[2], nps[3]);
+
+  EXPECT_ANY_THROW(solve(2, 4, {1.0, 1.0}, {2, 1}));
+  EXPECT_ANY_THROW(solve(2, 4, {1.0, 1.0}, {4, 0}));
+}
+
+TEST(schedule, hysteresis)
+{
+  const vector<double> diff{1.0, 6.0, 12.0, 2.0};
+
+  // same assignment: never worth it
+  EXPECT_FALSE(worth_reassigning({1, 2, 4, 1}, {1, 2, 4, 1}, diff, 0.0));
+  // big improvement
+  EXPECT_TRUE(worth_reassigning({1, 4, 2, 1}, {1, 2, 4, 1}, diff, 0.1));
+  // marginal improvement
+  EXPECT_FALSE(worth_reassigning({1, 2, 4, 1}, {1, 2, 4, 1}, {1.0, 6.0, 12.1, 2.0}, 0.1));
+  EXPECT_DOUBLE_EQ(3.0, bottleneck({1, 2, 4, 1}, diff));
+}
+
+TEST(schedule, convergence)
+{
+  // simulated pipeline: each stage needs a fixed amount of work per chunk,
+  // measured with up to 30% noise
+  const vector<double> work{1.0, 30.0, 60.0, 10.0};
+  const vector<unsigned int> fixed{1, 0, 0, 0};
+  const unsigned int nodes = 16;
+  const size_t rounds = 60;
+
+  const auto ideal = solve(work.size(), nodes, work, fixed);
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> noise(0.7, 1.3);
+
+  auto simulate = [&](const double alpha, const double hysteresis) {
+    auto nps = solve(work.size(), nodes, vector<double>(work.size(), 1.0), fixed);
+    vector<double> smoothed;
+    size_t late_changes = 0;
+    for (size_t round = 0; round < rounds; ++round) {
+      vector<double> measured(work.size());
+      for (size_t i = 0; i < work.size(); ++i) {
+        measured[i] = work[i] * noise(gen);
+      }
+      to_difficulty(measured);
+      smooth_difficulty(smoothed, measured, alpha);
+      auto proposed = solve(work.size(), nodes, smoothed, fixed);
+      if (worth_reassigning(nps, proposed, smoothed, hysteresis)) {
+        nps = proposed;
+        late_changes += (round >= 10);
+      }
+    }
+    return std::make_pair(nps, late_changes);
+  };
+
+  const auto damped = simulate(0.3, 0.1);
+  const auto undamped = simulate(1.0, 0.0);
+
+  // converges close to the ideal assignment...
+  for (size_t i = 0; i < ideal.size(); ++i) {
+    EXPECT_LE(std::abs(static_cast<int>(damped.first[i]) - static_cast<int>(ideal[i])), 1);
+  }
+  // ...and mostly stays there, unlike without damping
+  EXPECT_LE(damped.second, 2u);
+  EXPECT_GE(undamped.second, 10u);
+}
+
 TEST(schedule, to_difficulty)
 {
   std::vector<double> perstage_avg = {20.0, 2.0, 10.0, 3.0};
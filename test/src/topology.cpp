@@ -0,0 +1,48 @@
+#include "Epatest.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "util/topology.hpp"
+
+using namespace std;
+
+TEST(topology, cpulist)
+{
+  EXPECT_EQ(vector<int>({0, 1, 2, 3, 8, 10, 11}), parse_cpulist("0-3,8,10-11\n"));
+  EXPECT_EQ(vector<int>({5}), parse_cpulist("5"));
+  EXPECT_TRUE(parse_cpulist("").empty());
+  EXPECT_ANY_THROW(parse_cpulist("3-1"));
+  EXPECT_ANY_THROW(parse_cpulist("a-b"));
+
+  EXPECT_EQ("0-3,8,10-11", format_cpulist({11, 0, 1, 2, 3, 8, 10}));
+  EXPECT_EQ("", format_cpulist({}));
+}
+
+TEST(topology, numa_domains)
+{
+  // fake sysfs tree: two domains of cpus, plus one memory-only node
+  const string sysfs(env->out_dir + "fake_sysfs_node/");
+  ASSERT_EQ(0, system(("mkdir -p " + sysfs + "node0 " + sysfs + "node1 " + sysfs + "node2").c_str()));
+  ofstream(sysfs + "node0/cpulist") << "0-1\n";
+  ofstream(sysfs + "node1/cpulist") << "2-3\n";
+  ofstream(sysfs + "node2/cpulist") << "\n";
+
+  const auto domains = numa_domains(sysfs);
+
+  // we can only expect what this process is allowed to run on, but the
+  // domains must never overlap
+  ASSERT_FALSE(domains.empty());
+  EXPECT_LE(domains.size(), 2u);
+  for (size_t i = 1; i < domains.size(); ++i) {
+    ASSERT_FALSE(domains[i].empty());
+    EXPECT_LT(domains[i - 1].back(), domains[i].front());
+  }
+
+  // no information at all: everything is one domain
+  const auto fallback = numa_domains(env->out_dir + "does_not_exist");
+  EXPECT_EQ(1u, fallback.size());
+  EXPECT_FALSE(fallback[0].empty());
+}